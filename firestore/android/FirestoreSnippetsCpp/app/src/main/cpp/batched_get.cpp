@@ -0,0 +1,138 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "batched_get.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace snippets {
+
+using firebase::Future;
+using firebase::firestore::CollectionReference;
+using firebase::firestore::DocumentReference;
+using firebase::firestore::DocumentSnapshot;
+using firebase::firestore::Error;
+using firebase::firestore::FieldPath;
+using firebase::firestore::FieldValue;
+using firebase::firestore::QuerySnapshot;
+
+namespace {
+
+struct GetAllState {
+  std::mutex mutex;
+  std::vector<DocumentSnapshot> results;
+  size_t remaining = 0;
+  Error error = Error::kErrorOk;
+  std::string error_message;
+  std::function<void(std::vector<DocumentSnapshot>, Error, const std::string&)>
+      callback;
+};
+
+// The documents requested from one parent collection.
+struct Group {
+  CollectionReference collection;
+  // Positions in the input of each requested ID. An ID may be requested more
+  // than once.
+  std::unordered_map<std::string, std::vector<size_t>> positions;
+  std::vector<std::string> ids;
+};
+
+}  // namespace
+
+void GetAll(
+    const std::vector<DocumentReference>& documents, GetAllOptions options,
+    std::function<void(std::vector<DocumentSnapshot>, Error,
+                       const std::string&)>
+        callback) {
+  if (documents.empty()) {
+    callback({}, Error::kErrorOk, "");
+    return;
+  }
+
+  std::map<std::string, Group> groups;
+  for (size_t i = 0; i < documents.size(); ++i) {
+    CollectionReference parent = documents[i].Parent();
+    Group& group = groups[parent.path()];
+    group.collection = parent;
+    std::vector<size_t>& positions = group.positions[documents[i].id()];
+    if (positions.empty()) {
+      group.ids.push_back(documents[i].id());
+    }
+    positions.push_back(i);
+  }
+
+  size_t chunk_size = static_cast<size_t>(std::max(1, options.max_in_values));
+  size_t chunks = 0;
+  for (const auto& entry : groups) {
+    chunks += (entry.second.ids.size() + chunk_size - 1) / chunk_size;
+  }
+
+  auto state = std::make_shared<GetAllState>();
+  state->results.resize(documents.size());
+  state->remaining = chunks;
+  state->callback = std::move(callback);
+
+  for (auto& entry : groups) {
+    // Shared by all chunks of the group, so the position lookup isn't copied
+    // once per query.
+    auto group = std::make_shared<Group>(std::move(entry.second));
+
+    for (size_t begin = 0; begin < group->ids.size(); begin += chunk_size) {
+      size_t end = std::min(begin + chunk_size, group->ids.size());
+      std::vector<FieldValue> ids;
+      ids.reserve(end - begin);
+      for (size_t i = begin; i < end; ++i) {
+        ids.push_back(FieldValue::String(group->ids[i]));
+      }
+
+      group->collection.WhereIn(FieldPath::DocumentId(), ids)
+          .Get(options.source)
+          .OnCompletion([state, group](const Future<QuerySnapshot>& future) {
+            std::unique_lock<std::mutex> lock(state->mutex);
+            if (future.error() == Error::kErrorOk) {
+              for (const DocumentSnapshot& document :
+                   future.result()->documents()) {
+                auto found = group->positions.find(document.id());
+                if (found == group->positions.end()) continue;
+                for (size_t position : found->second) {
+                  state->results[position] = document;
+                }
+              }
+            } else if (state->error == Error::kErrorOk) {
+              state->error = static_cast<Error>(future.error());
+              state->error_message = future.error_message();
+            }
+
+            if (--state->remaining > 0) {
+              return;
+            }
+            lock.unlock();
+            if (state->error == Error::kErrorOk) {
+              state->callback(std::move(state->results), Error::kErrorOk, "");
+            } else {
+              state->callback({}, state->error, state->error_message);
+            }
+          });
+    }
+  }
+}
+
+}  // namespace snippets
@@ -0,0 +1,55 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_BATCHED_GET_H
+#define FIRESTORESNIPPETSCPP_BATCHED_GET_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "firebase/firestore.h"
+
+namespace snippets {
+
+struct GetAllOptions {
+  // Maximum number of values in one `WhereIn()` filter. Firestore currently
+  // accepts 30; older backends and emulators accept 10.
+  int max_in_values = 30;
+
+  firebase::firestore::Source source = firebase::firestore::Source::kDefault;
+};
+
+// Reads many known documents with a few queries instead of one `Get()` each.
+//
+// The documents are grouped by parent collection, and each group is fetched
+// with `WhereIn(FieldPath::DocumentId(), ids)` queries of at most
+// `max_in_values` IDs. All queries run in parallel.
+//
+// `callback` receives one snapshot per input reference, in input order.
+// Documents that don't exist get a default-constructed snapshot, for which
+// `is_valid()` is false. If any query fails, `callback` gets that error and
+// no snapshots.
+void GetAll(
+    const std::vector<firebase::firestore::DocumentReference>& documents,
+    GetAllOptions options,
+    std::function<void(std::vector<firebase::firestore::DocumentSnapshot>,
+                       firebase::firestore::Error, const std::string&)>
+        callback);
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_BATCHED_GET_H
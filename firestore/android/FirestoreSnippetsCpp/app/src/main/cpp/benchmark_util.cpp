@@ -0,0 +1,33 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "benchmark_util.h"
+
+#include <algorithm>
+#include <cstddef>
+
+namespace snippets {
+
+std::chrono::microseconds Percentile(
+    const std::vector<std::chrono::microseconds>& sorted, double fraction) {
+  if (sorted.empty()) {
+    return std::chrono::microseconds(0);
+  }
+  size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+  return sorted[std::min(index, sorted.size() - 1)];
+}
+
+}  // namespace snippets
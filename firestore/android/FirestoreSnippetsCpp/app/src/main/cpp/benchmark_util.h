@@ -0,0 +1,32 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_BENCHMARK_UTIL_H
+#define FIRESTORESNIPPETSCPP_BENCHMARK_UTIL_H
+
+#include <chrono>
+#include <vector>
+
+namespace snippets {
+
+// Returns the value at `fraction` (0 to 1) of the way through `sorted`,
+// rounding to the nearest index, or 0 if `sorted` is empty.
+std::chrono::microseconds Percentile(
+    const std::vector<std::chrono::microseconds>& sorted, double fraction);
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_BENCHMARK_UTIL_H
@@ -0,0 +1,215 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "bulk_loader.h"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+#include "field_value_json.h"
+
+namespace snippets {
+
+using firebase::Future;
+using firebase::firestore::CollectionReference;
+using firebase::firestore::DocumentReference;
+using firebase::firestore::Error;
+using firebase::firestore::MapFieldValue;
+using firebase::firestore::WriteBatch;
+
+namespace {
+
+// Errors caused by contention or a temporarily unavailable backend; a later
+// attempt of the same batch may succeed.
+bool IsRetryable(int error) {
+  switch (error) {
+    case Error::kErrorAborted:
+    case Error::kErrorUnavailable:
+    case Error::kErrorResourceExhausted:
+    case Error::kErrorDeadlineExceeded:
+      return true;
+    default:
+      return false;
+  }
+}
+
+std::chrono::milliseconds Backoff(std::chrono::milliseconds initial,
+                                  int attempt) {
+  static thread_local std::mt19937 rng{std::random_device{}()};
+  std::uniform_real_distribution<double> jitter(0.5, 1.5);
+  double delay =
+      initial.count() * static_cast<double>(1 << std::min(attempt, 10));
+  return std::chrono::milliseconds(static_cast<int64_t>(delay * jitter(rng)));
+}
+
+}  // namespace
+
+BulkLoader::BulkLoader(firebase::firestore::Firestore* db,
+                       BulkLoadOptions options)
+    : db_(db),
+      options_(std::move(options)),
+      start_(Clock::now()),
+      pending_(std::make_shared<Batch>()),
+      state_(std::make_shared<State>()) {}
+
+BulkLoader::~BulkLoader() { Finish(); }
+
+void BulkLoader::Set(const DocumentReference& document,
+                     const MapFieldValue& data) {
+  pending_->writes.emplace_back(document, data);
+  if (static_cast<int>(pending_->writes.size()) >= options_.batch_size) {
+    FlushPending();
+  }
+}
+
+int64_t BulkLoader::LoadNdjson(std::istream& input,
+                               const CollectionReference& collection) {
+  int64_t queued = 0;
+  int64_t line_number = 0;
+  std::string line;
+  while (std::getline(input, line)) {
+    ++line_number;
+    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+      continue;
+    }
+
+    MapFieldValue data;
+    std::string error_message;
+    if (!ParseJsonObject(line, &data, &error_message)) {
+      std::cout << "Skipping line " << line_number << ": " << error_message
+                << std::endl;
+      std::lock_guard<std::mutex> lock(state_->mutex);
+      ++state_->stats.documents_failed;
+      continue;
+    }
+
+    DocumentReference document;
+    auto id = data.find(options_.id_field);
+    if (id != data.end() && id->second.is_string()) {
+      document = collection.Document(id->second.string_value());
+      data.erase(id);
+    } else {
+      document = collection.Document();
+    }
+
+    Set(document, data);
+    ++queued;
+  }
+  return queued;
+}
+
+BulkLoadStats BulkLoader::Finish() {
+  FlushPending();
+  WaitUntilOutstandingBelow(1);
+
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  BulkLoadStats stats = state_->stats;
+  stats.elapsed_seconds =
+      std::chrono::duration<double>(Clock::now() - start_).count();
+  return stats;
+}
+
+void BulkLoader::FlushPending() {
+  if (pending_->writes.empty()) {
+    return;
+  }
+
+  WaitUntilOutstandingBelow(options_.max_in_flight_batches);
+  std::shared_ptr<Batch> batch = std::move(pending_);
+  pending_ = std::make_shared<Batch>();
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    ++state_->in_flight;
+  }
+  Commit(std::move(batch));
+}
+
+void BulkLoader::WaitUntilOutstandingBelow(int limit) {
+  std::unique_lock<std::mutex> lock(state_->mutex);
+  while (true) {
+    // Re-issue batches whose backoff has expired. Retries are committed from
+    // this thread rather than from the failed commit's callback so that no
+    // SDK thread ever sleeps.
+    Clock::time_point now = Clock::now();
+    auto due = std::partition(
+        state_->retries.begin(), state_->retries.end(),
+        [now](const std::shared_ptr<Batch>& b) { return b->not_before > now; });
+    std::vector<std::shared_ptr<Batch>> ready(due, state_->retries.end());
+    state_->retries.erase(due, state_->retries.end());
+    if (!ready.empty()) {
+      state_->in_flight += static_cast<int>(ready.size());
+      lock.unlock();
+      for (auto& batch : ready) {
+        Commit(std::move(batch));
+      }
+      lock.lock();
+      continue;
+    }
+
+    int outstanding =
+        state_->in_flight + static_cast<int>(state_->retries.size());
+    if (outstanding < limit) {
+      return;
+    }
+
+    if (state_->retries.empty()) {
+      state_->cv.wait(lock);
+    } else {
+      auto earliest = std::min_element(
+          state_->retries.begin(), state_->retries.end(),
+          [](const std::shared_ptr<Batch>& a, const std::shared_ptr<Batch>& b) {
+            return a->not_before < b->not_before;
+          });
+      state_->cv.wait_until(lock, (*earliest)->not_before);
+    }
+  }
+}
+
+void BulkLoader::Commit(std::shared_ptr<Batch> batch) {
+  WriteBatch write_batch = db_->batch();
+  for (const Write& write : batch->writes) {
+    write_batch.Set(write.first, write.second);
+  }
+  ++batch->attempt;
+
+  std::shared_ptr<State> state = state_;
+  BulkLoadOptions options = options_;
+  write_batch.Commit().OnCompletion(
+      [state, batch, options](const Future<void>& future) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        --state->in_flight;
+        int64_t size = static_cast<int64_t>(batch->writes.size());
+
+        if (future.error() == Error::kErrorOk) {
+          state->stats.documents_written += size;
+          ++state->stats.batches_committed;
+        } else if (IsRetryable(future.error()) &&
+                   batch->attempt < options.max_attempts) {
+          ++state->stats.retries;
+          batch->not_before = Clock::now() + Backoff(options.initial_backoff,
+                                                     batch->attempt - 1);
+          state->retries.push_back(batch);
+        } else {
+          std::cout << "Bulk load batch failed after " << batch->attempt
+                    << " attempt(s): " << future.error_message() << std::endl;
+          state->stats.documents_failed += size;
+        }
+        state->cv.notify_all();
+      });
+}
+
+}  // namespace snippets
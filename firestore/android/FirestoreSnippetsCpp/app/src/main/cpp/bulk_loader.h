@@ -0,0 +1,142 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_BULK_LOADER_H
+#define FIRESTORESNIPPETSCPP_BULK_LOADER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "firebase/firestore.h"
+
+namespace snippets {
+
+struct BulkLoadOptions {
+  // Number of writes grouped into one `WriteBatch`. Firestore rejects batches
+  // with more than 500 writes.
+  int batch_size = 500;
+
+  // Maximum number of batches being committed at the same time. Further calls
+  // to `BulkLoader::Set()` block until a commit finishes.
+  int max_in_flight_batches = 8;
+
+  // Number of times a batch is attempted before its documents are reported as
+  // failed. Only contention and availability errors are retried.
+  int max_attempts = 5;
+
+  // Delay before the first retry of a batch. Each further retry doubles the
+  // delay, with random jitter so that contending batches spread out.
+  std::chrono::milliseconds initial_backoff{200};
+
+  // Field of each NDJSON object that holds the document ID. The field is not
+  // written to the document. Objects without it get an auto-generated ID.
+  std::string id_field = "id";
+};
+
+struct BulkLoadStats {
+  int64_t documents_written = 0;
+  int64_t documents_failed = 0;
+  int64_t batches_committed = 0;
+  int64_t retries = 0;
+  double elapsed_seconds = 0;
+
+  double documents_per_second() const {
+    return elapsed_seconds > 0 ? documents_written / elapsed_seconds : 0;
+  }
+};
+
+// Writes large numbers of documents by splitting them into `WriteBatch`es
+// that are committed in parallel.
+//
+// Unlike a hand-written sequence of `Set()` calls, the loader keeps a bounded
+// number of commits in flight, retries batches that fail because of
+// contention, and reports the achieved throughput. It is meant for seeding
+// test datasets, e.g. on the emulator:
+//
+//   BulkLoader loader(db);
+//   loader.LoadNdjson(input, db->Collection("cities"));
+//   BulkLoadStats stats = loader.Finish();
+//
+// `Set()`, `LoadNdjson()` and `Finish()` block, so they must not be called
+// from a Firestore callback.
+class BulkLoader {
+ public:
+  explicit BulkLoader(firebase::firestore::Firestore* db,
+                      BulkLoadOptions options = BulkLoadOptions());
+
+  // Waits for outstanding commits.
+  ~BulkLoader();
+
+  BulkLoader(const BulkLoader&) = delete;
+  BulkLoader& operator=(const BulkLoader&) = delete;
+
+  // Queues a write of `data` to `document`, overwriting any existing
+  // contents.
+  void Set(const firebase::firestore::DocumentReference& document,
+           const firebase::firestore::MapFieldValue& data);
+
+  // Reads one JSON object per line from `input` and queues it for writing to
+  // `collection`. Blank lines are skipped; malformed lines are logged and
+  // counted as failed documents. Returns the number of documents queued.
+  int64_t LoadNdjson(
+      std::istream& input,
+      const firebase::firestore::CollectionReference& collection);
+
+  // Commits any remaining writes, waits until every batch has either been
+  // committed or has run out of attempts, and returns the totals.
+  BulkLoadStats Finish();
+
+ private:
+  using Clock = std::chrono::steady_clock;
+  using Write = std::pair<firebase::firestore::DocumentReference,
+                          firebase::firestore::MapFieldValue>;
+
+  struct Batch {
+    std::vector<Write> writes;
+    int attempt = 0;
+    Clock::time_point not_before;
+  };
+
+  // State shared with commit callbacks.
+  struct State {
+    std::mutex mutex;
+    std::condition_variable cv;
+    int in_flight = 0;
+    std::vector<std::shared_ptr<Batch>> retries;
+    BulkLoadStats stats;
+  };
+
+  void FlushPending();
+  void WaitUntilOutstandingBelow(int limit);
+  void Commit(std::shared_ptr<Batch> batch);
+
+  firebase::firestore::Firestore* db_ = nullptr;
+  BulkLoadOptions options_;
+  Clock::time_point start_;
+  std::shared_ptr<Batch> pending_;
+  std::shared_ptr<State> state_;
+};
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_BULK_LOADER_H
@@ -0,0 +1,341 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "bundle_benchmark.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+#include "field_value_json.h"
+#include "streaming_bundle_loader.h"
+
+namespace snippets {
+
+using firebase::Future;
+using firebase::Timestamp;
+using firebase::firestore::Error;
+using firebase::firestore::Firestore;
+using firebase::firestore::LoadBundleTaskProgress;
+using firebase::firestore::Query;
+using firebase::firestore::QuerySnapshot;
+using firebase::firestore::Source;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::string TimestampJson(const Timestamp& timestamp) {
+  return "{\"seconds\":" + std::to_string(timestamp.seconds()) +
+         ",\"nanos\":" + std::to_string(timestamp.nanoseconds()) + "}";
+}
+
+// Generates the elements of a synthetic bundle. Every element is generated
+// on demand, so the bundle can be sized without holding it in memory.
+class SyntheticElements {
+ public:
+  SyntheticElements(const SyntheticBundleOptions& options,
+                    const Timestamp& read_time)
+      : options_(options),
+        read_time_(TimestampJson(read_time)),
+        payload_(static_cast<size_t>(std::max(0, options.payload_bytes)),
+                 'x') {
+    AppendJsonString(options.query_name, &query_name_);
+  }
+
+  std::string NamedQuery() const {
+    std::string element = "{\"namedQuery\":{\"name\":" + query_name_ +
+                          ",\"bundledQuery\":{\"parent\":";
+    AppendJsonString(options_.database_name + "/documents", &element);
+    element += ",\"structuredQuery\":{\"from\":[{\"collectionId\":";
+    AppendJsonString(options_.collection, &element);
+    element +=
+        "}],\"orderBy\":[{\"field\":{\"fieldPath\":\"index\"},"
+        "\"direction\":\"ASCENDING\"}],\"limit\":" +
+        std::to_string(options_.query_limit) +
+        "},\"limitType\":\"FIRST\"},\"readTime\":" + read_time_ + "}}";
+    return element;
+  }
+
+  void Document(int index, std::string* metadata,
+                std::string* document) const {
+    std::string name;
+    AppendJsonString(options_.database_name + "/documents/" +
+                         options_.collection + "/doc" + std::to_string(index),
+                     &name);
+    *metadata = "{\"documentMetadata\":{\"name\":" + name +
+                ",\"readTime\":" + read_time_ +
+                ",\"exists\":true,\"queries\":[" + query_name_ + "]}}";
+    *document = "{\"document\":{\"name\":" + name +
+                ",\"fields\":{\"index\":{\"integerValue\":\"" +
+                std::to_string(index) + "\"},\"payload\":{\"stringValue\":\"" +
+                payload_ + "\"}},\"createTime\":" + read_time_ +
+                ",\"updateTime\":" + read_time_ + "}}";
+  }
+
+ private:
+  const SyntheticBundleOptions& options_;
+  std::string read_time_;
+  std::string payload_;
+  std::string query_name_;
+};
+
+int64_t ElementSize(const std::string& element) {
+  return static_cast<int64_t>(std::to_string(element.size()).size() +
+                              element.size());
+}
+
+void WriteElement(const std::string& element, std::ostream& out) {
+  out << element.size();
+  out.write(element.data(), element.size());
+}
+
+// Peak resident set size of the process, in bytes.
+int64_t PeakResidentBytes() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#if defined(__APPLE__)
+  return static_cast<int64_t>(usage.ru_maxrss);
+#else
+  // Linux and Android report kilobytes.
+  return static_cast<int64_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+double SecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+struct RunState {
+  std::mutex mutex;
+  Clock::time_point start;
+  Clock::time_point last_progress;
+  BundleBenchmarkResult result;
+  std::promise<void> done;
+
+  void OnProgress() {
+    std::lock_guard<std::mutex> lock(mutex);
+    Clock::time_point now = Clock::now();
+    if (result.progress_updates == 0) {
+      result.first_progress_seconds = SecondsSince(start);
+    } else {
+      result.max_progress_gap_seconds =
+          std::max(result.max_progress_gap_seconds,
+                   std::chrono::duration<double>(now - last_progress).count());
+    }
+    last_progress = now;
+    ++result.progress_updates;
+  }
+
+  void Finish(Error error) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      result.error = error;
+    }
+    done.set_value();
+  }
+};
+
+// Once the bundle is loaded, measures how long until its named query can be
+// resolved and read, as an app would at startup.
+void QueryAfterLoad(Firestore* db, const std::string& query_name,
+                    std::shared_ptr<RunState> state, Error error) {
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->result.load_seconds = SecondsSince(state->start);
+  }
+  if (error != Error::kErrorOk) {
+    state->Finish(error);
+    return;
+  }
+
+  db->NamedQuery(query_name)
+      .OnCompletion([state](const Future<Query>& query) {
+        {
+          std::lock_guard<std::mutex> lock(state->mutex);
+          state->result.named_query_seconds = SecondsSince(state->start);
+        }
+        if (query.error() != Error::kErrorOk) {
+          state->Finish(static_cast<Error>(query.error()));
+          return;
+        }
+        query.result()->Get(Source::kCache).OnCompletion(
+            [state](const Future<QuerySnapshot>& snapshot) {
+              {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->result.first_query_seconds = SecondsSince(state->start);
+              }
+              state->Finish(static_cast<Error>(snapshot.error()));
+            });
+      });
+}
+
+BundleBenchmarkResult RunOne(Firestore* db,
+                             const BundleBenchmarkOptions& options,
+                             int documents) {
+  Timestamp now = Timestamp::Now();
+  SyntheticBundleOptions bundle_options;
+  // A new ID for every run, so that the SDK doesn't skip the bundle.
+  bundle_options.bundle_id = "bundle-benchmark-" + std::to_string(documents) +
+                             "-" + std::to_string(now.seconds()) + "-" +
+                             std::to_string(now.nanoseconds());
+  bundle_options.database_name = std::string("projects/") +
+                                 db->app()->options().project_id() +
+                                 "/databases/(default)";
+  bundle_options.documents = documents;
+  bundle_options.payload_bytes = options.payload_bytes;
+
+  std::string path = "bundle_benchmark_" + std::to_string(documents) +
+                     ".bundle";
+  if (!options.directory.empty()) {
+    path = options.directory + "/" + path;
+  }
+
+  auto state = std::make_shared<RunState>();
+  state->result.documents = documents;
+  std::string error_message;
+  state->result.bundle_bytes =
+      WriteSyntheticBundle(path, bundle_options, &error_message);
+  if (state->result.bundle_bytes < 0) {
+    std::cout << "Warning: " << error_message << std::endl;
+    state->result.error = Error::kErrorInternal;
+    return state->result;
+  }
+
+  std::string query_name = bundle_options.query_name;
+  if (options.chunk_bytes == 0) {
+    std::string bundle;
+    {
+      std::ifstream in(path, std::ios::binary);
+      std::ostringstream contents;
+      contents << in.rdbuf();
+      bundle = contents.str();
+    }
+    state->start = Clock::now();
+    db->LoadBundle(bundle,
+                   [state](const LoadBundleTaskProgress& progress) {
+                     if (progress.state() !=
+                         LoadBundleTaskProgress::State::kError) {
+                       state->OnProgress();
+                     }
+                   })
+        .OnCompletion([db, query_name,
+                       state](const Future<LoadBundleTaskProgress>& future) {
+          QueryAfterLoad(db, query_name, state,
+                         static_cast<Error>(future.error()));
+        });
+  } else {
+    StreamingBundleOptions streaming_options;
+    streaming_options.chunk_bytes = options.chunk_bytes;
+    state->start = Clock::now();
+    LoadBundleFile(
+        db, path, streaming_options,
+        [state](const StreamingBundleProgress&) { state->OnProgress(); },
+        [db, query_name, state](Error error, const std::string&) {
+          QueryAfterLoad(db, query_name, state, error);
+        });
+  }
+
+  state->done.get_future().wait();
+  std::remove(path.c_str());
+
+  std::lock_guard<std::mutex> lock(state->mutex);
+  state->result.peak_rss_bytes = PeakResidentBytes();
+  return state->result;
+}
+
+}  // namespace
+
+int64_t WriteSyntheticBundle(const std::string& path,
+                             const SyntheticBundleOptions& options,
+                             std::string* error_message) {
+  Timestamp now = Timestamp::Now();
+  SyntheticElements elements(options, now);
+  std::string named_query = elements.NamedQuery();
+  std::string metadata;
+  std::string document;
+
+  // The metadata records the size of the rest of the bundle, so the
+  // documents are generated twice: once to measure them, once to write them.
+  int64_t total_bytes = ElementSize(named_query);
+  for (int i = 0; i < options.documents; ++i) {
+    elements.Document(i, &metadata, &document);
+    total_bytes += ElementSize(metadata) + ElementSize(document);
+  }
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    *error_message = "can't write " + path;
+    return -1;
+  }
+  std::string header = "{\"metadata\":{\"id\":";
+  AppendJsonString(options.bundle_id, &header);
+  header += ",\"createTime\":" + TimestampJson(now) +
+            ",\"version\":1,\"totalDocuments\":" +
+            std::to_string(options.documents) +
+            ",\"totalBytes\":" + std::to_string(total_bytes) + "}}";
+  WriteElement(header, out);
+  WriteElement(named_query, out);
+  for (int i = 0; i < options.documents; ++i) {
+    elements.Document(i, &metadata, &document);
+    WriteElement(metadata, out);
+    WriteElement(document, out);
+  }
+  out.flush();
+  if (!out) {
+    *error_message = "can't write " + path;
+    return -1;
+  }
+  return ElementSize(header) + total_bytes;
+}
+
+std::vector<BundleBenchmarkResult> RunBundleBenchmark(
+    Firestore* db, BundleBenchmarkOptions options) {
+  std::vector<BundleBenchmarkResult> results;
+  for (int documents : options.document_counts) {
+    results.push_back(RunOne(db, options, documents));
+  }
+  return results;
+}
+
+std::string ToJson(const BundleBenchmarkResult& result) {
+  std::ostringstream out;
+  out << "{\"documents\":" << result.documents
+      << ",\"bundle_bytes\":" << result.bundle_bytes
+      << ",\"error\":" << static_cast<int>(result.error)
+      << ",\"load_seconds\":" << result.load_seconds
+      << ",\"documents_per_second\":" << result.documents_per_second()
+      << ",\"bytes_per_second\":" << result.bytes_per_second()
+      << ",\"first_progress_seconds\":" << result.first_progress_seconds
+      << ",\"max_progress_gap_seconds\":" << result.max_progress_gap_seconds
+      << ",\"progress_updates\":" << result.progress_updates
+      << ",\"named_query_seconds\":" << result.named_query_seconds
+      << ",\"first_query_seconds\":" << result.first_query_seconds
+      << ",\"peak_rss_bytes\":" << result.peak_rss_bytes << "}";
+  return out.str();
+}
+
+}  // namespace snippets
@@ -0,0 +1,114 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_BUNDLE_BENCHMARK_H
+#define FIRESTORESNIPPETSCPP_BUNDLE_BENCHMARK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "firebase/firestore.h"
+
+namespace snippets {
+
+struct SyntheticBundleOptions {
+  std::string bundle_id = "synthetic";
+  // Full name of the database, "projects/<project>/databases/<database>".
+  std::string database_name;
+  std::string collection = "bundle_benchmark";
+  int documents = 1000;
+  // Size of the string field in each document.
+  int payload_bytes = 100;
+  // Name and limit of the named query included in the bundle, which returns
+  // the first documents by index.
+  std::string query_name = "bundle_benchmark_query";
+  int query_limit = 20;
+};
+
+// Writes a bundle of `documents` generated documents, plus one named query,
+// to the file at `path`. The bundle is written as it is generated, so that
+// large bundles don't have to fit in memory. Returns the size of the bundle,
+// or -1 with `error_message` set if the file can't be written.
+int64_t WriteSyntheticBundle(const std::string& path,
+                             const SyntheticBundleOptions& options,
+                             std::string* error_message);
+
+struct BundleBenchmarkOptions {
+  // Number of documents in each bundle, one run each.
+  std::vector<int> document_counts = {1000, 10000, 100000, 1000000};
+  int payload_bytes = 100;
+
+  // Directory in which bundle files are written, e.g. the app's cache
+  // directory. Each file is removed after its run.
+  std::string directory;
+
+  // 0 loads each bundle with a single `LoadBundle()` call, after reading the
+  // file into memory; otherwise bundles are loaded with `LoadBundleFile()` in
+  // chunks of this size.
+  size_t chunk_bytes = 0;
+};
+
+struct BundleBenchmarkResult {
+  int documents = 0;
+  int64_t bundle_bytes = 0;
+  firebase::firestore::Error error = firebase::firestore::Error::kErrorOk;
+
+  // From the start of the load until it completes.
+  double load_seconds = 0;
+  // Until the first progress update.
+  double first_progress_seconds = 0;
+  // Longest time between two progress updates.
+  double max_progress_gap_seconds = 0;
+  int progress_updates = 0;
+
+  // From the start of the load until `NamedQuery()` resolves, and until the
+  // first page of that query has been read from the cache.
+  double named_query_seconds = 0;
+  double first_query_seconds = 0;
+
+  // The process's peak resident set size after the run. This is a high-water
+  // mark over the life of the process, so runs go from small to large.
+  int64_t peak_rss_bytes = 0;
+
+  double documents_per_second() const {
+    return load_seconds > 0 ? documents / load_seconds : 0;
+  }
+  double bytes_per_second() const {
+    return load_seconds > 0 ? bundle_bytes / load_seconds : 0;
+  }
+};
+
+// Generates and loads a bundle for each entry of `document_counts`, and
+// measures how long it takes until the data can be queried.
+//
+// Each bundle gets a new ID, so that the SDK doesn't skip it as already
+// loaded, but its documents overwrite those of the previous runs. Use a
+// project or emulator that nothing else depends on.
+//
+// Blocks until every run has finished, so it must not be called from a
+// Firestore callback.
+std::vector<BundleBenchmarkResult> RunBundleBenchmark(
+    firebase::firestore::Firestore* db, BundleBenchmarkOptions options);
+
+// Formats `result` as a single-line JSON object, so that a series of results
+// can be written as JSON Lines and compared across runs and devices.
+std::string ToJson(const BundleBenchmarkResult& result);
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_BUNDLE_BENCHMARK_H
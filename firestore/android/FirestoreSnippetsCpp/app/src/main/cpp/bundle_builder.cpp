@@ -0,0 +1,574 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "bundle_builder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+
+#include "field_value_json.h"
+#include "future_combinators.h"
+
+namespace snippets {
+
+using firebase::Future;
+using firebase::Timestamp;
+using firebase::firestore::DocumentReference;
+using firebase::firestore::DocumentSnapshot;
+using firebase::firestore::Error;
+using firebase::firestore::FieldValue;
+using firebase::firestore::Firestore;
+using firebase::firestore::MapFieldValue;
+using firebase::firestore::Query;
+using firebase::firestore::QuerySnapshot;
+using firebase::firestore::Source;
+
+namespace {
+
+void AppendTimestamp(const Timestamp& timestamp, std::string* out) {
+  out->append("{\"seconds\":");
+  out->append(std::to_string(timestamp.seconds()));
+  out->append(",\"nanos\":");
+  out->append(std::to_string(timestamp.nanoseconds()));
+  out->push_back('}');
+}
+
+// JSON has no NaN or infinity; the protobuf JSON mapping spells them as
+// strings.
+void AppendDouble(double value, std::string* out) {
+  if (std::isnan(value)) {
+    out->append("\"NaN\"");
+  } else if (std::isinf(value)) {
+    out->append(value > 0 ? "\"Infinity\"" : "\"-Infinity\"");
+  } else {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+    out->append(buffer);
+  }
+}
+
+void AppendBase64(const uint8_t* data, size_t size, std::string* out) {
+  static const char kAlphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  out->push_back('"');
+  for (size_t i = 0; i < size; i += 3) {
+    uint32_t group = static_cast<uint32_t>(data[i]) << 16;
+    if (i + 1 < size) group |= static_cast<uint32_t>(data[i + 1]) << 8;
+    if (i + 2 < size) group |= data[i + 2];
+    out->push_back(kAlphabet[(group >> 18) & 0x3f]);
+    out->push_back(kAlphabet[(group >> 12) & 0x3f]);
+    out->push_back(i + 1 < size ? kAlphabet[(group >> 6) & 0x3f] : '=');
+    out->push_back(i + 2 < size ? kAlphabet[group & 0x3f] : '=');
+  }
+  out->push_back('"');
+}
+
+// Values are encoded as in the Firestore REST API, e.g. {"integerValue":"1"}.
+class ValueEncoder {
+ public:
+  explicit ValueEncoder(std::string database_name)
+      : documents_root_(std::move(database_name) + "/documents") {}
+
+  const std::string& documents_root() const { return documents_root_; }
+
+  std::string DocumentName(const std::string& path) const {
+    return documents_root_ + "/" + path;
+  }
+
+  void AppendValue(const FieldValue& value, std::string* out) const {
+    switch (value.type()) {
+      case FieldValue::Type::kBoolean:
+        out->append(value.boolean_value() ? "{\"booleanValue\":true}"
+                                          : "{\"booleanValue\":false}");
+        return;
+      case FieldValue::Type::kInteger:
+        // 64-bit integers are strings, so that JSON parsers that only have
+        // doubles don't round them.
+        out->append("{\"integerValue\":\"");
+        out->append(std::to_string(value.integer_value()));
+        out->append("\"}");
+        return;
+      case FieldValue::Type::kDouble:
+        out->append("{\"doubleValue\":");
+        AppendDouble(value.double_value(), out);
+        out->push_back('}');
+        return;
+      case FieldValue::Type::kTimestamp:
+        out->append("{\"timestampValue\":");
+        AppendTimestamp(value.timestamp_value(), out);
+        out->push_back('}');
+        return;
+      case FieldValue::Type::kString:
+        out->append("{\"stringValue\":");
+        AppendJsonString(value.string_value(), out);
+        out->push_back('}');
+        return;
+      case FieldValue::Type::kBlob:
+        out->append("{\"bytesValue\":");
+        AppendBase64(value.blob_value(), value.blob_size(), out);
+        out->push_back('}');
+        return;
+      case FieldValue::Type::kReference:
+        out->append("{\"referenceValue\":");
+        AppendJsonString(DocumentName(value.reference_value().path()), out);
+        out->push_back('}');
+        return;
+      case FieldValue::Type::kGeoPoint:
+        out->append("{\"geoPointValue\":{\"latitude\":");
+        AppendDouble(value.geo_point_value().latitude(), out);
+        out->append(",\"longitude\":");
+        AppendDouble(value.geo_point_value().longitude(), out);
+        out->append("}}");
+        return;
+      case FieldValue::Type::kArray:
+        out->append("{\"arrayValue\":");
+        AppendArray(value.array_value(), out);
+        out->push_back('}');
+        return;
+      case FieldValue::Type::kMap:
+        out->append("{\"mapValue\":{\"fields\":");
+        AppendFields(value.map_value(), out);
+        out->append("}}");
+        return;
+      default:
+        // Null, and sentinels such as `Delete()`, which never appear in
+        // snapshots.
+        out->append("{\"nullValue\":null}");
+        return;
+    }
+  }
+
+  void AppendArray(const std::vector<FieldValue>& values,
+                   std::string* out) const {
+    out->append("{\"values\":[");
+    for (size_t i = 0; i < values.size(); ++i) {
+      if (i > 0) out->push_back(',');
+      AppendValue(values[i], out);
+    }
+    out->append("]}");
+  }
+
+  // Keys are sorted, so that equal documents encode identically.
+  void AppendFields(const MapFieldValue& fields, std::string* out) const {
+    std::vector<const MapFieldValue::value_type*> sorted;
+    sorted.reserve(fields.size());
+    for (const auto& field : fields) {
+      sorted.push_back(&field);
+    }
+    std::sort(sorted.begin(), sorted.end(),
+              [](const MapFieldValue::value_type* left,
+                 const MapFieldValue::value_type* right) {
+                return left->first < right->first;
+              });
+
+    out->push_back('{');
+    for (size_t i = 0; i < sorted.size(); ++i) {
+      if (i > 0) out->push_back(',');
+      AppendJsonString(sorted[i]->first, out);
+      out->push_back(':');
+      AppendValue(sorted[i]->second, out);
+    }
+    out->push_back('}');
+  }
+
+ private:
+  std::string documents_root_;
+};
+
+const char* OperatorName(QuerySpec::Operator op) {
+  switch (op) {
+    case QuerySpec::Operator::kEqual:
+      return "EQUAL";
+    case QuerySpec::Operator::kNotEqual:
+      return "NOT_EQUAL";
+    case QuerySpec::Operator::kLessThan:
+      return "LESS_THAN";
+    case QuerySpec::Operator::kLessThanOrEqual:
+      return "LESS_THAN_OR_EQUAL";
+    case QuerySpec::Operator::kGreaterThan:
+      return "GREATER_THAN";
+    case QuerySpec::Operator::kGreaterThanOrEqual:
+      return "GREATER_THAN_OR_EQUAL";
+    case QuerySpec::Operator::kArrayContains:
+      return "ARRAY_CONTAINS";
+    case QuerySpec::Operator::kArrayContainsAny:
+      return "ARRAY_CONTAINS_ANY";
+    case QuerySpec::Operator::kIn:
+      return "IN";
+    case QuerySpec::Operator::kNotIn:
+      return "NOT_IN";
+  }
+  return "OPERATOR_UNSPECIFIED";
+}
+
+// Encodes `spec` as a StructuredQuery, together with the parent path it runs
+// under.
+class QueryEncoder {
+ public:
+  QueryEncoder(const ValueEncoder& values, const QuerySpec& spec)
+      : values_(values), spec_(spec) {}
+
+  std::string Parent() const {
+    if (spec_.is_collection_group()) {
+      return values_.documents_root();
+    }
+    size_t slash = spec_.path().rfind('/');
+    if (slash == std::string::npos) {
+      return values_.documents_root();
+    }
+    return values_.DocumentName(spec_.path().substr(0, slash));
+  }
+
+  void AppendStructuredQuery(std::string* out) const {
+    std::string collection_id = spec_.path();
+    if (!spec_.is_collection_group()) {
+      collection_id = collection_id.substr(collection_id.rfind('/') + 1);
+    }
+    out->append("{\"from\":[{\"collectionId\":");
+    AppendJsonString(collection_id, out);
+    out->append(spec_.is_collection_group() ? ",\"allDescendants\":true}]"
+                                            : "}]");
+
+    const std::vector<QuerySpec::Filter>& filters = spec_.filters();
+    if (filters.size() == 1) {
+      out->append(",\"where\":");
+      AppendFilter(filters[0], out);
+    } else if (filters.size() > 1) {
+      out->append(",\"where\":{\"compositeFilter\":{\"op\":\"AND\","
+                  "\"filters\":[");
+      for (size_t i = 0; i < filters.size(); ++i) {
+        if (i > 0) out->push_back(',');
+        AppendFilter(filters[i], out);
+      }
+      out->append("]}}");
+    }
+
+    const std::vector<QuerySpec::Order>& orders = spec_.orders();
+    if (!orders.empty()) {
+      out->append(",\"orderBy\":[");
+      for (size_t i = 0; i < orders.size(); ++i) {
+        if (i > 0) out->push_back(',');
+        out->append("{\"field\":");
+        AppendFieldReference(orders[i].field, out);
+        out->append(orders[i].direction == Query::Direction::kAscending
+                        ? ",\"direction\":\"ASCENDING\"}"
+                        : ",\"direction\":\"DESCENDING\"}");
+      }
+      out->push_back(']');
+    }
+
+    if (spec_.start_bound() != QuerySpec::Bound::kNone) {
+      out->append(",\"startAt\":");
+      AppendCursor(spec_.start_values(),
+                   spec_.start_bound() == QuerySpec::Bound::kStartAt, out);
+    }
+    if (spec_.end_bound() != QuerySpec::Bound::kNone) {
+      out->append(",\"endAt\":");
+      AppendCursor(spec_.end_values(),
+                   spec_.end_bound() == QuerySpec::Bound::kEndBefore, out);
+    }
+    if (spec_.limit() > 0) {
+      out->append(",\"limit\":");
+      out->append(std::to_string(spec_.limit()));
+    }
+    out->push_back('}');
+  }
+
+ private:
+  void AppendFieldReference(const std::string& field, std::string* out) const {
+    out->append("{\"fieldPath\":");
+    AppendJsonString(field, out);
+    out->push_back('}');
+  }
+
+  // Document IDs are given as strings in a `QuerySpec`, but compared as
+  // references by the backend.
+  void AppendOperand(const std::string& field, const FieldValue& value,
+                     std::string* out) const {
+    if (field == kDocumentIdField && value.is_string()) {
+      std::string path = value.string_value();
+      if (!spec_.is_collection_group()) {
+        path = spec_.path() + "/" + path;
+      }
+      out->append("{\"referenceValue\":");
+      AppendJsonString(values_.DocumentName(path), out);
+      out->push_back('}');
+    } else {
+      values_.AppendValue(value, out);
+    }
+  }
+
+  void AppendFilter(const QuerySpec::Filter& filter, std::string* out) const {
+    bool equality = filter.op == QuerySpec::Operator::kEqual ||
+                    filter.op == QuerySpec::Operator::kNotEqual;
+    if (equality && filter.values.size() == 1) {
+      // Comparisons with null and NaN are unary filters.
+      const FieldValue& value = filter.values[0];
+      bool is_nan = value.is_double() && std::isnan(value.double_value());
+      if (value.is_null() || is_nan) {
+        bool negated = filter.op == QuerySpec::Operator::kNotEqual;
+        out->append("{\"unaryFilter\":{\"op\":\"");
+        out->append(negated ? "IS_NOT_" : "IS_");
+        out->append(is_nan ? "NAN" : "NULL");
+        out->append("\",\"field\":");
+        AppendFieldReference(filter.field, out);
+        out->append("}}");
+        return;
+      }
+    }
+
+    out->append("{\"fieldFilter\":{\"field\":");
+    AppendFieldReference(filter.field, out);
+    out->append(",\"op\":\"");
+    out->append(OperatorName(filter.op));
+    out->append("\",\"value\":");
+    bool list = filter.op == QuerySpec::Operator::kIn ||
+                filter.op == QuerySpec::Operator::kNotIn ||
+                filter.op == QuerySpec::Operator::kArrayContainsAny;
+    if (list) {
+      out->append("{\"arrayValue\":{\"values\":[");
+      for (size_t i = 0; i < filter.values.size(); ++i) {
+        if (i > 0) out->push_back(',');
+        AppendOperand(filter.field, filter.values[i], out);
+      }
+      out->append("]}}");
+    } else if (!filter.values.empty()) {
+      AppendOperand(filter.field, filter.values[0], out);
+    } else {
+      out->append("{\"nullValue\":null}");
+    }
+    out->append("}}");
+  }
+
+  // `before` is true if the cursor position is just before the given values,
+  // i.e. for `StartAt()` and `EndBefore()`.
+  void AppendCursor(const std::vector<FieldValue>& values, bool before,
+                    std::string* out) const {
+    out->append("{\"values\":[");
+    for (size_t i = 0; i < values.size(); ++i) {
+      if (i > 0) out->push_back(',');
+      const std::vector<QuerySpec::Order>& orders = spec_.orders();
+      std::string field = i < orders.size() ? orders[i].field : "";
+      AppendOperand(field, values[i], out);
+    }
+    out->append(before ? "],\"before\":true}" : "],\"before\":false}");
+  }
+
+  const ValueEncoder& values_;
+  const QuerySpec& spec_;
+};
+
+void AppendElement(const std::string& element, std::string* out) {
+  out->append(std::to_string(element.size()));
+  out->append(element);
+}
+
+}  // namespace
+
+BundleBuilder::BundleBuilder(std::string bundle_id, std::string project_id,
+                             std::string database_id)
+    : bundle_id_(std::move(bundle_id)),
+      database_name_("projects/" + project_id + "/databases/" + database_id) {}
+
+BundleBuilder::BundledDocument& BundleBuilder::Add(
+    const DocumentSnapshot& document, const Timestamp& read_time) {
+  if (create_time_ < read_time) {
+    create_time_ = read_time;
+  }
+
+  std::string path = document.reference().path();
+  auto found = documents_.find(path);
+  if (found != documents_.end() && read_time < found->second.read_time) {
+    return found->second;
+  }
+
+  BundledDocument& bundled = documents_[path];
+  bundled.read_time = read_time;
+  bundled.exists = document.exists();
+  bundled.element.clear();
+  if (bundled.exists) {
+    ValueEncoder encoder(database_name_);
+    std::string& out = bundled.element;
+    out.append("{\"document\":{\"name\":");
+    AppendJsonString(encoder.DocumentName(path), &out);
+    out.append(",\"fields\":");
+    encoder.AppendFields(document.GetData(), &out);
+    // The real create and update times aren't available to clients. The
+    // read time is no later than the server's, so it is a safe version.
+    out.append(",\"createTime\":");
+    AppendTimestamp(read_time, &out);
+    out.append(",\"updateTime\":");
+    AppendTimestamp(read_time, &out);
+    out.append("}}");
+  }
+  return bundled;
+}
+
+void BundleBuilder::AddDocument(const DocumentSnapshot& document,
+                                const Timestamp& read_time) {
+  Add(document, read_time);
+}
+
+void BundleBuilder::AddNamedQuery(const std::string& name,
+                                  const QuerySpec& spec,
+                                  const QuerySnapshot& results,
+                                  const Timestamp& read_time) {
+  ValueEncoder values(database_name_);
+  QueryEncoder query(values, spec);
+
+  std::string element = "{\"namedQuery\":{\"name\":";
+  AppendJsonString(name, &element);
+  element.append(",\"bundledQuery\":{\"parent\":");
+  AppendJsonString(query.Parent(), &element);
+  element.append(",\"structuredQuery\":");
+  query.AppendStructuredQuery(&element);
+  element.append(",\"limitType\":\"FIRST\"},\"readTime\":");
+  AppendTimestamp(read_time, &element);
+  element.append("}}");
+  named_queries_.push_back(std::move(element));
+
+  for (const DocumentSnapshot& document : results.documents()) {
+    std::vector<std::string>& queries = Add(document, read_time).queries;
+    if (std::find(queries.begin(), queries.end(), name) == queries.end()) {
+      queries.push_back(name);
+    }
+  }
+  if (create_time_ < read_time) {
+    create_time_ = read_time;
+  }
+}
+
+std::string BundleBuilder::Build() const {
+  ValueEncoder encoder(database_name_);
+
+  std::string body;
+  for (const std::string& named_query : named_queries_) {
+    AppendElement(named_query, &body);
+  }
+  for (const auto& entry : documents_) {
+    const BundledDocument& document = entry.second;
+    std::string metadata = "{\"documentMetadata\":{\"name\":";
+    AppendJsonString(encoder.DocumentName(entry.first), &metadata);
+    metadata.append(",\"readTime\":");
+    AppendTimestamp(document.read_time, &metadata);
+    metadata.append(document.exists ? ",\"exists\":true" : ",\"exists\":false");
+    if (!document.queries.empty()) {
+      metadata.append(",\"queries\":[");
+      for (size_t i = 0; i < document.queries.size(); ++i) {
+        if (i > 0) metadata.push_back(',');
+        AppendJsonString(document.queries[i], &metadata);
+      }
+      metadata.push_back(']');
+    }
+    metadata.append("}}");
+    AppendElement(metadata, &body);
+    if (document.exists) {
+      AppendElement(document.element, &body);
+    }
+  }
+
+  std::string metadata = "{\"metadata\":{\"id\":";
+  AppendJsonString(bundle_id_, &metadata);
+  metadata.append(",\"createTime\":");
+  AppendTimestamp(create_time_, &metadata);
+  metadata.append(",\"version\":1,\"totalDocuments\":");
+  metadata.append(std::to_string(documents_.size()));
+  metadata.append(",\"totalBytes\":");
+  metadata.append(std::to_string(body.size()));
+  metadata.append("}}");
+
+  std::string bundle;
+  bundle.reserve(metadata.size() + body.size() + 16);
+  AppendElement(metadata, &bundle);
+  bundle.append(body);
+  return bundle;
+}
+
+namespace {
+
+constexpr char kClockField[] = "time";
+
+void BuildBundleAt(
+    Firestore* db, const std::string& bundle_id,
+    const std::vector<std::pair<std::string, QuerySpec>>& named_queries,
+    const Timestamp& read_time,
+    std::function<void(const std::string&, Error, const std::string&)>
+        callback) {
+  std::vector<Future<QuerySnapshot>> reads;
+  for (const auto& named_query : named_queries) {
+    reads.push_back(named_query.second.ToQuery(db).Get(Source::kServer));
+  }
+
+  auto builder = std::make_shared<BundleBuilder>(
+      bundle_id, db->app()->options().project_id());
+  std::vector<std::pair<std::string, QuerySpec>> queries = named_queries;
+  WhenAll<Future<QuerySnapshot>>(
+      std::move(reads),
+      [builder, queries, read_time,
+       callback](const std::vector<Future<QuerySnapshot>>& done) {
+        for (size_t i = 0; i < done.size(); ++i) {
+          if (done[i].error() != Error::kErrorOk) {
+            callback("", static_cast<Error>(done[i].error()),
+                     done[i].error_message());
+            return;
+          }
+          builder->AddNamedQuery(queries[i].first, queries[i].second,
+                                 *done[i].result(), read_time);
+        }
+        callback(builder->Build(), Error::kErrorOk, "");
+      });
+}
+
+}  // namespace
+
+void BuildBundle(
+    Firestore* db, const std::string& bundle_id,
+    const std::vector<std::pair<std::string, QuerySpec>>& named_queries,
+    const DocumentReference& clock_document,
+    std::function<void(const std::string&, Error, const std::string&)>
+        callback) {
+  DocumentReference clock = clock_document;
+  clock.Set({{kClockField, FieldValue::ServerTimestamp()}})
+      .OnCompletion([db, bundle_id, named_queries, clock,
+                     callback](const Future<void>& written) {
+        if (written.error() != Error::kErrorOk) {
+          callback("", static_cast<Error>(written.error()),
+                   written.error_message());
+          return;
+        }
+        clock.Get(Source::kServer)
+            .OnCompletion([db, bundle_id, named_queries,
+                           callback](const Future<DocumentSnapshot>& read) {
+              if (read.error() != Error::kErrorOk) {
+                callback("", static_cast<Error>(read.error()),
+                         read.error_message());
+                return;
+              }
+              FieldValue time = read.result()->Get(kClockField);
+              if (!time.is_timestamp()) {
+                callback("", Error::kErrorInternal,
+                         "Server timestamp missing from the clock document");
+                return;
+              }
+              BuildBundleAt(db, bundle_id, named_queries,
+                            time.timestamp_value(), callback);
+            });
+      });
+}
+
+}  // namespace snippets
@@ -0,0 +1,110 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_BUNDLE_BUILDER_H
+#define FIRESTORESNIPPETSCPP_BUNDLE_BUILDER_H
+
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "firebase/firestore.h"
+#include "query_spec.h"
+
+namespace snippets {
+
+// Serializes documents and named queries into a Firestore bundle, the format
+// read by `Firestore::LoadBundle()`.
+//
+// A bundle is a sequence of JSON elements, each preceded by its length in
+// bytes: a `metadata` element, then one `namedQuery` per query, then a
+// `documentMetadata` element followed by a `document` element for each
+// document.
+//
+// Bundles are normally built on a server with the Admin SDK. This builder is
+// for producing them from a client, e.g. to ship a snapshot of the example
+// data with an app. Clients can't see when a document was last updated, so
+// each document's update time is the time it was read; a bundle never
+// replaces newer data already in a client's cache.
+class BundleBuilder {
+ public:
+  // `project_id` and `database_id` identify the database that the documents
+  // belong to; a bundle can only be loaded into that database.
+  BundleBuilder(std::string bundle_id, std::string project_id,
+                std::string database_id = "(default)");
+
+  // Adds the query described by `spec` under `name`, along with `results`,
+  // which must be the results of that query read at `read_time`.
+  // `QuerySpec` is needed because a `Query` can't be serialized.
+  void AddNamedQuery(const std::string& name, const QuerySpec& spec,
+                     const firebase::firestore::QuerySnapshot& results,
+                     const firebase::Timestamp& read_time);
+
+  // Adds a single document, or records that it doesn't exist. A document
+  // added more than once keeps the version with the latest `read_time`.
+  void AddDocument(const firebase::firestore::DocumentSnapshot& document,
+                   const firebase::Timestamp& read_time);
+
+  // Returns the serialized bundle. Its creation time is the latest read time
+  // of its contents.
+  std::string Build() const;
+
+  size_t document_count() const { return documents_.size(); }
+
+ private:
+  struct BundledDocument {
+    firebase::Timestamp read_time;
+    bool exists = false;
+    // The `document` element, without its length prefix.
+    std::string element;
+    std::vector<std::string> queries;
+  };
+
+  BundledDocument& Add(const firebase::firestore::DocumentSnapshot& document,
+                       const firebase::Timestamp& read_time);
+
+  std::string bundle_id_;
+  std::string database_name_;
+  firebase::Timestamp create_time_;
+  // Keyed by document path, so that the output doesn't depend on the order
+  // in which documents were added.
+  std::map<std::string, BundledDocument> documents_;
+  std::vector<std::string> named_queries_;
+};
+
+// Reads each query from the server and builds a bundle with the results,
+// each query named by its key in `named_queries`. If a query fails,
+// `callback` gets that error and an empty bundle.
+//
+// Snapshots don't carry their read time, and the device clock may run ahead
+// of the server's, which would make the bundle claim to be newer than it is
+// and let it replace newer cached data. So the read time is taken from the
+// server first: a server timestamp is written to `clock_document` and read
+// back before the queries run. Their results are at least that new, so the
+// bundle's read time is never later than the real one.
+void BuildBundle(
+    firebase::firestore::Firestore* db, const std::string& bundle_id,
+    const std::vector<std::pair<std::string, QuerySpec>>& named_queries,
+    const firebase::firestore::DocumentReference& clock_document,
+    std::function<void(const std::string& bundle, firebase::firestore::Error,
+                       const std::string&)>
+        callback);
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_BUNDLE_BUILDER_H
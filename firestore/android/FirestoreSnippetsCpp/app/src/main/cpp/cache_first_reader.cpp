@@ -0,0 +1,260 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "cache_first_reader.h"
+
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace snippets {
+
+using firebase::Future;
+using firebase::firestore::DocumentReference;
+using firebase::firestore::DocumentSnapshot;
+using firebase::firestore::Error;
+using firebase::firestore::Query;
+using firebase::firestore::QuerySnapshot;
+using firebase::firestore::Source;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Refresh times are pruned once there are this many.
+constexpr size_t kMaxRefreshTimes = 1024;
+
+Source SourceFor(ReadStrategy strategy) {
+  switch (strategy) {
+    case ReadStrategy::kCacheOnly:
+      return Source::kCache;
+    case ReadStrategy::kServerOnly:
+      return Source::kServer;
+    default:
+      return Source::kDefault;
+  }
+}
+
+template <typename T, typename Callback>
+void Deliver(const Future<T>& future, const Callback& callback) {
+  Error error = static_cast<Error>(future.error());
+  if (error == Error::kErrorOk) {
+    callback(*future.result(), error, "");
+  } else {
+    callback(T(), error, future.error_message());
+  }
+}
+
+// Snapshots compare their metadata too, and a cached snapshot never equals a
+// fresh one, so only the data is compared.
+bool SameDocument(const DocumentSnapshot& left,
+                  const DocumentSnapshot& right) {
+  if (left.exists() != right.exists()) {
+    return false;
+  }
+  return !left.exists() || left.GetData() == right.GetData();
+}
+
+bool SameResults(const QuerySnapshot& left, const QuerySnapshot& right) {
+  std::vector<DocumentSnapshot> left_documents = left.documents();
+  std::vector<DocumentSnapshot> right_documents = right.documents();
+  if (left_documents.size() != right_documents.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < left_documents.size(); ++i) {
+    if (left_documents[i].reference().path() !=
+            right_documents[i].reference().path() ||
+        !SameDocument(left_documents[i], right_documents[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string CollectionId(const std::string& path) {
+  size_t slash = path.rfind('/');
+  return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+}  // namespace
+
+struct CacheFirstReader::State {
+  ReadPolicy default_policy;
+
+  mutable std::mutex mutex;
+  std::unordered_map<std::string, ReadPolicy> policies;
+  // When each document or query was last refreshed, by path or canonical
+  // key.
+  std::unordered_map<std::string, Clock::time_point> refreshed;
+  CacheFirstReaderStats stats;
+
+  ReadPolicy PolicyFor(const std::string& collection_path) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = policies.find(collection_path);
+    if (found == policies.end()) {
+      found = policies.find(CollectionId(collection_path));
+    }
+    return found != policies.end() ? found->second : default_policy;
+  }
+
+  void Count(int64_t CacheFirstReaderStats::*counter) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++(stats.*counter);
+  }
+
+  // Returns whether `key` is due for a refresh, and if so records that it is
+  // being refreshed now.
+  bool StartRefresh(const std::string& key, const ReadPolicy& policy) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Clock::time_point now = Clock::now();
+    if (policy.min_refresh_interval.count() > 0) {
+      auto found = refreshed.find(key);
+      if (found != refreshed.end() &&
+          now - found->second < policy.min_refresh_interval) {
+        ++stats.refreshes_skipped;
+        return false;
+      }
+      if (refreshed.size() >= kMaxRefreshTimes) {
+        for (auto it = refreshed.begin(); it != refreshed.end();) {
+          if (now - it->second >= policy.min_refresh_interval) {
+            it = refreshed.erase(it);
+          } else {
+            ++it;
+          }
+        }
+      }
+      refreshed[key] = now;
+    }
+    ++stats.refreshes;
+    return true;
+  }
+};
+
+CacheFirstReader::CacheFirstReader(firebase::firestore::Firestore* db,
+                                   ReadPolicy default_policy)
+    : db_(db), state_(std::make_shared<State>()) {
+  state_->default_policy = default_policy;
+}
+
+void CacheFirstReader::SetPolicy(const std::string& collection,
+                                 ReadPolicy policy) {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  state_->policies[collection] = policy;
+}
+
+void CacheFirstReader::Get(const DocumentReference& document,
+                           DocumentCallback callback,
+                           DocumentCallback on_change) {
+  ReadPolicy policy = state_->PolicyFor(document.Parent().path());
+  if (policy.strategy != ReadStrategy::kCacheFirst) {
+    document.Get(SourceFor(policy.strategy))
+        .OnCompletion([callback](const Future<DocumentSnapshot>& future) {
+          Deliver(future, callback);
+        });
+    return;
+  }
+
+  std::shared_ptr<State> state = state_;
+  DocumentReference target = document;
+  target.Get(Source::kCache).OnCompletion(
+      [state, target, policy, callback,
+       on_change](const Future<DocumentSnapshot>& cached) {
+        if (cached.error() != Error::kErrorOk) {
+          // Not in the cache: there is nothing to serve early.
+          state->Count(&CacheFirstReaderStats::cache_misses);
+          target.Get(Source::kDefault)
+              .OnCompletion([callback](const Future<DocumentSnapshot>& future) {
+                Deliver(future, callback);
+              });
+          return;
+        }
+
+        state->Count(&CacheFirstReaderStats::cache_hits);
+        DocumentSnapshot served = *cached.result();
+        callback(served, Error::kErrorOk, "");
+
+        if (!state->StartRefresh(target.path(), policy)) {
+          return;
+        }
+        target.Get(Source::kServer).OnCompletion(
+            [state, served, on_change](const Future<DocumentSnapshot>& fresh) {
+              // If the server can't be reached, the cached data stands.
+              if (fresh.error() != Error::kErrorOk ||
+                  SameDocument(served, *fresh.result())) {
+                return;
+              }
+              state->Count(&CacheFirstReaderStats::refresh_changes);
+              if (on_change) {
+                on_change(*fresh.result(), Error::kErrorOk, "");
+              }
+            });
+      });
+}
+
+void CacheFirstReader::Get(const QuerySpec& spec, QueryCallback callback,
+                           QueryCallback on_change) {
+  ReadPolicy policy = state_->PolicyFor(spec.path());
+  Query query = spec.ToQuery(db_);
+  if (policy.strategy != ReadStrategy::kCacheFirst) {
+    query.Get(SourceFor(policy.strategy))
+        .OnCompletion([callback](const Future<QuerySnapshot>& future) {
+          Deliver(future, callback);
+        });
+    return;
+  }
+
+  std::shared_ptr<State> state = state_;
+  std::string key = spec.CanonicalKey();
+  query.Get(Source::kCache).OnCompletion(
+      [state, query, key, policy, callback,
+       on_change](const Future<QuerySnapshot>& cached) {
+        if (cached.error() != Error::kErrorOk || cached.result()->empty()) {
+          state->Count(&CacheFirstReaderStats::cache_misses);
+          query.Get(Source::kDefault)
+              .OnCompletion([callback](const Future<QuerySnapshot>& future) {
+                Deliver(future, callback);
+              });
+          return;
+        }
+
+        state->Count(&CacheFirstReaderStats::cache_hits);
+        QuerySnapshot served = *cached.result();
+        callback(served, Error::kErrorOk, "");
+
+        if (!state->StartRefresh(key, policy)) {
+          return;
+        }
+        query.Get(Source::kServer).OnCompletion(
+            [state, served, on_change](const Future<QuerySnapshot>& fresh) {
+              if (fresh.error() != Error::kErrorOk ||
+                  SameResults(served, *fresh.result())) {
+                return;
+              }
+              state->Count(&CacheFirstReaderStats::refresh_changes);
+              if (on_change) {
+                on_change(*fresh.result(), Error::kErrorOk, "");
+              }
+            });
+      });
+}
+
+CacheFirstReaderStats CacheFirstReader::stats() const {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  return state_->stats;
+}
+
+}  // namespace snippets
@@ -0,0 +1,113 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_CACHE_FIRST_READER_H
+#define FIRESTORESNIPPETSCPP_CACHE_FIRST_READER_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "firebase/firestore.h"
+#include "query_spec.h"
+
+namespace snippets {
+
+enum class ReadStrategy {
+  // Read from the offline cache if possible, then refresh from the server in
+  // the background ("stale-while-revalidate").
+  kCacheFirst,
+  // `Source::kDefault`: the server, or the cache if the server can't be
+  // reached.
+  kServerFirst,
+  // `Source::kCache` only.
+  kCacheOnly,
+  // `Source::kServer` only.
+  kServerOnly,
+};
+
+struct ReadPolicy {
+  ReadStrategy strategy = ReadStrategy::kCacheFirst;
+
+  // With `kCacheFirst`, don't refresh a document or query that was refreshed
+  // less than this long ago.
+  std::chrono::milliseconds min_refresh_interval{0};
+};
+
+struct CacheFirstReaderStats {
+  // Reads answered from the offline cache.
+  int64_t cache_hits = 0;
+  // `kCacheFirst` reads that weren't in the cache, and went to the server.
+  int64_t cache_misses = 0;
+  // Background refreshes, and those that found different data.
+  int64_t refreshes = 0;
+  int64_t refresh_changes = 0;
+  // Refreshes skipped because of `min_refresh_interval`.
+  int64_t refreshes_skipped = 0;
+};
+
+// Chooses, per collection, where `Get()` reads from.
+//
+// With `kCacheFirst`, the callback gets the cached data as soon as it has
+// been read, without waiting for the network, and the data is then fetched
+// from the server in the background. If the server's data differs from what
+// was returned, `on_change` is called with it; the refresh also updates the
+// offline cache for later reads. This suits screens that must render
+// immediately and can update in place.
+//
+// A document that isn't in the cache is read with `Source::kDefault`. A query
+// whose cached result is empty is treated the same way, since the cache can't
+// tell an empty result from a query that has never been run.
+//
+// Policies are looked up by collection path ("cities/SF/landmarks"), then by
+// collection ID ("landmarks"), and otherwise the default policy applies.
+//
+// Thread-safe. Callbacks run on Firestore callback threads.
+class CacheFirstReader {
+ public:
+  using DocumentCallback =
+      std::function<void(const firebase::firestore::DocumentSnapshot&,
+                         firebase::firestore::Error, const std::string&)>;
+  using QueryCallback =
+      std::function<void(const firebase::firestore::QuerySnapshot&,
+                         firebase::firestore::Error, const std::string&)>;
+
+  explicit CacheFirstReader(firebase::firestore::Firestore* db,
+                            ReadPolicy default_policy = ReadPolicy());
+
+  void SetPolicy(const std::string& collection, ReadPolicy policy);
+
+  // `on_change` may be empty, in which case the refresh still updates the
+  // offline cache.
+  void Get(const firebase::firestore::DocumentReference& document,
+           DocumentCallback callback, DocumentCallback on_change = nullptr);
+  void Get(const QuerySpec& spec, QueryCallback callback,
+           QueryCallback on_change = nullptr);
+
+  CacheFirstReaderStats stats() const;
+
+ private:
+  struct State;
+
+  firebase::firestore::Firestore* db_ = nullptr;
+  std::shared_ptr<State> state_;
+};
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_CACHE_FIRST_READER_H
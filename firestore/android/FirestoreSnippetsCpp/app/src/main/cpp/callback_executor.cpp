@@ -0,0 +1,211 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "callback_executor.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace snippets {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Task {
+  std::function<void()> run;
+  Clock::time_point posted;
+};
+
+struct ListenerQueue {
+  std::deque<Task> tasks;
+  // True while the listener is in the ready list or one of its tasks is
+  // running. Keeps a listener's tasks from running concurrently.
+  bool active = false;
+};
+
+std::chrono::microseconds ToMicroseconds(Clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(duration);
+}
+
+}  // namespace
+
+struct CallbackExecutor::State {
+  explicit State(CallbackExecutorOptions options)
+      : options(std::move(options)) {}
+
+  CallbackExecutorOptions options;
+
+  mutable std::mutex mutex;
+  // Signalled when a listener becomes ready or the executor stops.
+  std::condition_variable work_cv;
+  // Signalled when a task leaves a queue, for `OverflowPolicy::kBlock`.
+  std::condition_variable space_cv;
+
+  bool stopping = false;
+  uint64_t next_listener = 1;
+  // Only listeners with queued or running tasks have an entry.
+  std::unordered_map<uint64_t, ListenerQueue> queues;
+  // Listeners with queued tasks and none running, in turn order.
+  std::deque<uint64_t> ready;
+  CallbackExecutorStats stats;
+};
+
+CallbackExecutor::CallbackExecutor(CallbackExecutorOptions options)
+    : state_(std::make_shared<State>(std::move(options))) {
+  int worker_count = std::max(1, state_->options.worker_count);
+  workers_.reserve(worker_count);
+  for (int i = 0; i < worker_count; ++i) {
+    workers_.emplace_back(RunWorker, state_);
+  }
+}
+
+CallbackExecutor::~CallbackExecutor() {
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->stopping = true;
+  }
+  state_->work_cv.notify_all();
+  state_->space_cv.notify_all();
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+}
+
+uint64_t CallbackExecutor::NewListener() {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  return state_->next_listener++;
+}
+
+void CallbackExecutor::Post(uint64_t listener, std::function<void()> task) {
+  Post(state_, listener, std::move(task));
+}
+
+CallbackExecutorStats CallbackExecutor::stats() const {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  return state_->stats;
+}
+
+void CallbackExecutor::Post(const std::weak_ptr<State>& weak_state,
+                            uint64_t listener, std::function<void()> task) {
+  std::shared_ptr<State> state = weak_state.lock();
+  if (!state) return;
+
+  size_t max_pending =
+      std::max<size_t>(1, state->options.max_pending_per_listener);
+  Task queued{std::move(task), Clock::now()};
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  if (state->stopping) return;
+
+  switch (state->options.overflow_policy) {
+    case OverflowPolicy::kCoalesceLatest: {
+      ListenerQueue& queue = state->queues[listener];
+      if (!queue.tasks.empty()) {
+        // The waiting event hasn't been seen yet; the new one supersedes it.
+        // It keeps its original post time, so queue wait still reflects how
+        // stale the listener's view is.
+        queue.tasks.back().run = std::move(queued.run);
+        ++state->stats.coalesced;
+        return;
+      }
+      break;
+    }
+    case OverflowPolicy::kDropOldest: {
+      ListenerQueue& queue = state->queues[listener];
+      while (queue.tasks.size() >= max_pending) {
+        queue.tasks.pop_front();
+        --state->stats.queue_depth;
+        ++state->stats.dropped;
+      }
+      break;
+    }
+    case OverflowPolicy::kBlock:
+      // Looked up on every wakeup: a worker erases the queue once it drains.
+      state->space_cv.wait(lock, [&] {
+        if (state->stopping) return true;
+        auto found = state->queues.find(listener);
+        return found == state->queues.end() ||
+               found->second.tasks.size() < max_pending;
+      });
+      if (state->stopping) return;
+      break;
+  }
+
+  ListenerQueue& queue = state->queues[listener];
+  queue.tasks.push_back(std::move(queued));
+  CallbackExecutorStats& stats = state->stats;
+  ++stats.queue_depth;
+  stats.max_queue_depth = std::max(stats.max_queue_depth, stats.queue_depth);
+
+  if (!queue.active) {
+    queue.active = true;
+    state->ready.push_back(listener);
+    lock.unlock();
+    state->work_cv.notify_one();
+  }
+}
+
+void CallbackExecutor::RunWorker(std::shared_ptr<State> state) {
+  std::unique_lock<std::mutex> lock(state->mutex);
+  while (true) {
+    state->work_cv.wait(
+        lock, [&] { return state->stopping || !state->ready.empty(); });
+    if (state->ready.empty()) {
+      // Stopping, and every queued task has been picked up.
+      return;
+    }
+
+    uint64_t listener = state->ready.front();
+    state->ready.pop_front();
+    ListenerQueue& queue = state->queues[listener];
+    Task task = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+
+    CallbackExecutorStats& stats = state->stats;
+    --stats.queue_depth;
+    Clock::time_point start = Clock::now();
+    stats.max_queue_wait =
+        std::max(stats.max_queue_wait, ToMicroseconds(start - task.posted));
+    lock.unlock();
+    state->space_cv.notify_all();
+
+    task.run();
+    std::chrono::microseconds elapsed = ToMicroseconds(Clock::now() - start);
+
+    lock.lock();
+    ++stats.executed;
+    stats.total_handler_time += elapsed;
+    stats.max_handler_time = std::max(stats.max_handler_time, elapsed);
+
+    auto found = state->queues.find(listener);
+    if (found->second.tasks.empty()) {
+      state->queues.erase(found);
+      // A blocked poster may be waiting on this listener's queue.
+      state->space_cv.notify_all();
+    } else {
+      // Back of the line, so other listeners get a turn first.
+      state->ready.push_back(listener);
+      state->work_cv.notify_one();
+    }
+  }
+}
+
+}  // namespace snippets
@@ -0,0 +1,149 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_CALLBACK_EXECUTOR_H
+#define FIRESTORESNIPPETSCPP_CALLBACK_EXECUTOR_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "firebase/firestore.h"
+
+namespace snippets {
+
+// What `CallbackExecutor::Post()` does when a listener already has
+// `max_pending_per_listener` events waiting.
+enum class OverflowPolicy {
+  // Discards the listener's oldest waiting event.
+  kDropOldest,
+  // Keeps at most one waiting event per listener, replacing it with each new
+  // one. `max_pending_per_listener` is ignored.
+  kCoalesceLatest,
+  // Blocks the posting thread, which for a wrapped listener is the SDK's
+  // callback thread, until the listener's handler catches up.
+  kBlock,
+};
+
+struct CallbackExecutorOptions {
+  int worker_count = 2;
+  size_t max_pending_per_listener = 16;
+  OverflowPolicy overflow_policy = OverflowPolicy::kDropOldest;
+};
+
+struct CallbackExecutorStats {
+  // Events waiting to run, across all listeners, and the highest that number
+  // has been.
+  size_t queue_depth = 0;
+  size_t max_queue_depth = 0;
+
+  int64_t executed = 0;
+  int64_t dropped = 0;
+  int64_t coalesced = 0;
+
+  // Time spent inside handlers.
+  std::chrono::microseconds total_handler_time{0};
+  std::chrono::microseconds max_handler_time{0};
+
+  // Longest time an event waited between `Post()` and its handler starting.
+  std::chrono::microseconds max_queue_wait{0};
+
+  std::chrono::microseconds average_handler_time() const {
+    return executed > 0 ? total_handler_time / executed
+                        : std::chrono::microseconds(0);
+  }
+};
+
+// Runs snapshot handlers on a small pool of worker threads instead of the
+// SDK's callback thread.
+//
+// A listener's handler runs inline on the thread that delivers every
+// snapshot, so one slow handler delays all other listeners. Wrapping the
+// handler hands each event to the executor and returns immediately:
+//
+//   CallbackExecutor executor;
+//   query.AddSnapshotListener(executor.Wrap<QuerySnapshot>(
+//       [](const QuerySnapshot& snapshot, Error error,
+//          const std::string& error_message) { /* slow work */ }));
+//
+// Each listener has its own queue. Its events run one at a time, in the
+// order they arrived, and workers take turns between listeners, so a slow
+// handler occupies at most one worker and cannot starve the others. The
+// queue is bounded, and `overflow_policy` decides what happens when it is
+// full.
+//
+// The destructor runs the events already queued, then joins the workers.
+// Events posted after that are discarded, so wrapped listeners may outlive
+// the executor.
+class CallbackExecutor {
+ public:
+  template <typename Snapshot>
+  using Handler = std::function<void(const Snapshot&,
+                                     firebase::firestore::Error,
+                                     const std::string&)>;
+
+  explicit CallbackExecutor(
+      CallbackExecutorOptions options = CallbackExecutorOptions());
+  ~CallbackExecutor();
+
+  CallbackExecutor(const CallbackExecutor&) = delete;
+  CallbackExecutor& operator=(const CallbackExecutor&) = delete;
+
+  // Returns a listener callback that runs `handler` on the executor, as its
+  // own listener queue.
+  template <typename Snapshot>
+  Handler<Snapshot> Wrap(Handler<Snapshot> handler) {
+    uint64_t listener = NewListener();
+    std::weak_ptr<State> weak_state = state_;
+    auto shared_handler = std::make_shared<Handler<Snapshot>>(
+        std::move(handler));
+    return [weak_state, listener, shared_handler](
+               const Snapshot& snapshot, firebase::firestore::Error error,
+               const std::string& error_message) {
+      Post(weak_state, listener, [shared_handler, snapshot, error,
+                                  error_message] {
+        (*shared_handler)(snapshot, error, error_message);
+      });
+    };
+  }
+
+  // Allocates a queue for `Post()`.
+  uint64_t NewListener();
+
+  // Queues `task` behind the other tasks of `listener`.
+  void Post(uint64_t listener, std::function<void()> task);
+
+  CallbackExecutorStats stats() const;
+
+ private:
+  struct State;
+
+  static void Post(const std::weak_ptr<State>& weak_state, uint64_t listener,
+                   std::function<void()> task);
+  static void RunWorker(std::shared_ptr<State> state);
+
+  std::shared_ptr<State> state_;
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_CALLBACK_EXECUTOR_H
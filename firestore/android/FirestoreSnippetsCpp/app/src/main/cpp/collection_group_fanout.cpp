@@ -0,0 +1,171 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "collection_group_fanout.h"
+
+#include <unordered_set>
+#include <utility>
+
+#include "future_combinators.h"
+#include "ordered_merge.h"
+
+namespace snippets {
+
+using firebase::Future;
+using firebase::firestore::DocumentSnapshot;
+using firebase::firestore::Error;
+using firebase::firestore::Firestore;
+using firebase::firestore::QuerySnapshot;
+
+namespace {
+
+using Callback = std::function<void(const std::vector<DocumentSnapshot>&,
+                                    Error, const std::string&)>;
+
+// Copies the filters, orders and cursors of `spec`, and its limit if
+// `with_limit`, onto `target`.
+QuerySpec CopyOnto(const QuerySpec& spec, QuerySpec target, bool with_limit) {
+  for (const QuerySpec::Filter& filter : spec.filters()) {
+    target.Where(filter.field, filter.op, filter.values);
+  }
+  for (const QuerySpec::Order& order : spec.orders()) {
+    target.OrderBy(order.field, order.direction);
+  }
+  switch (spec.start_bound()) {
+    case QuerySpec::Bound::kStartAt:
+      target.StartAt(spec.start_values());
+      break;
+    case QuerySpec::Bound::kStartAfter:
+      target.StartAfter(spec.start_values());
+      break;
+    default:
+      break;
+  }
+  switch (spec.end_bound()) {
+    case QuerySpec::Bound::kEndAt:
+      target.EndAt(spec.end_values());
+      break;
+    case QuerySpec::Bound::kEndBefore:
+      target.EndBefore(spec.end_values());
+      break;
+    default:
+      break;
+  }
+  if (with_limit && spec.limit() > 0) {
+    target.Limit(spec.limit());
+  }
+  return target;
+}
+
+// "cities/SF/landmarks/x" -> "cities/SF".
+std::string ParentDocumentPath(const std::string& path) {
+  size_t slash = path.rfind('/');
+  if (slash == std::string::npos) return "";
+  slash = path.rfind('/', slash - 1);
+  if (slash == std::string::npos || slash == 0) return "";
+  return path.substr(0, slash);
+}
+
+void GetWithGroupQuery(Firestore* db, const QuerySpec& query,
+                       const std::vector<std::string>& parent_paths,
+                       const CollectionGroupFanOutOptions& options,
+                       Callback callback) {
+  QuerySpec group = CopyOnto(
+      query, QuerySpec::CollectionGroup(query.path()), /*with_limit=*/false);
+  std::unordered_set<std::string> parents(parent_paths.begin(),
+                                          parent_paths.end());
+  size_t limit = query.limit() > 0 ? static_cast<size_t>(query.limit()) : 0;
+
+  group.ToQuery(db).Get(options.source).OnCompletion(
+      [parents, limit, callback](const Future<QuerySnapshot>& future) {
+        Error error = static_cast<Error>(future.error());
+        if (error != Error::kErrorOk) {
+          callback({}, error, future.error_message());
+          return;
+        }
+        std::vector<DocumentSnapshot> result;
+        for (const DocumentSnapshot& document : future.result()->documents()) {
+          if (limit > 0 && result.size() == limit) break;
+          if (parents.count(ParentDocumentPath(document.reference().path()))) {
+            result.push_back(document);
+          }
+        }
+        callback(result, Error::kErrorOk, "");
+      });
+}
+
+void GetWithParentQueries(Firestore* db, const QuerySpec& query,
+                          const std::vector<std::string>& parent_paths,
+                          const CollectionGroupFanOutOptions& options,
+                          Callback callback) {
+  // Each parent returns at most `limit` documents, which is all the merge
+  // can need from it.
+  std::vector<Future<QuerySnapshot>> reads;
+  for (const std::string& parent : parent_paths) {
+    QuerySpec collection =
+        CopyOnto(query, QuerySpec::Collection(parent + "/" + query.path()),
+                 /*with_limit=*/true);
+    reads.push_back(collection.ToQuery(db).Get(options.source));
+  }
+
+  DocumentOrder order(query.EffectiveOrders());
+  int32_t limit = query.limit();
+  WhenAll<Future<QuerySnapshot>>(
+      std::move(reads),
+      [order, limit, callback](const std::vector<Future<QuerySnapshot>>& done) {
+        std::vector<std::vector<DocumentSnapshot>> lists;
+        for (const Future<QuerySnapshot>& future : done) {
+          if (future.error() != Error::kErrorOk) {
+            callback({}, static_cast<Error>(future.error()),
+                     future.error_message());
+            return;
+          }
+          lists.push_back(future.result()->documents());
+        }
+        callback(MergeOrdered(lists, order, limit), Error::kErrorOk, "");
+      });
+}
+
+}  // namespace
+
+FanOutStrategy ChooseFanOutStrategy(
+    size_t parents, const CollectionGroupFanOutOptions& options) {
+  return parents <= options.max_parent_queries
+             ? FanOutStrategy::kPerParent
+             : FanOutStrategy::kCollectionGroup;
+}
+
+void GetCollectionGroupSubset(Firestore* db, const QuerySpec& query,
+                              const std::vector<std::string>& parent_paths,
+                              CollectionGroupFanOutOptions options,
+                              Callback callback) {
+  if (!query.is_collection_group()) {
+    callback({}, Error::kErrorInvalidArgument,
+             "GetCollectionGroupSubset() needs a collection-group query");
+    return;
+  }
+  switch (ChooseFanOutStrategy(parent_paths.size(), options)) {
+    case FanOutStrategy::kPerParent:
+      GetWithParentQueries(db, query, parent_paths, options,
+                           std::move(callback));
+      break;
+    case FanOutStrategy::kCollectionGroup:
+      GetWithGroupQuery(db, query, parent_paths, options, std::move(callback));
+      break;
+  }
+}
+
+}  // namespace snippets
@@ -0,0 +1,79 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_COLLECTION_GROUP_FANOUT_H
+#define FIRESTORESNIPPETSCPP_COLLECTION_GROUP_FANOUT_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "firebase/firestore.h"
+#include "query_spec.h"
+
+namespace snippets {
+
+enum class FanOutStrategy {
+  // One collection-group query, with documents under other parents dropped
+  // on the client.
+  kCollectionGroup,
+  // One collection query per parent, run in parallel and merged.
+  kPerParent,
+};
+
+struct CollectionGroupFanOutOptions {
+  // Parent sets up to this size are read with one query per parent; larger
+  // ones with a single collection-group query.
+  size_t max_parent_queries = 10;
+
+  firebase::firestore::Source source = firebase::firestore::Source::kDefault;
+};
+
+// Returns the strategy `GetCollectionGroupSubset()` uses for `parents`
+// parents.
+FanOutStrategy ChooseFanOutStrategy(
+    size_t parents,
+    const CollectionGroupFanOutOptions& options =
+        CollectionGroupFanOutOptions());
+
+// Runs the collection-group query `query` (see `QuerySpec::CollectionGroup()`)
+// over only the documents whose parent document is one of `parent_paths`,
+// e.g. the "landmarks" of "cities/SF" and "cities/LA".
+//
+// A collection-group query reads matching documents under every parent, so
+// for a few parents it is cheaper to query each parent's subcollection on its
+// own; their results are merged with `MergeOrdered()` into the order the
+// group query would have returned. For many parents, the single group query
+// wins; its limit is then applied after dropping other parents' documents,
+// so it isn't sent to the backend.
+//
+// Per-parent queries compare document IDs within one parent only, so cursors
+// on `kDocumentIdField` must not be used with them.
+//
+// `callback` receives the documents in query order, or the first error.
+void GetCollectionGroupSubset(
+    firebase::firestore::Firestore* db, const QuerySpec& query,
+    const std::vector<std::string>& parent_paths,
+    CollectionGroupFanOutOptions options,
+    std::function<void(
+        const std::vector<firebase::firestore::DocumentSnapshot>& documents,
+        firebase::firestore::Error error, const std::string& error_message)>
+        callback);
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_COLLECTION_GROUP_FANOUT_H
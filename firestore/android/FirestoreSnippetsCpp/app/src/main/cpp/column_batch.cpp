@@ -0,0 +1,306 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "column_batch.h"
+
+#include <limits>
+#include <utility>
+
+#include "query_evaluator.h"
+
+namespace snippets {
+
+using firebase::firestore::DocumentSnapshot;
+using firebase::firestore::FieldValue;
+using firebase::firestore::MapFieldValue;
+using firebase::firestore::QuerySnapshot;
+
+namespace {
+
+// Marks string rows without a value until the dictionary is complete.
+constexpr uint32_t kPendingNullCode = std::numeric_limits<uint32_t>::max();
+
+// Adds `b` to `a` unless that would overflow.
+bool AddWithoutOverflow(int64_t a, int64_t b, int64_t* out) {
+  if ((b > 0 && a > std::numeric_limits<int64_t>::max() - b) ||
+      (b < 0 && a < std::numeric_limits<int64_t>::min() - b)) {
+    return false;
+  }
+  *out = a + b;
+  return true;
+}
+
+ColumnType TypeOf(const FieldValue& value) {
+  switch (value.type()) {
+    case FieldValue::Type::kBoolean:
+      return ColumnType::kBoolean;
+    case FieldValue::Type::kInteger:
+      return ColumnType::kInteger;
+    case FieldValue::Type::kDouble:
+      return ColumnType::kDouble;
+    case FieldValue::Type::kString:
+      return ColumnType::kString;
+    default:
+      return ColumnType::kValue;
+  }
+}
+
+}  // namespace
+
+FieldValue BatchColumn::Get(size_t row) const {
+  if (!is_valid(row)) {
+    return FieldValue::Null();
+  }
+  switch (type_) {
+    case ColumnType::kNull:
+      return FieldValue::Null();
+    case ColumnType::kBoolean:
+      return FieldValue::Boolean(booleans_[row] != 0);
+    case ColumnType::kInteger:
+      return FieldValue::Integer(integers_[row]);
+    case ColumnType::kDouble:
+      return FieldValue::Double(doubles_[row]);
+    case ColumnType::kString:
+      return FieldValue::String(dictionary_[codes_[row]]);
+    case ColumnType::kValue:
+      return values_[row];
+  }
+  return FieldValue::Null();
+}
+
+void BatchColumn::Append(const FieldValue* value) {
+  size_t row = size_;
+  if (row % 64 == 0) {
+    validity_.push_back(0);
+  }
+  bool valid = value != nullptr && value->is_valid() && !value->is_null();
+
+  if (valid) {
+    ColumnType type = TypeOf(*value);
+    if (type_ == ColumnType::kNull) {
+      // Earlier rows were all null; give them zeros in the new array.
+      type_ = type;
+      booleans_.resize(type == ColumnType::kBoolean ? row : 0);
+      integers_.resize(type == ColumnType::kInteger ? row : 0);
+      doubles_.resize(type == ColumnType::kDouble ? row : 0);
+      codes_.resize(type == ColumnType::kString ? row : 0, kPendingNullCode);
+      values_.resize(type == ColumnType::kValue ? row : 0, FieldValue::Null());
+    } else if (type_ == ColumnType::kInteger && type == ColumnType::kDouble) {
+      Promote(ColumnType::kDouble);
+    } else if (type_ != type &&
+               !(type_ == ColumnType::kDouble &&
+                 type == ColumnType::kInteger) &&
+               type_ != ColumnType::kValue) {
+      Promote(ColumnType::kValue);
+    }
+    validity_.back() |= uint64_t{1} << (row % 64);
+  } else {
+    ++null_count_;
+  }
+
+  switch (type_) {
+    case ColumnType::kNull:
+      break;
+    case ColumnType::kBoolean:
+      booleans_.push_back(valid && value->boolean_value() ? 1 : 0);
+      break;
+    case ColumnType::kInteger:
+      integers_.push_back(valid ? value->integer_value() : 0);
+      break;
+    case ColumnType::kDouble:
+      if (!valid) {
+        doubles_.push_back(0);
+      } else if (value->is_integer()) {
+        doubles_.push_back(static_cast<double>(value->integer_value()));
+      } else {
+        doubles_.push_back(value->double_value());
+      }
+      break;
+    case ColumnType::kString: {
+      uint32_t code = kPendingNullCode;
+      if (valid) {
+        const std::string& string = value->string_value();
+        auto inserted = codes_by_string_.emplace(
+            string, static_cast<uint32_t>(dictionary_.size()));
+        if (inserted.second) {
+          dictionary_.push_back(string);
+        }
+        code = inserted.first->second;
+      }
+      codes_.push_back(code);
+      break;
+    }
+    case ColumnType::kValue:
+      values_.push_back(valid ? *value : FieldValue::Null());
+      break;
+  }
+  ++size_;
+}
+
+void BatchColumn::Promote(ColumnType type) {
+  if (type == ColumnType::kDouble) {
+    doubles_.reserve(integers_.size());
+    for (int64_t integer : integers_) {
+      doubles_.push_back(static_cast<double>(integer));
+    }
+    integers_ = std::vector<int64_t>();
+  } else {
+    values_.reserve(size_);
+    for (size_t row = 0; row < size_; ++row) {
+      values_.push_back(Get(row));
+    }
+    booleans_ = std::vector<uint8_t>();
+    integers_ = std::vector<int64_t>();
+    doubles_ = std::vector<double>();
+    codes_ = std::vector<uint32_t>();
+    dictionary_ = std::vector<std::string>();
+    codes_by_string_.clear();
+  }
+  type_ = type;
+}
+
+void BatchColumn::Finish() {
+  if (type_ == ColumnType::kString) {
+    uint32_t null_code = static_cast<uint32_t>(dictionary_.size());
+    for (uint32_t& code : codes_) {
+      if (code == kPendingNullCode) code = null_code;
+    }
+  }
+  codes_by_string_ = std::unordered_map<std::string, uint32_t>();
+}
+
+ColumnBatch ColumnBatch::FromSnapshot(const QuerySnapshot& snapshot,
+                                      const std::vector<std::string>& fields) {
+  ColumnBatch batch;
+  batch.fields_ = fields;
+  batch.columns_.resize(fields.size());
+  batch.ids_.reserve(snapshot.size());
+  for (const DocumentSnapshot& document : snapshot.documents()) {
+    batch.ids_.push_back(document.id());
+    batch.AddRow(document.GetData());
+  }
+  batch.Finish();
+  return batch;
+}
+
+ColumnBatch ColumnBatch::FromDocuments(
+    const std::vector<MapFieldValue>& documents,
+    const std::vector<std::string>& ids,
+    const std::vector<std::string>& fields) {
+  ColumnBatch batch;
+  batch.fields_ = fields;
+  batch.columns_.resize(fields.size());
+  batch.ids_ = ids;
+  batch.ids_.resize(documents.size());
+  for (const MapFieldValue& data : documents) {
+    batch.AddRow(data);
+  }
+  batch.Finish();
+  return batch;
+}
+
+const BatchColumn* ColumnBatch::column(const std::string& field) const {
+  for (size_t i = 0; i < fields_.size(); ++i) {
+    if (fields_[i] == field) return &columns_[i];
+  }
+  return nullptr;
+}
+
+void ColumnBatch::AddRow(const MapFieldValue& data) {
+  FieldValue value;
+  for (size_t i = 0; i < fields_.size(); ++i) {
+    bool found = LookupField(data, fields_[i], &value);
+    columns_[i].Append(found ? &value : nullptr);
+  }
+}
+
+void ColumnBatch::Finish() {
+  for (BatchColumn& column : columns_) {
+    column.Finish();
+  }
+}
+
+double SumColumn(const BatchColumn& column) {
+  size_t size = column.size();
+  switch (column.type()) {
+    case ColumnType::kBoolean: {
+      const uint8_t* booleans = column.booleans().data();
+      int64_t sum = 0;
+      for (size_t i = 0; i < size; ++i) sum += booleans[i];
+      return static_cast<double>(sum);
+    }
+    case ColumnType::kInteger: {
+      // Partial sums that would overflow are moved into a double.
+      const int64_t* integers = column.integers().data();
+      int64_t sum = 0;
+      double spilled = 0;
+      for (size_t i = 0; i < size; ++i) {
+        if (!AddWithoutOverflow(sum, integers[i], &sum)) {
+          spilled += static_cast<double>(sum);
+          sum = integers[i];
+        }
+      }
+      return spilled + static_cast<double>(sum);
+    }
+    case ColumnType::kDouble: {
+      const double* doubles = column.doubles().data();
+      double sum = 0;
+      for (size_t i = 0; i < size; ++i) sum += doubles[i];
+      return sum;
+    }
+    default:
+      return 0;
+  }
+}
+
+std::vector<double> SumByKey(const BatchColumn& keys,
+                             const BatchColumn& values) {
+  // The extra entry collects rows without a key.
+  std::vector<double> sums(keys.dictionary().size() + 1, 0);
+  if (keys.type() != ColumnType::kString || values.size() != keys.size()) {
+    sums.pop_back();
+    return sums;
+  }
+  const uint32_t* codes = keys.codes().data();
+  size_t size = keys.size();
+  switch (values.type()) {
+    case ColumnType::kBoolean:
+      for (size_t i = 0; i < size; ++i) sums[codes[i]] += values.booleans()[i];
+      break;
+    case ColumnType::kInteger:
+      for (size_t i = 0; i < size; ++i) {
+        sums[codes[i]] += static_cast<double>(values.integers()[i]);
+      }
+      break;
+    case ColumnType::kDouble:
+      for (size_t i = 0; i < size; ++i) sums[codes[i]] += values.doubles()[i];
+      break;
+    default:
+      break;
+  }
+  sums.pop_back();
+  return sums;
+}
+
+std::vector<int64_t> CountByKey(const BatchColumn& keys) {
+  std::vector<int64_t> counts(keys.dictionary().size() + 1, 0);
+  const uint32_t* codes = keys.codes().data();
+  for (size_t i = 0; i < keys.codes().size(); ++i) ++counts[codes[i]];
+  counts.pop_back();
+  return counts;
+}
+
+}  // namespace snippets
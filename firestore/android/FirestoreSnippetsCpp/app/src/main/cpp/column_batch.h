@@ -0,0 +1,156 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_COLUMN_BATCH_H
+#define FIRESTORESNIPPETSCPP_COLUMN_BATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "firebase/firestore.h"
+
+namespace snippets {
+
+enum class ColumnType {
+  // Every row is null or missing.
+  kNull,
+  kBoolean,
+  kInteger,
+  // Doubles, or a mix of doubles and integers.
+  kDouble,
+  // Strings, stored as codes into a dictionary of the distinct values.
+  kString,
+  // Any other type, or a mix of types, stored as `FieldValue`s.
+  kValue,
+};
+
+// One field of every document in a `ColumnBatch`.
+//
+// Rows where the field is null or missing are marked invalid in the
+// validity bitmap, and hold zero (or the null code, for strings) in the
+// typed array, so aggregations can run over the whole array without checking
+// validity.
+class BatchColumn {
+ public:
+  ColumnType type() const { return type_; }
+  size_t size() const { return size_; }
+  size_t null_count() const { return null_count_; }
+
+  // One bit per row, least significant bit first; set for rows with a value.
+  const std::vector<uint64_t>& validity() const { return validity_; }
+  bool is_valid(size_t row) const {
+    return (validity_[row / 64] >> (row % 64)) & 1;
+  }
+
+  // The array matching `type()`; the others are empty.
+  const std::vector<uint8_t>& booleans() const { return booleans_; }
+  const std::vector<int64_t>& integers() const { return integers_; }
+  const std::vector<double>& doubles() const { return doubles_; }
+  const std::vector<firebase::firestore::FieldValue>& values() const {
+    return values_;
+  }
+
+  // For `kString`: the distinct strings in order of first appearance, and a
+  // code per row indexing them. Invalid rows have the code
+  // `dictionary().size()`, so per-code results can be sized
+  // `dictionary().size() + 1` and the last entry ignored.
+  const std::vector<std::string>& dictionary() const { return dictionary_; }
+  const std::vector<uint32_t>& codes() const { return codes_; }
+
+  // The value at `row`, or null if the row is invalid.
+  firebase::firestore::FieldValue Get(size_t row) const;
+
+ private:
+  friend class ColumnBatch;
+
+  // Adds a row; `value` is null if the field is missing.
+  void Append(const firebase::firestore::FieldValue* value);
+  // Converts the column to `kDouble` or `kValue` to take a value that doesn't
+  // fit its type.
+  void Promote(ColumnType type);
+  void Finish();
+
+  ColumnType type_ = ColumnType::kNull;
+  size_t size_ = 0;
+  size_t null_count_ = 0;
+  std::vector<uint64_t> validity_;
+
+  std::vector<uint8_t> booleans_;
+  std::vector<int64_t> integers_;
+  std::vector<double> doubles_;
+  std::vector<firebase::firestore::FieldValue> values_;
+  std::vector<std::string> dictionary_;
+  std::vector<uint32_t> codes_;
+  std::unordered_map<std::string, uint32_t> codes_by_string_;
+};
+
+// The documents of a query result, stored a field at a time for analytics:
+// each requested field becomes a `BatchColumn` of contiguous typed values,
+// instead of a map lookup per document and field.
+//
+// Each column takes the narrowest type that holds all its values: integers
+// stay integers until a double appears, and any other mix of types falls
+// back to `kValue`.
+class ColumnBatch {
+ public:
+  // Converts `snapshot`, reading only `fields`. Fields may be nested paths
+  // ("address.city").
+  static ColumnBatch FromSnapshot(
+      const firebase::firestore::QuerySnapshot& snapshot,
+      const std::vector<std::string>& fields);
+
+  // As above, for documents that are already maps. `ids` may be empty.
+  static ColumnBatch FromDocuments(
+      const std::vector<firebase::firestore::MapFieldValue>& documents,
+      const std::vector<std::string>& ids,
+      const std::vector<std::string>& fields);
+
+  size_t num_rows() const { return ids_.size(); }
+  const std::vector<std::string>& ids() const { return ids_; }
+  const std::vector<std::string>& fields() const { return fields_; }
+
+  // Returns the column for `field`, or null if it wasn't requested.
+  const BatchColumn* column(const std::string& field) const;
+
+ private:
+  void AddRow(const firebase::firestore::MapFieldValue& data);
+  void Finish();
+
+  std::vector<std::string> ids_;
+  std::vector<std::string> fields_;
+  std::vector<BatchColumn> columns_;
+};
+
+// Sums the valid values of a `kInteger`, `kDouble` or `kBoolean` column.
+// Returns 0 for other types.
+double SumColumn(const BatchColumn& column);
+
+// Sums `values` per distinct string in `keys`, which must be a `kString`
+// column of the same batch. The result has one entry per entry of
+// `keys.dictionary()`; rows with no key or no value are skipped.
+std::vector<double> SumByKey(const BatchColumn& keys,
+                             const BatchColumn& values);
+
+// Counts the rows per distinct string in `keys`, which must be a `kString`
+// column. The result has one entry per entry of `keys.dictionary()`.
+std::vector<int64_t> CountByKey(const BatchColumn& keys);
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_COLUMN_BATCH_H
@@ -0,0 +1,154 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "column_batch.h"
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "firebase/firestore.h"
+#include "gtest/gtest.h"
+
+namespace snippets {
+namespace {
+
+using firebase::firestore::FieldValue;
+using firebase::firestore::MapFieldValue;
+
+ColumnBatch MakeBatch(const std::vector<MapFieldValue>& documents) {
+  return ColumnBatch::FromDocuments(documents, {}, {"a"});
+}
+
+TEST(ColumnBatchTest, LeadingNullsTakeTheTypeOfTheFirstValue) {
+  ColumnBatch batch = MakeBatch({
+      {},
+      {{"a", FieldValue::Null()}},
+      {{"a", FieldValue::Integer(5)}},
+      {{"a", FieldValue::Integer(7)}},
+  });
+  const BatchColumn& column = *batch.column("a");
+  EXPECT_EQ(column.type(), ColumnType::kInteger);
+  EXPECT_EQ(column.size(), 4u);
+  EXPECT_EQ(column.null_count(), 2u);
+  EXPECT_EQ(column.validity(), (std::vector<uint64_t>{0b1100}));
+  EXPECT_EQ(column.integers(), (std::vector<int64_t>{0, 0, 5, 7}));
+  EXPECT_TRUE(column.Get(1).is_null());
+  EXPECT_EQ(column.Get(2), FieldValue::Integer(5));
+  EXPECT_EQ(SumColumn(column), 12);
+}
+
+TEST(ColumnBatchTest, IntegersArePromotedToDoubles) {
+  ColumnBatch batch = MakeBatch({
+      {{"a", FieldValue::Null()}},
+      {{"a", FieldValue::Integer(2)}},
+      {{"a", FieldValue::Double(0.5)}},
+      {},
+      {{"a", FieldValue::Integer(3)}},
+  });
+  const BatchColumn& column = *batch.column("a");
+  EXPECT_EQ(column.type(), ColumnType::kDouble);
+  EXPECT_TRUE(column.integers().empty());
+  EXPECT_EQ(column.doubles(), (std::vector<double>{0, 2, 0.5, 0, 3}));
+  EXPECT_EQ(column.null_count(), 2u);
+  EXPECT_EQ(column.Get(1), FieldValue::Double(2));
+  EXPECT_EQ(SumColumn(column), 5.5);
+}
+
+TEST(ColumnBatchTest, StringsUseADictionaryWithANullCode) {
+  ColumnBatch batch = MakeBatch({
+      {{"a", FieldValue::Null()}},
+      {{"a", FieldValue::String("x")}},
+      {{"a", FieldValue::String("y")}},
+      {},
+      {{"a", FieldValue::String("x")}},
+  });
+  const BatchColumn& column = *batch.column("a");
+  EXPECT_EQ(column.type(), ColumnType::kString);
+  EXPECT_EQ(column.dictionary(), (std::vector<std::string>{"x", "y"}));
+  EXPECT_EQ(column.codes(), (std::vector<uint32_t>{2, 0, 1, 2, 0}));
+  EXPECT_TRUE(column.Get(0).is_null());
+  EXPECT_EQ(column.Get(4), FieldValue::String("x"));
+  EXPECT_EQ(CountByKey(column), (std::vector<int64_t>{2, 1}));
+}
+
+TEST(ColumnBatchTest, MixedStringColumnIsPromotedToValues) {
+  ColumnBatch batch = MakeBatch({
+      {},
+      {{"a", FieldValue::String("x")}},
+      {{"a", FieldValue::Null()}},
+      {{"a", FieldValue::String("y")}},
+      {{"a", FieldValue::Integer(1)}},
+      {{"a", FieldValue::String("x")}},
+  });
+  const BatchColumn& column = *batch.column("a");
+  EXPECT_EQ(column.type(), ColumnType::kValue);
+  EXPECT_TRUE(column.dictionary().empty());
+  EXPECT_TRUE(column.codes().empty());
+  EXPECT_EQ(column.values(),
+            (std::vector<FieldValue>{
+                FieldValue::Null(), FieldValue::String("x"), FieldValue::Null(),
+                FieldValue::String("y"), FieldValue::Integer(1),
+                FieldValue::String("x")}));
+  EXPECT_EQ(column.null_count(), 2u);
+  EXPECT_FALSE(column.is_valid(2));
+  EXPECT_TRUE(column.is_valid(5));
+  EXPECT_EQ(SumColumn(column), 0);
+}
+
+TEST(ColumnBatchTest, ValidityCoversMoreThanOneWord) {
+  std::vector<MapFieldValue> documents(130);
+  documents[64] = {{"a", FieldValue::Boolean(true)}};
+  documents[129] = {{"a", FieldValue::Boolean(false)}};
+  ColumnBatch batch = MakeBatch(documents);
+  const BatchColumn& column = *batch.column("a");
+  EXPECT_EQ(column.type(), ColumnType::kBoolean);
+  EXPECT_EQ(column.validity(), (std::vector<uint64_t>{0, 1, 2}));
+  EXPECT_EQ(column.null_count(), 128u);
+  EXPECT_EQ(SumColumn(column), 1);
+}
+
+TEST(ColumnBatchTest, IntegerSumDoesNotOverflow) {
+  const int64_t max = std::numeric_limits<int64_t>::max();
+  ColumnBatch batch = MakeBatch({
+      {{"a", FieldValue::Integer(max)}},
+      {{"a", FieldValue::Integer(max)}},
+      {{"a", FieldValue::Integer(-max)}},
+      {{"a", FieldValue::Integer(1)}},
+  });
+  EXPECT_DOUBLE_EQ(SumColumn(*batch.column("a")),
+                   static_cast<double>(max) + 1);
+}
+
+TEST(ColumnBatchTest, SumsByKey) {
+  ColumnBatch batch = ColumnBatch::FromDocuments(
+      {
+          {{"k", FieldValue::String("x")}, {"v", FieldValue::Integer(1)}},
+          {{"k", FieldValue::String("y")}, {"v", FieldValue::Double(2.5)}},
+          {{"v", FieldValue::Integer(100)}},
+          {{"k", FieldValue::String("x")}},
+          {{"k", FieldValue::String("x")}, {"v", FieldValue::Integer(4)}},
+      },
+      {}, {"k", "v"});
+  EXPECT_EQ(SumByKey(*batch.column("k"), *batch.column("v")),
+            (std::vector<double>{5, 2.5}));
+  EXPECT_EQ(CountByKey(*batch.column("k")), (std::vector<int64_t>{3, 1}));
+  EXPECT_EQ(batch.column("missing"), nullptr);
+}
+
+}  // namespace
+}  // namespace snippets
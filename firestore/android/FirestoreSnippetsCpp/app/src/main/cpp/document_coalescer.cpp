@@ -0,0 +1,150 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "document_coalescer.h"
+
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace snippets {
+
+using firebase::Future;
+using firebase::firestore::DocumentReference;
+using firebase::firestore::DocumentSnapshot;
+using firebase::firestore::Error;
+using firebase::firestore::Source;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+}  // namespace
+
+struct DocumentCoalescer::State {
+  struct Slot {
+    // Callbacks waiting for the read in flight, if any.
+    std::vector<Callback> waiters;
+    bool in_flight = false;
+
+    // The last successful result, reused while younger than max_staleness.
+    bool has_result = false;
+    DocumentSnapshot snapshot;
+    Clock::time_point fetched;
+  };
+
+  // Drops results that can no longer be reused, once enough paths have
+  // accumulated for it to be worth a pass over the map.
+  void PruneExpired(Clock::time_point now) {
+    if (slots.size() < kPruneThreshold) {
+      return;
+    }
+    for (auto it = slots.begin(); it != slots.end();) {
+      const Slot& slot = it->second;
+      if (!slot.in_flight && now - slot.fetched > max_staleness) {
+        it = slots.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  static constexpr size_t kPruneThreshold = 1024;
+
+  std::chrono::milliseconds max_staleness;
+  Source source = Source::kDefault;
+  mutable std::mutex mutex;
+  std::unordered_map<std::string, Slot> slots;
+  DocumentCoalescerStats stats;
+};
+
+DocumentCoalescer::DocumentCoalescer(std::chrono::milliseconds max_staleness,
+                                     Source source)
+    : state_(std::make_shared<State>()) {
+  state_->max_staleness = max_staleness;
+  state_->source = source;
+}
+
+void DocumentCoalescer::Get(const DocumentReference& document,
+                            Callback callback) {
+  std::string path = document.path();
+
+  std::unique_lock<std::mutex> lock(state_->mutex);
+  State::Slot& slot = state_->slots[path];
+
+  if (slot.has_result && state_->max_staleness.count() > 0 &&
+      Clock::now() - slot.fetched <= state_->max_staleness) {
+    ++state_->stats.reused;
+    DocumentSnapshot snapshot = slot.snapshot;
+    lock.unlock();
+    callback(snapshot, Error::kErrorOk, "");
+    return;
+  }
+
+  slot.waiters.push_back(std::move(callback));
+  if (slot.in_flight) {
+    ++state_->stats.coalesced;
+    return;
+  }
+  slot.in_flight = true;
+  ++state_->stats.reads;
+  Source source = state_->source;
+  lock.unlock();
+
+  std::shared_ptr<State> state = state_;
+  document.Get(source).OnCompletion(
+      [state, path](const Future<DocumentSnapshot>& future) {
+        Error error = static_cast<Error>(future.error());
+        DocumentSnapshot snapshot;
+        std::string error_message;
+        if (error == Error::kErrorOk) {
+          snapshot = *future.result();
+        } else {
+          error_message = future.error_message();
+        }
+
+        std::vector<Callback> waiters;
+        {
+          std::lock_guard<std::mutex> lock(state->mutex);
+          State::Slot& slot = state->slots[path];
+          waiters = std::move(slot.waiters);
+          slot.waiters.clear();
+          slot.in_flight = false;
+
+          if (error == Error::kErrorOk && state->max_staleness.count() > 0) {
+            slot.has_result = true;
+            slot.snapshot = snapshot;
+            slot.fetched = Clock::now();
+            state->PruneExpired(slot.fetched);
+          } else {
+            // Nothing worth keeping; don't let idle paths accumulate.
+            state->slots.erase(path);
+          }
+        }
+
+        for (const Callback& waiter : waiters) {
+          waiter(snapshot, error, error_message);
+        }
+      });
+}
+
+DocumentCoalescerStats DocumentCoalescer::stats() const {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  return state_->stats;
+}
+
+}  // namespace snippets
@@ -0,0 +1,79 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_DOCUMENT_COALESCER_H
+#define FIRESTORESNIPPETSCPP_DOCUMENT_COALESCER_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "firebase/firestore.h"
+
+namespace snippets {
+
+struct DocumentCoalescerStats {
+  // Gets that issued a read.
+  int64_t reads = 0;
+  // Gets that joined a read already in flight.
+  int64_t coalesced = 0;
+  // Gets answered from a result younger than the allowed staleness.
+  int64_t reused = 0;
+};
+
+// Coalesces concurrent `DocumentReference::Get()` calls for the same path.
+//
+// While a read of a document is in flight, further `Get()`s of that document
+// wait for it instead of issuing reads of their own. With a non-zero
+// `max_staleness`, a completed result is also handed to `Get()`s made within
+// that window, so a burst of reads of a hot document costs one backend read
+// per window.
+//
+//   DocumentCoalescer coalescer(std::chrono::milliseconds(500));
+//   coalescer.Get(db->Collection("cities").Document("SF"),
+//                 [](const DocumentSnapshot& snapshot, Error error,
+//                    const std::string& error_message) { /* ... */ });
+class DocumentCoalescer {
+ public:
+  using Callback =
+      std::function<void(const firebase::firestore::DocumentSnapshot&,
+                         firebase::firestore::Error, const std::string&)>;
+
+  // `max_staleness` of zero only shares reads that are still in flight.
+  explicit DocumentCoalescer(
+      std::chrono::milliseconds max_staleness = std::chrono::milliseconds(0),
+      firebase::firestore::Source source =
+          firebase::firestore::Source::kDefault);
+
+  // Calls `callback` with a snapshot of `document`. A reused result is
+  // delivered before `Get()` returns; otherwise `callback` runs on a Firestore
+  // callback thread.
+  void Get(const firebase::firestore::DocumentReference& document,
+           Callback callback);
+
+  DocumentCoalescerStats stats() const;
+
+ private:
+  struct State;
+
+  std::shared_ptr<State> state_;
+};
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_DOCUMENT_COALESCER_H
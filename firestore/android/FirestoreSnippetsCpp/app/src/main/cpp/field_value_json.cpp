@@ -0,0 +1,419 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "field_value_json.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace snippets {
+
+namespace {
+
+using firebase::firestore::FieldValue;
+using firebase::firestore::MapFieldValue;
+
+// Deepest nesting of objects and arrays accepted, so that hostile input
+// can't exhaust the stack.
+constexpr int kMaxDepth = 64;
+
+// A small recursive-descent JSON parser that produces `FieldValue`s directly,
+// without going through an intermediate representation.
+class JsonParser {
+ public:
+  explicit JsonParser(const std::string& json) : json_(json) {}
+
+  bool Parse(FieldValue* out, std::string* error_message) {
+    SkipWhitespace();
+    if (!ParseValue(out)) {
+      *error_message = error_;
+      return false;
+    }
+    SkipWhitespace();
+    if (pos_ != json_.size()) {
+      *error_message = ErrorAt("unexpected trailing characters");
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  bool ParseValue(FieldValue* out) {
+    if (pos_ >= json_.size()) {
+      return Fail("unexpected end of input");
+    }
+
+    char c = json_[pos_];
+    switch (c) {
+      case '{':
+        return ParseObject(out);
+      case '[':
+        return ParseArray(out);
+      case '"': {
+        std::string s;
+        if (!ParseString(&s)) return false;
+        *out = FieldValue::String(std::move(s));
+        return true;
+      }
+      case 't':
+        if (!ConsumeLiteral("true")) return false;
+        *out = FieldValue::Boolean(true);
+        return true;
+      case 'f':
+        if (!ConsumeLiteral("false")) return false;
+        *out = FieldValue::Boolean(false);
+        return true;
+      case 'n':
+        if (!ConsumeLiteral("null")) return false;
+        *out = FieldValue::Null();
+        return true;
+      default:
+        if (c == '-' || (c >= '0' && c <= '9')) {
+          return ParseNumber(out);
+        }
+        return Fail("unexpected character");
+    }
+  }
+
+  bool ParseObject(FieldValue* out) {
+    if (depth_ >= kMaxDepth) return Fail("nesting too deep");
+    ++pos_;  // '{'
+    ++depth_;
+    MapFieldValue result;
+
+    SkipWhitespace();
+    if (Peek() == '}') {
+      ++pos_;
+      --depth_;
+      *out = FieldValue::Map(std::move(result));
+      return true;
+    }
+
+    while (true) {
+      SkipWhitespace();
+      if (Peek() != '"') return Fail("expected object key");
+      std::string key;
+      if (!ParseString(&key)) return false;
+
+      SkipWhitespace();
+      if (Peek() != ':') return Fail("expected ':'");
+      ++pos_;
+
+      SkipWhitespace();
+      FieldValue value;
+      if (!ParseValue(&value)) return false;
+      result[key] = std::move(value);
+
+      SkipWhitespace();
+      char c = Peek();
+      ++pos_;
+      if (c == '}') break;
+      if (c != ',') return Fail("expected ',' or '}'");
+    }
+
+    --depth_;
+    *out = FieldValue::Map(std::move(result));
+    return true;
+  }
+
+  bool ParseArray(FieldValue* out) {
+    if (depth_ >= kMaxDepth) return Fail("nesting too deep");
+    ++pos_;  // '['
+    ++depth_;
+    std::vector<FieldValue> result;
+
+    SkipWhitespace();
+    if (Peek() == ']') {
+      ++pos_;
+      --depth_;
+      *out = FieldValue::Array(std::move(result));
+      return true;
+    }
+
+    while (true) {
+      SkipWhitespace();
+      FieldValue value;
+      if (!ParseValue(&value)) return false;
+      result.push_back(std::move(value));
+
+      SkipWhitespace();
+      char c = Peek();
+      ++pos_;
+      if (c == ']') break;
+      if (c != ',') return Fail("expected ',' or ']'");
+    }
+
+    --depth_;
+    *out = FieldValue::Array(std::move(result));
+    return true;
+  }
+
+  bool ParseString(std::string* out) {
+    ++pos_;  // '"'
+    while (pos_ < json_.size()) {
+      char c = json_[pos_++];
+      if (c == '"') return true;
+      if (static_cast<unsigned char>(c) < 0x20) {
+        return Fail("unescaped control character in string");
+      }
+      if (c != '\\') {
+        out->push_back(c);
+        continue;
+      }
+
+      if (pos_ >= json_.size()) break;
+      char escaped = json_[pos_++];
+      switch (escaped) {
+        case '"':
+        case '\\':
+        case '/':
+          out->push_back(escaped);
+          break;
+        case 'b':
+          out->push_back('\b');
+          break;
+        case 'f':
+          out->push_back('\f');
+          break;
+        case 'n':
+          out->push_back('\n');
+          break;
+        case 'r':
+          out->push_back('\r');
+          break;
+        case 't':
+          out->push_back('\t');
+          break;
+        case 'u': {
+          uint32_t code_point = 0;
+          if (!ParseHex4(&code_point)) return false;
+          // Combine UTF-16 surrogate pairs into a single code point. A
+          // surrogate on its own has no UTF-8 encoding.
+          if (code_point >= 0xDC00 && code_point <= 0xDFFF) {
+            return Fail("unpaired surrogate in \\u escape");
+          }
+          if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+            if (json_.compare(pos_, 2, "\\u") != 0) {
+              return Fail("unpaired surrogate in \\u escape");
+            }
+            pos_ += 2;
+            uint32_t low = 0;
+            if (!ParseHex4(&low)) return false;
+            if (low < 0xDC00 || low > 0xDFFF) {
+              return Fail("unpaired surrogate in \\u escape");
+            }
+            code_point =
+                0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+          }
+          AppendUtf8(code_point, out);
+          break;
+        }
+        default:
+          return Fail("invalid escape sequence");
+      }
+    }
+    return Fail("unterminated string");
+  }
+
+  bool ParseHex4(uint32_t* out) {
+    if (pos_ + 4 > json_.size()) return Fail("truncated \\u escape");
+    for (int i = 0; i < 4; ++i) {
+      char c = json_[pos_++];
+      *out <<= 4;
+      if (c >= '0' && c <= '9') {
+        *out |= c - '0';
+      } else if (c >= 'a' && c <= 'f') {
+        *out |= c - 'a' + 10;
+      } else if (c >= 'A' && c <= 'F') {
+        *out |= c - 'A' + 10;
+      } else {
+        return Fail("invalid \\u escape");
+      }
+    }
+    return true;
+  }
+
+  // Follows the JSON grammar: an optional minus, an integer part without
+  // leading zeros, then optionally a fraction and an exponent, each with at
+  // least one digit.
+  bool ParseNumber(FieldValue* out) {
+    size_t start = pos_;
+    bool is_integer = true;
+    if (Peek() == '-') ++pos_;
+    if (Peek() == '0') {
+      ++pos_;
+    } else if (SkipDigits() == 0) {
+      return Fail("invalid number");
+    }
+    if (Peek() == '.') {
+      ++pos_;
+      if (SkipDigits() == 0) return Fail("invalid number");
+      is_integer = false;
+    }
+    if (Peek() == 'e' || Peek() == 'E') {
+      ++pos_;
+      if (Peek() == '+' || Peek() == '-') ++pos_;
+      if (SkipDigits() == 0) return Fail("invalid number");
+      is_integer = false;
+    }
+    if (Peek() >= '0' && Peek() <= '9') {
+      return Fail("invalid number");
+    }
+
+    std::string number = json_.substr(start, pos_ - start);
+    char* end = nullptr;
+    if (is_integer) {
+      errno = 0;
+      long long value = std::strtoll(number.c_str(), &end, 10);
+      if (*end != '\0') {
+        return Fail("invalid number");
+      }
+      if (errno != ERANGE) {
+        *out = FieldValue::Integer(value);
+        return true;
+      }
+      // Too large for 64 bits, so read as a double instead, as most JSON
+      // parsers do.
+    }
+    double value = std::strtod(number.c_str(), &end);
+    if (*end != '\0') {
+      return Fail("invalid number");
+    }
+    *out = FieldValue::Double(value);
+    return true;
+  }
+
+  // Advances past a run of digits and returns its length.
+  size_t SkipDigits() {
+    size_t start = pos_;
+    while (pos_ < json_.size() && json_[pos_] >= '0' && json_[pos_] <= '9') {
+      ++pos_;
+    }
+    return pos_ - start;
+  }
+
+  bool ConsumeLiteral(const char* literal) {
+    std::string expected(literal);
+    if (json_.compare(pos_, expected.size(), expected) != 0) {
+      return Fail("invalid literal");
+    }
+    pos_ += expected.size();
+    return true;
+  }
+
+  static void AppendUtf8(uint32_t code_point, std::string* out) {
+    if (code_point < 0x80) {
+      out->push_back(static_cast<char>(code_point));
+    } else if (code_point < 0x800) {
+      out->push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+      out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else if (code_point < 0x10000) {
+      out->push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+      out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+      out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else {
+      out->push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+      out->push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+      out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+      out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+  }
+
+  void SkipWhitespace() {
+    while (pos_ < json_.size() &&
+           (json_[pos_] == ' ' || json_[pos_] == '\t' || json_[pos_] == '\n' ||
+            json_[pos_] == '\r')) {
+      ++pos_;
+    }
+  }
+
+  char Peek() const { return pos_ < json_.size() ? json_[pos_] : '\0'; }
+
+  bool Fail(const char* message) {
+    error_ = ErrorAt(message);
+    return false;
+  }
+
+  std::string ErrorAt(const char* message) const {
+    return std::string(message) + " at offset " + std::to_string(pos_);
+  }
+
+  const std::string& json_;
+  size_t pos_ = 0;
+  int depth_ = 0;
+  std::string error_;
+};
+
+}  // namespace
+
+bool ParseJson(const std::string& json, FieldValue* out,
+               std::string* error_message) {
+  return JsonParser(json).Parse(out, error_message);
+}
+
+bool ParseJsonObject(const std::string& json, MapFieldValue* out,
+                     std::string* error_message) {
+  FieldValue value;
+  if (!ParseJson(json, &value, error_message)) {
+    return false;
+  }
+  if (!value.is_map()) {
+    *error_message = "top-level JSON value is not an object";
+    return false;
+  }
+  *out = value.map_value();
+  return true;
+}
+
+void AppendJsonString(const std::string& value, std::string* out) {
+  static const char kHex[] = "0123456789abcdef";
+  out->push_back('"');
+  for (char c : value) {
+    switch (c) {
+      case '"':
+        out->append("\\\"");
+        break;
+      case '\\':
+        out->append("\\\\");
+        break;
+      case '\n':
+        out->append("\\n");
+        break;
+      case '\r':
+        out->append("\\r");
+        break;
+      case '\t':
+        out->append("\\t");
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          out->append("\\u00");
+          out->push_back(kHex[(c >> 4) & 0xf]);
+          out->push_back(kHex[c & 0xf]);
+        } else {
+          // UTF-8 sequences are valid in JSON strings as they are.
+          out->push_back(c);
+        }
+    }
+  }
+  out->push_back('"');
+}
+
+}  // namespace snippets
@@ -0,0 +1,52 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_FIELD_VALUE_JSON_H
+#define FIRESTORESNIPPETSCPP_FIELD_VALUE_JSON_H
+
+#include <string>
+
+#include "firebase/firestore.h"
+
+namespace snippets {
+
+// Parses a single JSON value into a `FieldValue`.
+//
+// JSON numbers without a fraction or exponent become integers, unless they
+// don't fit in 64 bits; all other numbers become doubles. Objects become maps
+// and arrays become arrays; there is no special encoding for timestamps,
+// references or other Firestore-only types.
+//
+// Returns false and fills in `error_message` if `json` is not valid JSON
+// (including numbers such as "01", "1." or "+1", and unescaped control
+// characters in strings), is nested more than 64 levels deep, or contains an
+// unpaired UTF-16 surrogate escape.
+bool ParseJson(const std::string& json, firebase::firestore::FieldValue* out,
+               std::string* error_message);
+
+// Like `ParseJson`, but requires the top-level value to be a JSON object, so
+// that the result can be written directly as document data.
+bool ParseJsonObject(const std::string& json,
+                     firebase::firestore::MapFieldValue* out,
+                     std::string* error_message);
+
+// Appends `value` to `out` as a quoted JSON string, escaping quotes,
+// backslashes and control characters.
+void AppendJsonString(const std::string& value, std::string* out);
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_FIELD_VALUE_JSON_H
@@ -0,0 +1,214 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "field_value_order.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace snippets {
+
+using firebase::firestore::FieldValue;
+using firebase::firestore::MapFieldValue;
+
+namespace {
+
+int TypeRank(FieldValue::Type type) {
+  switch (type) {
+    case FieldValue::Type::kNull:
+      return 0;
+    case FieldValue::Type::kBoolean:
+      return 1;
+    case FieldValue::Type::kInteger:
+    case FieldValue::Type::kDouble:
+      return 2;
+    case FieldValue::Type::kTimestamp:
+      return 3;
+    case FieldValue::Type::kString:
+      return 4;
+    case FieldValue::Type::kBlob:
+      return 5;
+    case FieldValue::Type::kReference:
+      return 6;
+    case FieldValue::Type::kGeoPoint:
+      return 7;
+    case FieldValue::Type::kArray:
+      return 8;
+    case FieldValue::Type::kMap:
+      return 9;
+    default:
+      // Sentinels such as `Delete()` or `ServerTimestamp()` never appear in
+      // snapshots; keep them after everything else.
+      return 10;
+  }
+}
+
+template <typename T>
+int Compare(const T& lhs, const T& rhs) {
+  if (lhs < rhs) return -1;
+  if (rhs < lhs) return 1;
+  return 0;
+}
+
+int CompareDoubles(double lhs, double rhs) {
+  if (std::isnan(lhs)) return std::isnan(rhs) ? 0 : -1;
+  if (std::isnan(rhs)) return 1;
+  return Compare(lhs, rhs);
+}
+
+// Compares without converting the integer to double, which would lose
+// precision above 2^53.
+int CompareIntegerToDouble(int64_t lhs, double rhs) {
+  if (std::isnan(rhs)) return 1;
+  if (rhs < -9223372036854775808.0) return 1;
+  if (rhs >= 9223372036854775808.0) return -1;
+
+  double whole = std::trunc(rhs);
+  int result = Compare(lhs, static_cast<int64_t>(whole));
+  if (result != 0) return result;
+  return Compare(0.0, rhs - whole);
+}
+
+int CompareNumbers(const FieldValue& lhs, const FieldValue& rhs) {
+  if (lhs.is_integer() && rhs.is_integer()) {
+    return Compare(lhs.integer_value(), rhs.integer_value());
+  }
+  if (lhs.is_integer()) {
+    return CompareIntegerToDouble(lhs.integer_value(), rhs.double_value());
+  }
+  if (rhs.is_integer()) {
+    return -CompareIntegerToDouble(rhs.integer_value(), lhs.double_value());
+  }
+  return CompareDoubles(lhs.double_value(), rhs.double_value());
+}
+
+int CompareBytes(const uint8_t* lhs, size_t lhs_size, const uint8_t* rhs,
+                 size_t rhs_size) {
+  size_t common = std::min(lhs_size, rhs_size);
+  int result = common == 0 ? 0 : std::memcmp(lhs, rhs, common);
+  if (result != 0) return result < 0 ? -1 : 1;
+  return Compare(lhs_size, rhs_size);
+}
+
+// Paths compare segment by segment, so "a/b" sorts before "a-b/c" even
+// though '-' is smaller than '/'.
+int ComparePaths(const std::string& lhs, const std::string& rhs) {
+  size_t lhs_begin = 0;
+  size_t rhs_begin = 0;
+  while (lhs_begin <= lhs.size() && rhs_begin <= rhs.size()) {
+    size_t lhs_end = std::min(lhs.find('/', lhs_begin), lhs.size());
+    size_t rhs_end = std::min(rhs.find('/', rhs_begin), rhs.size());
+    int result = lhs.compare(lhs_begin, lhs_end - lhs_begin, rhs, rhs_begin,
+                             rhs_end - rhs_begin);
+    if (result != 0) return result < 0 ? -1 : 1;
+    lhs_begin = lhs_end + 1;
+    rhs_begin = rhs_end + 1;
+  }
+  return Compare(lhs_begin <= lhs.size(), rhs_begin <= rhs.size());
+}
+
+std::vector<std::pair<std::string, FieldValue>> SortedEntries(
+    const MapFieldValue& map) {
+  std::vector<std::pair<std::string, FieldValue>> entries(map.begin(),
+                                                          map.end());
+  std::sort(entries.begin(), entries.end(),
+            [](const std::pair<std::string, FieldValue>& lhs,
+               const std::pair<std::string, FieldValue>& rhs) {
+              return lhs.first < rhs.first;
+            });
+  return entries;
+}
+
+}  // namespace
+
+int FieldValueTypeOrder(const FieldValue& value) {
+  return TypeRank(value.type());
+}
+
+int CompareFieldValues(const FieldValue& lhs, const FieldValue& rhs) {
+  int lhs_rank = TypeRank(lhs.type());
+  int rhs_rank = TypeRank(rhs.type());
+  if (lhs_rank != rhs_rank) return Compare(lhs_rank, rhs_rank);
+
+  switch (lhs.type()) {
+    case FieldValue::Type::kNull:
+      return 0;
+    case FieldValue::Type::kBoolean:
+      return Compare(lhs.boolean_value(), rhs.boolean_value());
+    case FieldValue::Type::kInteger:
+    case FieldValue::Type::kDouble:
+      return CompareNumbers(lhs, rhs);
+    case FieldValue::Type::kTimestamp: {
+      firebase::Timestamp lhs_ts = lhs.timestamp_value();
+      firebase::Timestamp rhs_ts = rhs.timestamp_value();
+      int result = Compare(lhs_ts.seconds(), rhs_ts.seconds());
+      return result != 0 ? result
+                         : Compare(lhs_ts.nanoseconds(), rhs_ts.nanoseconds());
+    }
+    case FieldValue::Type::kString: {
+      // `std::string::compare` compares as unsigned bytes, which for UTF-8
+      // matches code point order.
+      int result = lhs.string_value().compare(rhs.string_value());
+      return result < 0 ? -1 : (result > 0 ? 1 : 0);
+    }
+    case FieldValue::Type::kBlob:
+      return CompareBytes(lhs.blob_value(), lhs.blob_size(), rhs.blob_value(),
+                          rhs.blob_size());
+    case FieldValue::Type::kReference:
+      return ComparePaths(lhs.reference_value().path(),
+                          rhs.reference_value().path());
+    case FieldValue::Type::kGeoPoint: {
+      firebase::GeoPoint lhs_point = lhs.geo_point_value();
+      firebase::GeoPoint rhs_point = rhs.geo_point_value();
+      int result = CompareDoubles(lhs_point.latitude(), rhs_point.latitude());
+      return result != 0 ? result
+                         : CompareDoubles(lhs_point.longitude(),
+                                          rhs_point.longitude());
+    }
+    case FieldValue::Type::kArray: {
+      std::vector<FieldValue> lhs_values = lhs.array_value();
+      std::vector<FieldValue> rhs_values = rhs.array_value();
+      size_t common = std::min(lhs_values.size(), rhs_values.size());
+      for (size_t i = 0; i < common; ++i) {
+        int result = CompareFieldValues(lhs_values[i], rhs_values[i]);
+        if (result != 0) return result;
+      }
+      return Compare(lhs_values.size(), rhs_values.size());
+    }
+    case FieldValue::Type::kMap: {
+      auto lhs_entries = SortedEntries(lhs.map_value());
+      auto rhs_entries = SortedEntries(rhs.map_value());
+      size_t common = std::min(lhs_entries.size(), rhs_entries.size());
+      for (size_t i = 0; i < common; ++i) {
+        int result = Compare(lhs_entries[i].first, rhs_entries[i].first);
+        if (result != 0) return result;
+        result = CompareFieldValues(lhs_entries[i].second,
+                                    rhs_entries[i].second);
+        if (result != 0) return result;
+      }
+      return Compare(lhs_entries.size(), rhs_entries.size());
+    }
+    default:
+      return 0;
+  }
+}
+
+}  // namespace snippets
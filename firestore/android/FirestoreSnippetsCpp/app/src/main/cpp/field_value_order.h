@@ -0,0 +1,51 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_FIELD_VALUE_ORDER_H
+#define FIRESTORESNIPPETSCPP_FIELD_VALUE_ORDER_H
+
+#include "firebase/firestore.h"
+
+namespace snippets {
+
+// Compares two values the way Firestore orders them in query results.
+// Returns a negative number, zero or a positive number when `lhs` sorts
+// before, together with or after `rhs`.
+//
+// Values of different types sort by type: null, booleans, numbers,
+// timestamps, strings, blobs, references, geo points, arrays, maps. Integers
+// and doubles are compared by numeric value, with NaN before every other
+// number. Strings and blobs compare bytewise, arrays element by element, and
+// maps by their sorted keys and then values.
+int CompareFieldValues(const firebase::firestore::FieldValue& lhs,
+                       const firebase::firestore::FieldValue& rhs);
+
+// Returns the position of `value`'s type in the order above, starting at 0
+// for null. Integers and doubles share a position. Range filters only match
+// values whose type has the same position as the operand's.
+int FieldValueTypeOrder(const firebase::firestore::FieldValue& value);
+
+// Strict weak ordering over `FieldValue`, for ordered containers.
+struct FieldValueLess {
+  bool operator()(const firebase::firestore::FieldValue& lhs,
+                  const firebase::firestore::FieldValue& rhs) const {
+    return CompareFieldValues(lhs, rhs) < 0;
+  }
+};
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_FIELD_VALUE_ORDER_H
@@ -0,0 +1,90 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "future_combinators.h"
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace snippets {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// A single thread that runs tasks at their due time. Tasks still pending at
+// exit are dropped.
+class TimerThread {
+ public:
+  TimerThread() : thread_([this] { Run(); }) { thread_.detach(); }
+
+  void Schedule(Clock::time_point when, std::function<void()> task) {
+    bool earliest;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      earliest = tasks_.empty() || when < tasks_.begin()->first;
+      tasks_.emplace(when, std::move(task));
+    }
+    if (earliest) {
+      cv_.notify_one();
+    }
+  }
+
+ private:
+  void Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      if (tasks_.empty()) {
+        cv_.wait(lock);
+        continue;
+      }
+      auto first = tasks_.begin();
+      if (first->first > Clock::now()) {
+        cv_.wait_until(lock, first->first);
+        continue;
+      }
+      std::function<void()> task = std::move(first->second);
+      tasks_.erase(first);
+      lock.unlock();
+      task();
+      task = nullptr;
+      lock.lock();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::multimap<Clock::time_point, std::function<void()>> tasks_;
+  // Last, so that it starts after the other members are initialized.
+  std::thread thread_;
+};
+
+// Never destroyed: the thread may still be waiting when static destructors
+// run.
+TimerThread& SharedTimer() {
+  static TimerThread* timer = new TimerThread();
+  return *timer;
+}
+
+}  // namespace
+
+void RunAfter(std::chrono::milliseconds delay, std::function<void()> task) {
+  SharedTimer().Schedule(Clock::now() + delay, std::move(task));
+}
+
+}  // namespace snippets
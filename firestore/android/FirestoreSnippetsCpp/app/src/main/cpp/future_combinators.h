@@ -0,0 +1,147 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_FUTURE_COMBINATORS_H
+#define FIRESTORESNIPPETSCPP_FUTURE_COMBINATORS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "firebase/future.h"
+
+// Combinators over `firebase::Future`.
+//
+// Futures can't be created outside the SDK, so instead of returning a new
+// future each combinator calls back once its condition is met. Completions
+// are counted with atomics rather than a lock, and no thread waits on any
+// future; the callbacks run on whichever thread completes the deciding
+// future. `FutureType` is any `firebase::Future<T>`, or `firebase::FutureBase`
+// to mix result types.
+//
+// Callbacks are registered with `AddOnCompletion()`, so they don't displace
+// a callback set with `OnCompletion()` or by another combinator on the same
+// future. The SDK releases them once the future completes.
+
+namespace snippets {
+
+// Calls `callback(futures)` once every future in `futures` has completed,
+// successfully or not. Calls it immediately if `futures` is empty.
+template <typename FutureType>
+void WhenAll(
+    std::vector<FutureType> futures,
+    std::function<void(const std::vector<FutureType>&)> callback) {
+  struct State {
+    std::vector<FutureType> futures;
+    std::function<void(const std::vector<FutureType>&)> callback;
+    std::atomic<size_t> remaining{0};
+  };
+
+  if (futures.empty()) {
+    callback(futures);
+    return;
+  }
+
+  auto state = std::make_shared<State>();
+  state->futures = std::move(futures);
+  state->callback = std::move(callback);
+  state->remaining.store(state->futures.size(), std::memory_order_relaxed);
+
+  // Callbacks for futures that are already complete run immediately, and the
+  // last one clears `state->futures`, so iterate over a copy.
+  std::vector<FutureType> pending = state->futures;
+  for (const FutureType& future : pending) {
+    future.AddOnCompletion([state](const FutureType&) {
+      // acq_rel: the last completion must see every earlier one's effects
+      // before handing the futures to the callback.
+      if (state->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        state->callback(state->futures);
+        // Release the futures now rather than when the SDK destroys the
+        // last completion callback.
+        state->futures.clear();
+        state->callback = nullptr;
+      }
+    });
+  }
+}
+
+// Calls `callback(index, future)` for the first future in `futures` to
+// complete. Later completions are ignored. Does nothing if `futures` is
+// empty.
+template <typename FutureType>
+void WhenAny(const std::vector<FutureType>& futures,
+             std::function<void(size_t, const FutureType&)> callback) {
+  struct State {
+    std::function<void(size_t, const FutureType&)> callback;
+    std::atomic<bool> done{false};
+  };
+
+  auto state = std::make_shared<State>();
+  state->callback = std::move(callback);
+
+  for (size_t i = 0; i < futures.size(); ++i) {
+    futures[i].AddOnCompletion([state, i](const FutureType& future) {
+      if (!state->done.exchange(true, std::memory_order_acq_rel)) {
+        std::function<void(size_t, const FutureType&)> callback =
+            std::move(state->callback);
+        callback(i, future);
+      }
+    });
+  }
+}
+
+// Runs `task` on a shared timer thread after `delay`. All timeouts in the
+// process share the one thread.
+void RunAfter(std::chrono::milliseconds delay, std::function<void()> task);
+
+// Calls `callback(future, false)` when `future` completes, or
+// `callback(future, true)` if it is still pending after `timeout`, whichever
+// happens first. A timeout doesn't cancel the underlying operation.
+template <typename FutureType>
+void WithTimeout(const FutureType& future, std::chrono::milliseconds timeout,
+                 std::function<void(const FutureType&, bool timed_out)>
+                     callback) {
+  struct State {
+    std::function<void(const FutureType&, bool)> callback;
+    std::atomic<bool> done{false};
+  };
+
+  auto state = std::make_shared<State>();
+  state->callback = std::move(callback);
+
+  future.AddOnCompletion([state](const FutureType& completed) {
+    if (!state->done.exchange(true, std::memory_order_acq_rel)) {
+      std::function<void(const FutureType&, bool)> callback =
+          std::move(state->callback);
+      callback(completed, false);
+    }
+  });
+  RunAfter(timeout, [state, future] {
+    if (!state->done.exchange(true, std::memory_order_acq_rel)) {
+      std::function<void(const FutureType&, bool)> callback =
+          std::move(state->callback);
+      callback(future, true);
+    }
+  });
+}
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_FUTURE_COMBINATORS_H
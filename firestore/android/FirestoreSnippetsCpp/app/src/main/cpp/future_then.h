@@ -0,0 +1,57 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_FUTURE_THEN_H
+#define FIRESTORESNIPPETSCPP_FUTURE_THEN_H
+
+#include <functional>
+
+#include "firebase/future.h"
+
+namespace snippets {
+
+// Runs a task, possibly on another thread. An empty `Executor` means "run it
+// inline, on the thread that completed the future".
+//
+// A `CallbackExecutor` queue can serve as an executor:
+//
+//   uint64_t queue = callback_executor.NewListener();
+//   Executor executor = [&callback_executor, queue](std::function<void()> f) {
+//     callback_executor.Post(queue, std::move(f));
+//   };
+using Executor = std::function<void(std::function<void()>)>;
+
+// Calls `callback(future)` on `executor` once `future` completes.
+//
+// Each step of a chain can choose where it runs instead of always running
+// on the SDK's callback thread. The callback is added with
+// `AddOnCompletion()`, so it doesn't replace one already set on `future`.
+template <typename T, typename Callback>
+void ThenOn(const firebase::Future<T>& future, Executor executor,
+            Callback callback) {
+  future.AddOnCompletion(
+      [executor, callback](const firebase::Future<T>& done) {
+        if (executor) {
+          executor([callback, done] { callback(done); });
+        } else {
+          callback(done);
+        }
+      });
+}
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_FUTURE_THEN_H
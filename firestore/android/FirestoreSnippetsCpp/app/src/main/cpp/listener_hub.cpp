@@ -0,0 +1,305 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "listener_hub.h"
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace snippets {
+
+using firebase::firestore::DocumentReference;
+using firebase::firestore::DocumentSnapshot;
+using firebase::firestore::Error;
+using firebase::firestore::ListenerRegistration;
+using firebase::firestore::MetadataChanges;
+using firebase::firestore::Query;
+using firebase::firestore::QuerySnapshot;
+
+namespace {
+
+// One underlying listener and the subscribers it fans out to.
+template <typename Snapshot>
+struct Channel {
+  // What the SDK calls.
+  using Listener =
+      std::function<void(const Snapshot&, Error, const std::string&)>;
+  // What subscribers get: the event, and whether it is a replay.
+  using Callback =
+      std::function<void(const Snapshot&, Error, const std::string&, bool)>;
+
+  ListenerRegistration registration;
+  bool registered = false;
+
+  // The most recent event, replayed to subscribers that join later, and how
+  // many events there have been.
+  bool has_last = false;
+  Snapshot last;
+  Error last_error = Error::kErrorOk;
+  std::string last_error_message;
+  uint64_t sequence = 0;
+
+  std::map<uint64_t, Callback> subscribers;
+  // Subscribers that are still being sent the replay. The channel is kept
+  // while there are any, even if it has no subscribers.
+  int joining = 0;
+};
+
+template <typename Snapshot>
+using ChannelMap =
+    std::unordered_map<std::string, std::shared_ptr<Channel<Snapshot>>>;
+
+std::string ChannelKey(const std::string& target,
+                       MetadataChanges metadata_changes) {
+  return metadata_changes == MetadataChanges::kInclude ? target + "|metadata"
+                                                        : target;
+}
+
+}  // namespace
+
+struct ListenerHub::State {
+  // `listen` starts the underlying listener; it is only called for the first
+  // subscriber of `key`.
+  template <typename Snapshot, typename Listen>
+  static ListenerSubscription Subscribe(
+      const std::shared_ptr<State>& self, ChannelMap<Snapshot> State::*map,
+      const std::string& key, typename Channel<Snapshot>::Callback callback,
+      Listen listen) {
+    std::unique_lock<std::mutex> lock(self->mutex);
+    uint64_t id = self->next_id++;
+    std::shared_ptr<Channel<Snapshot>>& slot = ((*self).*map)[key];
+    bool is_new = !slot;
+    if (is_new) {
+      slot = std::make_shared<Channel<Snapshot>>();
+    }
+    std::shared_ptr<Channel<Snapshot>> channel = slot;
+
+    // The replay is sent before the subscriber is added, so that `Dispatch()`
+    // can't deliver a newer event ahead of it. An event that arrives while
+    // the replay is being sent is replayed as well.
+    uint64_t replayed = 0;
+    ++channel->joining;
+    while (channel->has_last && channel->sequence != replayed) {
+      replayed = channel->sequence;
+      Snapshot last = channel->last;
+      Error last_error = channel->last_error;
+      std::string last_error_message = channel->last_error_message;
+      lock.unlock();
+      callback(last, last_error, last_error_message, /*replayed=*/true);
+      lock.lock();
+    }
+    --channel->joining;
+    if (channel->has_last && channel->last_error != Error::kErrorOk) {
+      // The replay was the listener's error, and the channel is gone.
+      return ListenerSubscription();
+    }
+    channel->subscribers[id] = callback;
+    lock.unlock();
+
+    std::weak_ptr<State> weak_state = self;
+    std::weak_ptr<Channel<Snapshot>> weak_channel = channel;
+
+    if (is_new) {
+      // The listener is started without holding the lock, because the SDK
+      // may deliver the first snapshot before `AddSnapshotListener()`
+      // returns.
+      ListenerRegistration registration =
+          listen([weak_state, weak_channel, map, key](
+                     const Snapshot& snapshot, Error error,
+                     const std::string& error_message) {
+            Dispatch(weak_state, weak_channel, map, key, snapshot, error,
+                     error_message);
+          });
+
+      lock.lock();
+      if (channel->subscribers.empty() || self->shut_down) {
+        // Everyone left while the listener was being set up.
+        lock.unlock();
+        registration.Remove();
+      } else {
+        channel->registration = registration;
+        channel->registered = true;
+      }
+    }
+
+    return ListenerSubscription([weak_state, weak_channel, map, key, id] {
+      std::shared_ptr<State> state = weak_state.lock();
+      std::shared_ptr<Channel<Snapshot>> channel = weak_channel.lock();
+      if (!state || !channel) return;
+      Unsubscribe(state, channel, map, key, id);
+    });
+  }
+
+  template <typename Snapshot>
+  static void Unsubscribe(const std::shared_ptr<State>& self,
+                          const std::shared_ptr<Channel<Snapshot>>& channel,
+                          ChannelMap<Snapshot> State::*map,
+                          const std::string& key, uint64_t id) {
+    ListenerRegistration registration;
+    bool remove = false;
+    {
+      std::lock_guard<std::mutex> lock(self->mutex);
+      channel->subscribers.erase(id);
+      if (!channel->subscribers.empty() || channel->joining > 0) return;
+
+      ChannelMap<Snapshot>& channels = (*self).*map;
+      auto it = channels.find(key);
+      if (it != channels.end() && it->second == channel) {
+        channels.erase(it);
+      }
+      if (channel->registered) {
+        registration = channel->registration;
+        channel->registered = false;
+        remove = true;
+      }
+    }
+    // `Remove()` may wait for a callback in progress, and that callback may
+    // be waiting for the mutex, so it is called without holding it.
+    if (remove) {
+      registration.Remove();
+    }
+  }
+
+  // A listener that fails receives no further events, so its channel is
+  // dropped and the next subscriber starts a new listener.
+  template <typename Snapshot>
+  static void Dispatch(const std::weak_ptr<State>& weak_state,
+                       const std::weak_ptr<Channel<Snapshot>>& weak_channel,
+                       ChannelMap<Snapshot> State::*map,
+                       const std::string& key, const Snapshot& snapshot,
+                       Error error, const std::string& error_message) {
+    std::shared_ptr<State> state = weak_state.lock();
+    std::shared_ptr<Channel<Snapshot>> channel = weak_channel.lock();
+    if (!state || !channel) return;
+
+    std::vector<typename Channel<Snapshot>::Callback> subscribers;
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      channel->has_last = true;
+      channel->last = snapshot;
+      channel->last_error = error;
+      channel->last_error_message = error_message;
+      ++channel->sequence;
+      subscribers.reserve(channel->subscribers.size());
+      for (const auto& subscriber : channel->subscribers) {
+        subscribers.push_back(subscriber.second);
+      }
+
+      if (error != Error::kErrorOk) {
+        ChannelMap<Snapshot>& channels = (*state).*map;
+        auto it = channels.find(key);
+        if (it != channels.end() && it->second == channel) {
+          channels.erase(it);
+        }
+        // The SDK has already stopped the listener. `Remove()` isn't
+        // called, since it may wait for this very callback to return.
+        channel->registered = false;
+      }
+    }
+    for (const auto& subscriber : subscribers) {
+      subscriber(snapshot, error, error_message, /*replayed=*/false);
+    }
+  }
+
+  template <typename Snapshot>
+  void CollectRegistrations(ChannelMap<Snapshot>* channels,
+                            std::vector<ListenerRegistration>* out) {
+    for (auto& entry : *channels) {
+      if (entry.second->registered) {
+        out->push_back(entry.second->registration);
+        entry.second->registered = false;
+      }
+    }
+    channels->clear();
+  }
+
+  mutable std::mutex mutex;
+  uint64_t next_id = 1;
+  bool shut_down = false;
+  ChannelMap<DocumentSnapshot> documents;
+  ChannelMap<QuerySnapshot> queries;
+};
+
+ListenerHub::ListenerHub(firebase::firestore::Firestore* db)
+    : db_(db), state_(std::make_shared<State>()) {}
+
+ListenerHub::~ListenerHub() {
+  std::vector<ListenerRegistration> registrations;
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->shut_down = true;
+    state_->CollectRegistrations(&state_->documents, &registrations);
+    state_->CollectRegistrations(&state_->queries, &registrations);
+  }
+  for (ListenerRegistration& registration : registrations) {
+    registration.Remove();
+  }
+}
+
+ListenerSubscription ListenerHub::Subscribe(const DocumentReference& document,
+                                            DocumentCallback callback,
+                                            MetadataChanges metadata_changes) {
+  DocumentReference target = document;
+  // A replayed document snapshot is complete in itself, so document
+  // subscribers aren't told about replays.
+  auto subscriber = [callback](const DocumentSnapshot& snapshot, Error error,
+                               const std::string& error_message, bool) {
+    callback(snapshot, error, error_message);
+  };
+  return State::Subscribe<DocumentSnapshot>(
+      state_, &State::documents,
+      ChannelKey(document.path(), metadata_changes), subscriber,
+      [target, metadata_changes](
+          Channel<DocumentSnapshot>::Listener listener) mutable {
+        return target.AddSnapshotListener(metadata_changes, listener);
+      });
+}
+
+ListenerSubscription ListenerHub::Subscribe(const QuerySpec& query,
+                                            QueryCallback callback,
+                                            MetadataChanges metadata_changes) {
+  Query target = query.ToQuery(db_);
+  return State::Subscribe<QuerySnapshot>(
+      state_, &State::queries,
+      ChannelKey(query.CanonicalKey(), metadata_changes), std::move(callback),
+      [target, metadata_changes](
+          Channel<QuerySnapshot>::Listener listener) mutable {
+        return target.AddSnapshotListener(metadata_changes, listener);
+      });
+}
+
+size_t ListenerHub::listener_count() const {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  return state_->documents.size() + state_->queries.size();
+}
+
+size_t ListenerHub::subscriber_count() const {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  size_t count = 0;
+  for (const auto& entry : state_->documents) {
+    count += entry.second->subscribers.size();
+  }
+  for (const auto& entry : state_->queries) {
+    count += entry.second->subscribers.size();
+  }
+  return count;
+}
+
+}  // namespace snippets
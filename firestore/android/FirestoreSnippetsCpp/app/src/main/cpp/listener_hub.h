@@ -0,0 +1,98 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_LISTENER_HUB_H
+#define FIRESTORESNIPPETSCPP_LISTENER_HUB_H
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "firebase/firestore.h"
+#include "listener_subscription.h"
+#include "query_spec.h"
+
+namespace snippets {
+
+// Shares one snapshot listener between everyone watching the same document
+// or query.
+//
+// Each `AddSnapshotListener()` call opens its own watch stream, even for a
+// document that is already being listened to. The hub instead keeps a single
+// `ListenerRegistration` per document path (or per `QuerySpec` key) and
+// metadata mode, and forwards every snapshot to all of its subscribers. The
+// underlying listener is removed when its last subscriber goes away, so the
+// number of streams tracks the number of distinct targets, not the number of
+// subscribers.
+//
+// A subscriber that joins an active listener immediately receives the latest
+// snapshot, on the calling thread, before any newer event. All other events
+// arrive on the SDK's callback thread. A listener that fails is dropped once
+// its subscribers have been told, so subscribing again starts a new one.
+//
+// A replayed query snapshot still carries the `DocumentChanges()` of the
+// update that produced it, not an "added" entry for every document, so query
+// callbacks are told when a snapshot is replayed. Consumers that apply
+// changes, such as `LiveQueryView`, should rebuild from `documents()` then,
+// e.g. with `LiveQueryView::Reset()`.
+class ListenerHub {
+ public:
+  using DocumentCallback =
+      std::function<void(const firebase::firestore::DocumentSnapshot&,
+                         firebase::firestore::Error, const std::string&)>;
+  // `replayed` is true for the cached snapshot a late subscriber receives
+  // when it joins.
+  using QueryCallback = std::function<void(
+      const firebase::firestore::QuerySnapshot&, firebase::firestore::Error,
+      const std::string&, bool replayed)>;
+
+  explicit ListenerHub(firebase::firestore::Firestore* db);
+
+  // Removes every underlying listener. Outstanding subscriptions become
+  // no-ops.
+  ~ListenerHub();
+
+  ListenerHub(const ListenerHub&) = delete;
+  ListenerHub& operator=(const ListenerHub&) = delete;
+
+  ListenerSubscription Subscribe(
+      const firebase::firestore::DocumentReference& document,
+      DocumentCallback callback,
+      firebase::firestore::MetadataChanges metadata_changes =
+          firebase::firestore::MetadataChanges::kExclude);
+
+  ListenerSubscription Subscribe(
+      const QuerySpec& query, QueryCallback callback,
+      firebase::firestore::MetadataChanges metadata_changes =
+          firebase::firestore::MetadataChanges::kExclude);
+
+  // Number of underlying Firestore listeners.
+  size_t listener_count() const;
+
+  // Number of subscriptions across all listeners.
+  size_t subscriber_count() const;
+
+ private:
+  struct State;
+
+  firebase::firestore::Firestore* db_ = nullptr;
+  std::shared_ptr<State> state_;
+};
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_LISTENER_HUB_H
@@ -0,0 +1,285 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "listener_registry.h"
+
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <utility>
+
+namespace snippets {
+
+using firebase::firestore::DocumentReference;
+using firebase::firestore::DocumentSnapshot;
+using firebase::firestore::Error;
+using firebase::firestore::Firestore;
+using firebase::firestore::ListenerRegistration;
+using firebase::firestore::MetadataChanges;
+using firebase::firestore::Query;
+using firebase::firestore::QuerySnapshot;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double ToSeconds(Clock::duration duration) {
+  return std::chrono::duration<double>(duration).count();
+}
+
+}  // namespace
+
+double ListenerInfo::events_per_second() const {
+  double seconds = ToSeconds(age);
+  return seconds > 0 ? events / seconds : 0;
+}
+
+// Guarded by the state's mutex, except for the constant fields.
+struct ListenerRegistry::Entry {
+  ListenerInfo Describe(Clock::time_point now) const {
+    ListenerInfo info;
+    info.id = id;
+    info.owner = owner;
+    info.target = target;
+    info.age = now - created;
+    info.idle = now - (events > 0 ? last_event : created);
+    info.events = events;
+    return info;
+  }
+
+  uint64_t id = 0;
+  std::string owner;
+  std::string target;
+  Clock::time_point created;
+
+  int64_t events = 0;
+  Clock::time_point last_event;
+  ListenerRegistration registration;
+  bool registered = false;
+  // Shared with the listener's subscription, which stops being active once
+  // this is released.
+  std::shared_ptr<void> alive;
+  // Set once the listener is removed, in case that happens before
+  // `AddSnapshotListener()` has returned the registration.
+  bool removed = false;
+};
+
+struct ListenerRegistry::State {
+  // Forgets listener `id` and returns its registration, if it has one, for
+  // removal outside the lock. Requires `mutex`.
+  bool Untrack(uint64_t id, ListenerRegistration* registration) {
+    auto found = entries.find(id);
+    if (found == entries.end()) return false;
+    Entry& entry = *found->second;
+    entry.removed = true;
+    entry.alive.reset();
+    bool registered = entry.registered;
+    if (registered) {
+      *registration = entry.registration;
+      entry.registered = false;
+    }
+    entries.erase(found);
+    return registered;
+  }
+
+  void Detach(uint64_t id) {
+    ListenerRegistration registration;
+    bool registered;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      registered = Untrack(id, &registration);
+    }
+    if (registered) {
+      registration.Remove();
+    }
+  }
+
+  mutable std::mutex mutex;
+  uint64_t next_id = 1;
+  std::map<uint64_t, std::shared_ptr<Entry>> entries;
+};
+
+ListenerRegistry::ListenerRegistry(ListenerRegistryOptions options)
+    : options_(std::move(options)), state_(std::make_shared<State>()) {}
+
+ListenerRegistry::~ListenerRegistry() {
+  std::vector<ListenerRegistration> registrations;
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    for (auto& entry : state_->entries) {
+      entry.second->removed = true;
+      entry.second->alive.reset();
+      if (entry.second->registered) {
+        registrations.push_back(entry.second->registration);
+        entry.second->registered = false;
+      }
+    }
+    state_->entries.clear();
+  }
+  for (ListenerRegistration& registration : registrations) {
+    registration.Remove();
+  }
+}
+
+ListenerSubscription ListenerRegistry::Listen(
+    const DocumentReference& document, std::string owner,
+    DocumentCallback callback, MetadataChanges metadata_changes) {
+  std::shared_ptr<Entry> entry = Track(std::move(owner), document.path());
+  std::weak_ptr<State> weak_state = state_;
+
+  DocumentReference target = document;
+  ListenerRegistration registration = target.AddSnapshotListener(
+      metadata_changes,
+      [weak_state, entry, callback](const DocumentSnapshot& snapshot,
+                                    Error error,
+                                    const std::string& error_message) {
+        if (std::shared_ptr<State> state = weak_state.lock()) {
+          std::lock_guard<std::mutex> lock(state->mutex);
+          ++entry->events;
+          entry->last_event = Clock::now();
+        }
+        callback(snapshot, error, error_message);
+      });
+  return Attach(entry, registration);
+}
+
+ListenerSubscription ListenerRegistry::Listen(
+    const Query& query, std::string owner, QueryCallback callback,
+    MetadataChanges metadata_changes) {
+  return ListenToQuery(query, std::move(owner), "query", std::move(callback),
+                       metadata_changes);
+}
+
+ListenerSubscription ListenerRegistry::Listen(
+    Firestore* db, const QuerySpec& spec, std::string owner,
+    QueryCallback callback, MetadataChanges metadata_changes) {
+  return ListenToQuery(spec.ToQuery(db), std::move(owner), spec.CanonicalKey(),
+                       std::move(callback), metadata_changes);
+}
+
+ListenerSubscription ListenerRegistry::ListenToQuery(
+    const Query& query, std::string owner, std::string description,
+    QueryCallback callback, MetadataChanges metadata_changes) {
+  std::shared_ptr<Entry> entry =
+      Track(std::move(owner), std::move(description));
+  std::weak_ptr<State> weak_state = state_;
+
+  Query target = query;
+  ListenerRegistration registration = target.AddSnapshotListener(
+      metadata_changes,
+      [weak_state, entry, callback](const QuerySnapshot& snapshot, Error error,
+                                    const std::string& error_message) {
+        if (std::shared_ptr<State> state = weak_state.lock()) {
+          std::lock_guard<std::mutex> lock(state->mutex);
+          ++entry->events;
+          entry->last_event = Clock::now();
+        }
+        callback(snapshot, error, error_message);
+      });
+  return Attach(entry, registration);
+}
+
+std::vector<ListenerInfo> ListenerRegistry::ActiveListeners() const {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  Clock::time_point now = Clock::now();
+  std::vector<ListenerInfo> result;
+  result.reserve(state_->entries.size());
+  for (const auto& entry : state_->entries) {
+    result.push_back(entry.second->Describe(now));
+  }
+  return result;
+}
+
+std::vector<ListenerInfo> ListenerRegistry::CheckIdle() {
+  std::vector<ListenerInfo> idle;
+  std::vector<ListenerRegistration> registrations;
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    Clock::time_point now = Clock::now();
+    for (const auto& entry : state_->entries) {
+      ListenerInfo info = entry.second->Describe(now);
+      if (info.idle > options_.idle_threshold) {
+        idle.push_back(std::move(info));
+      }
+    }
+    if (options_.auto_detach_idle) {
+      for (const ListenerInfo& info : idle) {
+        ListenerRegistration registration;
+        if (state_->Untrack(info.id, &registration)) {
+          registrations.push_back(registration);
+        }
+      }
+    }
+  }
+
+  for (const ListenerInfo& info : idle) {
+    std::cout << "Listener " << info.id << " (" << info.owner << ", "
+              << info.target << ") has been idle for "
+              << ToSeconds(info.idle) << "s after " << info.events
+              << " events"
+              << (options_.auto_detach_idle ? "; detaching" : "") << std::endl;
+  }
+  for (ListenerRegistration& registration : registrations) {
+    registration.Remove();
+  }
+  return idle;
+}
+
+std::shared_ptr<ListenerRegistry::Entry> ListenerRegistry::Track(
+    std::string owner, std::string target) {
+  auto entry = std::make_shared<Entry>();
+  entry->owner = std::move(owner);
+  entry->target = std::move(target);
+  entry->created = Clock::now();
+
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  entry->id = state_->next_id++;
+  state_->entries.emplace(entry->id, entry);
+  return entry;
+}
+
+ListenerSubscription ListenerRegistry::Attach(
+    const std::shared_ptr<Entry>& entry, ListenerRegistration registration) {
+  bool attached = false;
+  std::shared_ptr<void> alive;
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    if (!entry->removed) {
+      entry->registration = registration;
+      entry->registered = true;
+      entry->alive = std::make_shared<bool>(true);
+      alive = entry->alive;
+      attached = true;
+    }
+  }
+  if (!attached) {
+    // Detached before it was fully attached.
+    registration.Remove();
+    return ListenerSubscription();
+  }
+
+  std::weak_ptr<State> weak_state = state_;
+  uint64_t id = entry->id;
+  return ListenerSubscription(
+      [weak_state, id] {
+        if (std::shared_ptr<State> state = weak_state.lock()) {
+          state->Detach(id);
+        }
+      },
+      alive);
+}
+
+}  // namespace snippets
@@ -0,0 +1,133 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_LISTENER_REGISTRY_H
+#define FIRESTORESNIPPETSCPP_LISTENER_REGISTRY_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "firebase/firestore.h"
+#include "listener_subscription.h"
+#include "query_spec.h"
+
+namespace snippets {
+
+struct ListenerInfo {
+  uint64_t id = 0;
+  // Who created the listener, as passed to `ListenerRegistry::Listen()`.
+  std::string owner;
+  // Path of the document, or `QuerySpec::CanonicalKey()` of the query. A
+  // query passed as a `Query`, which can't be read back, is just "query".
+  std::string target;
+
+  std::chrono::steady_clock::duration age{0};
+  // Time since the last event, or since creation if there was none.
+  std::chrono::steady_clock::duration idle{0};
+  int64_t events = 0;
+
+  double events_per_second() const;
+};
+
+struct ListenerRegistryOptions {
+  // Listeners without an event for this long are reported by `CheckIdle()`.
+  std::chrono::seconds idle_threshold{300};
+
+  // Whether `CheckIdle()` also removes the idle listeners it reports.
+  bool auto_detach_idle = false;
+};
+
+// Keeps track of every listener created through it, to find listeners that
+// were never removed.
+//
+// Each listener is recorded with its owner, its age and the events it has
+// received. `ActiveListeners()` lists them, and `CheckIdle()` warns about, or
+// detaches, listeners that have been quiet for longer than
+// `idle_threshold`. Call `CheckIdle()` periodically, e.g. when the app comes
+// to the foreground.
+//
+// Listeners are removed when their `ListenerSubscription` is destroyed, when
+// they are detached as idle, or when the registry is destroyed, whichever
+// comes first. The subscription of a listener removed by the registry stops
+// being `is_active()`. The registry is thread-safe.
+class ListenerRegistry {
+ public:
+  using DocumentCallback =
+      std::function<void(const firebase::firestore::DocumentSnapshot&,
+                         firebase::firestore::Error, const std::string&)>;
+  using QueryCallback =
+      std::function<void(const firebase::firestore::QuerySnapshot&,
+                         firebase::firestore::Error, const std::string&)>;
+
+  explicit ListenerRegistry(
+      ListenerRegistryOptions options = ListenerRegistryOptions());
+  ~ListenerRegistry();
+
+  ListenerRegistry(const ListenerRegistry&) = delete;
+  ListenerRegistry& operator=(const ListenerRegistry&) = delete;
+
+  ListenerSubscription Listen(
+      const firebase::firestore::DocumentReference& document,
+      std::string owner, DocumentCallback callback,
+      firebase::firestore::MetadataChanges metadata_changes =
+          firebase::firestore::MetadataChanges::kExclude);
+
+  ListenerSubscription Listen(
+      const firebase::firestore::Query& query, std::string owner,
+      QueryCallback callback,
+      firebase::firestore::MetadataChanges metadata_changes =
+          firebase::firestore::MetadataChanges::kExclude);
+
+  // As above, for the query `spec` describes, which is recorded by its
+  // canonical key so that `ActiveListeners()` shows what it listens to.
+  ListenerSubscription Listen(
+      firebase::firestore::Firestore* db, const QuerySpec& spec,
+      std::string owner, QueryCallback callback,
+      firebase::firestore::MetadataChanges metadata_changes =
+          firebase::firestore::MetadataChanges::kExclude);
+
+  std::vector<ListenerInfo> ActiveListeners() const;
+
+  // Logs every listener that has been idle for longer than `idle_threshold`,
+  // removing it if `auto_detach_idle` is set. Returns the listeners found.
+  std::vector<ListenerInfo> CheckIdle();
+
+ private:
+  struct Entry;
+  struct State;
+
+  // Records a listener whose registration is filled in once
+  // `AddSnapshotListener()` returns.
+  std::shared_ptr<Entry> Track(std::string owner, std::string target);
+  ListenerSubscription ListenToQuery(
+      const firebase::firestore::Query& query, std::string owner,
+      std::string description, QueryCallback callback,
+      firebase::firestore::MetadataChanges metadata_changes);
+  ListenerSubscription Attach(
+      const std::shared_ptr<Entry>& entry,
+      firebase::firestore::ListenerRegistration registration);
+
+  ListenerRegistryOptions options_;
+  std::shared_ptr<State> state_;
+};
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_LISTENER_REGISTRY_H
@@ -0,0 +1,86 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_LISTENER_SUBSCRIPTION_H
+#define FIRESTORESNIPPETSCPP_LISTENER_SUBSCRIPTION_H
+
+#include <functional>
+#include <memory>
+#include <utility>
+
+namespace snippets {
+
+// Keeps a listener, or a subscription to a shared one, alive. It ends when
+// `Remove()` is called or the object is destroyed.
+//
+// `ListenerHub` and `ListenerRegistry` both hand these out, so that a
+// listener can't be dropped on the floor the way a `ListenerRegistration`
+// can.
+class ListenerSubscription {
+ public:
+  ListenerSubscription() = default;
+  explicit ListenerSubscription(std::function<void()> remove)
+      : remove_(std::move(remove)) {}
+  // For a subscription that its issuer may also end, e.g. when
+  // `ListenerRegistry` detaches an idle listener. The issuer does so by
+  // releasing the last reference to `alive`.
+  ListenerSubscription(std::function<void()> remove, std::weak_ptr<void> alive)
+      : remove_(std::move(remove)), alive_(std::move(alive)), tracked_(true) {}
+  ~ListenerSubscription() { Remove(); }
+
+  ListenerSubscription(ListenerSubscription&& other) noexcept
+      : remove_(std::move(other.remove_)),
+        alive_(std::move(other.alive_)),
+        tracked_(other.tracked_) {
+    other.remove_ = nullptr;
+  }
+  ListenerSubscription& operator=(ListenerSubscription&& other) noexcept {
+    if (this != &other) {
+      Remove();
+      remove_ = std::move(other.remove_);
+      alive_ = std::move(other.alive_);
+      tracked_ = other.tracked_;
+      other.remove_ = nullptr;
+    }
+    return *this;
+  }
+
+  ListenerSubscription(const ListenerSubscription&) = delete;
+  ListenerSubscription& operator=(const ListenerSubscription&) = delete;
+
+  // Ends the subscription now. Does nothing if it has already ended.
+  void Remove() {
+    if (remove_) {
+      std::function<void()> remove = std::move(remove_);
+      remove_ = nullptr;
+      alive_.reset();
+      remove();
+    }
+  }
+
+  bool is_active() const {
+    return remove_ && !(tracked_ && alive_.expired());
+  }
+
+ private:
+  std::function<void()> remove_;
+  std::weak_ptr<void> alive_;
+  bool tracked_ = false;
+};
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_LISTENER_SUBSCRIPTION_H
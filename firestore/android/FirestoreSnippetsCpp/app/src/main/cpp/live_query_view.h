@@ -0,0 +1,228 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_LIVE_QUERY_VIEW_H
+#define FIRESTORESNIPPETSCPP_LIVE_QUERY_VIEW_H
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "field_value_order.h"
+#include "firebase/firestore.h"
+
+namespace snippets {
+
+// An in-memory copy of a query's results, kept up to date from the
+// `DocumentChange`s of each snapshot.
+//
+// Documents are decoded into `T` once, when they are added or modified, and
+// indexed both by ID and by the value of the query's order field. Applying a
+// snapshot costs O(changes * log(size)) rather than a walk over
+// `snapshot.documents()`, lookups by ID are O(1), and iteration follows the
+// query's order.
+//
+//   auto view = std::make_shared<LiveQueryView<City>>(
+//       FieldPath{"population"}, Query::Direction::kDescending, DecodeCity);
+//   query.AddSnapshotListener([view](const QuerySnapshot& snapshot, ...) {
+//     view->Apply(snapshot);
+//   });
+//
+// Documents are keyed by ID, so the query must not return two documents with
+// the same ID, as a collection group query can. The view is not thread-safe;
+// apply snapshots and read from the same thread, or guard it externally.
+template <typename T>
+class LiveQueryView {
+ public:
+  using Decoder =
+      std::function<T(const firebase::firestore::DocumentSnapshot&)>;
+
+  // Orders the view by document ID only.
+  explicit LiveQueryView(Decoder decode)
+      : decode_(std::move(decode)),
+        index_(IndexLess{firebase::firestore::Query::Direction::kAscending}) {}
+
+  // Orders the view by `order_field`, then by document ID, matching a query
+  // with `OrderBy(order_field, direction)`.
+  LiveQueryView(firebase::firestore::FieldPath order_field,
+                firebase::firestore::Query::Direction direction,
+                Decoder decode)
+      : decode_(std::move(decode)),
+        has_order_field_(true),
+        order_field_(std::move(order_field)),
+        index_(IndexLess{direction}) {}
+
+  LiveQueryView(const LiveQueryView&) = delete;
+  LiveQueryView& operator=(const LiveQueryView&) = delete;
+
+  // Applies the changes since the previous snapshot and returns how many
+  // there were. The first snapshot of a listener reports every document as
+  // added, so the view needs no separate initial load.
+  size_t Apply(const firebase::firestore::QuerySnapshot& snapshot) {
+    using firebase::firestore::DocumentChange;
+
+    std::vector<DocumentChange> changes = snapshot.DocumentChanges();
+    for (const DocumentChange& change : changes) {
+      firebase::firestore::DocumentSnapshot document = change.document();
+      if (change.type() == DocumentChange::Type::kRemoved) {
+        Remove(document.id());
+      } else {
+        Upsert(document);
+      }
+    }
+    return changes.size();
+  }
+
+  // Replaces the view's contents with `snapshot.documents()`, ignoring its
+  // changes. Use it for a snapshot that doesn't follow the last one applied,
+  // such as the cached snapshot `ListenerHub` replays to a late subscriber.
+  size_t Reset(const firebase::firestore::QuerySnapshot& snapshot) {
+    Clear();
+    for (const firebase::firestore::DocumentSnapshot& document :
+         snapshot.documents()) {
+      Upsert(document);
+    }
+    return entries_.size();
+  }
+
+  void Clear() {
+    index_.clear();
+    entries_.clear();
+  }
+
+  // Returns the decoded document with ID `id`, or null. The pointer stays
+  // valid until that document is removed from the view.
+  const T* Find(const std::string& id) const {
+    auto found = entries_.find(id);
+    return found == entries_.end() ? nullptr : &found->second.value;
+  }
+
+  size_t size() const { return entries_.size(); }
+  bool empty() const { return entries_.empty(); }
+
+  // Calls `f(id, value)` for every document, in query order. Stops early if
+  // `f` returns false.
+  void ForEach(
+      const std::function<bool(const std::string&, const T&)>& f) const {
+    for (const auto& entry : index_) {
+      if (!f(entry.first.id, *entry.second)) return;
+    }
+  }
+
+  // Like `ForEach()`, but only visits documents whose order field lies
+  // between `first` and `last`, inclusive, where `first` comes before `last`
+  // in query order. Finds the start of the range in O(log(size)).
+  void ForEachInRange(
+      const firebase::firestore::FieldValue& first,
+      const firebase::firestore::FieldValue& last,
+      const std::function<bool(const std::string&, const T&)>& f) const {
+    const IndexLess& less = index_.key_comp();
+    for (auto it = index_.lower_bound(first); it != index_.end(); ++it) {
+      if (less.CompareValues(it->first.order_value, last) > 0) return;
+      if (!f(it->first.id, *it->second)) return;
+    }
+  }
+
+ private:
+  struct IndexKey {
+    firebase::firestore::FieldValue order_value;
+    std::string id;
+  };
+
+  struct IndexLess {
+    // Allows `lower_bound()` by order value alone.
+    using is_transparent = void;
+
+    firebase::firestore::Query::Direction direction;
+
+    int CompareValues(const firebase::firestore::FieldValue& lhs,
+                      const firebase::firestore::FieldValue& rhs) const {
+      int result = CompareFieldValues(lhs, rhs);
+      return direction == firebase::firestore::Query::Direction::kDescending
+                 ? -result
+                 : result;
+    }
+
+    // Ties on the order field are broken by document ID, in the same
+    // direction, as Firestore does.
+    bool operator()(const IndexKey& lhs, const IndexKey& rhs) const {
+      int result = CompareValues(lhs.order_value, rhs.order_value);
+      if (result != 0) return result < 0;
+      int id_result = lhs.id.compare(rhs.id);
+      return direction == firebase::firestore::Query::Direction::kDescending
+                 ? id_result > 0
+                 : id_result < 0;
+    }
+
+    bool operator()(const IndexKey& lhs,
+                    const firebase::firestore::FieldValue& rhs) const {
+      return CompareValues(lhs.order_value, rhs) < 0;
+    }
+    bool operator()(const firebase::firestore::FieldValue& lhs,
+                    const IndexKey& rhs) const {
+      return CompareValues(lhs, rhs.order_value) < 0;
+    }
+  };
+
+  struct Entry {
+    T value;
+    firebase::firestore::FieldValue order_value;
+  };
+
+  void Upsert(const firebase::firestore::DocumentSnapshot& document) {
+    firebase::firestore::FieldValue order_value;
+    if (has_order_field_) {
+      order_value = document.Get(order_field_);
+    }
+
+    const std::string& id = document.id();
+    auto found = entries_.find(id);
+    if (found != entries_.end()) {
+      index_.erase(IndexKey{found->second.order_value, id});
+      found->second.value = decode_(document);
+      found->second.order_value = order_value;
+    } else {
+      found = entries_
+                  .emplace(id, Entry{decode_(document), order_value})
+                  .first;
+    }
+    // Map nodes don't move on rehash, so the index can point into them.
+    index_.emplace(IndexKey{std::move(order_value), id},
+                   &found->second.value);
+  }
+
+  void Remove(const std::string& id) {
+    auto found = entries_.find(id);
+    if (found == entries_.end()) return;
+    index_.erase(IndexKey{found->second.order_value, id});
+    entries_.erase(found);
+  }
+
+  Decoder decode_;
+  bool has_order_field_ = false;
+  firebase::firestore::FieldPath order_field_{
+      firebase::firestore::FieldPath::DocumentId()};
+  std::unordered_map<std::string, Entry> entries_;
+  std::map<IndexKey, const T*, IndexLess> index_;
+};
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_LIVE_QUERY_VIEW_H
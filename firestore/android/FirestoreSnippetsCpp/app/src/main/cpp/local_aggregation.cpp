@@ -0,0 +1,296 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "local_aggregation.h"
+
+#include <limits>
+#include <memory>
+#include <utility>
+
+#include "partitioned_scan.h"
+#include "query_evaluator.h"
+
+namespace snippets {
+
+using firebase::firestore::DocumentSnapshot;
+using firebase::firestore::Error;
+using firebase::firestore::FieldPath;
+using firebase::firestore::FieldValue;
+using firebase::firestore::MapFieldValue;
+using firebase::firestore::Query;
+
+namespace {
+
+using Function = AggregationSpec::Function;
+
+// Stores `a + b` in `out`, unless that would overflow.
+bool AddWithoutOverflow(int64_t a, int64_t b, int64_t* out) {
+  if ((b > 0 && a > std::numeric_limits<int64_t>::max() - b) ||
+      (b < 0 && a < std::numeric_limits<int64_t>::min() - b)) {
+    return false;
+  }
+  *out = a + b;
+  return true;
+}
+
+}  // namespace
+
+AggregationSpec& AggregationSpec::Count() {
+  aggregates_.push_back({Function::kCount, ""});
+  return *this;
+}
+
+AggregationSpec& AggregationSpec::Sum(const std::string& field) {
+  aggregates_.push_back({Function::kSum, field});
+  return *this;
+}
+
+AggregationSpec& AggregationSpec::Average(const std::string& field) {
+  aggregates_.push_back({Function::kAverage, field});
+  return *this;
+}
+
+AggregationSpec& AggregationSpec::Min(const std::string& field) {
+  aggregates_.push_back({Function::kMin, field});
+  return *this;
+}
+
+AggregationSpec& AggregationSpec::Max(const std::string& field) {
+  aggregates_.push_back({Function::kMax, field});
+  return *this;
+}
+
+AggregationSpec& AggregationSpec::GroupBy(const std::string& field) {
+  group_by_ = field;
+  return *this;
+}
+
+AggregationAccumulator::AggregationAccumulator(AggregationSpec spec)
+    : spec_(std::move(spec)) {}
+
+template <typename GetField>
+void AggregationAccumulator::AddDocument(const GetField& get) {
+  FieldValue key = FieldValue::Null();
+  if (!spec_.group_by().empty()) {
+    key = get(spec_.group_by());
+    if (!key.is_valid()) key = FieldValue::Null();
+  }
+  Group& group = groups_[key];
+  group.resize(spec_.aggregates().size());
+
+  for (size_t i = 0; i < group.size(); ++i) {
+    const AggregationSpec::Aggregate& aggregate = spec_.aggregates()[i];
+    if (aggregate.function == Function::kCount) {
+      ++group[i].count;
+      continue;
+    }
+    FieldValue value = get(aggregate.field);
+    if (value.is_valid()) {
+      AddValue(aggregate, value, &group[i]);
+    }
+  }
+  ++document_count_;
+}
+
+void AggregationAccumulator::Add(const DocumentSnapshot& document) {
+  AddDocument(
+      [&document](const std::string& field) { return document.Get(field); });
+}
+
+void AggregationAccumulator::Add(const MapFieldValue& data) {
+  AddDocument([&data](const std::string& field) {
+    FieldValue value;
+    LookupField(data, field, &value);
+    return value;
+  });
+}
+
+void AggregationAccumulator::AddValue(
+    const AggregationSpec::Aggregate& aggregate, const FieldValue& value,
+    Partial* partial) const {
+  switch (aggregate.function) {
+    case Function::kCount:
+      break;
+    case Function::kSum:
+    case Function::kAverage:
+      if (value.is_integer()) {
+        int64_t integer = value.integer_value();
+        if (!AddWithoutOverflow(partial->integer_sum, integer,
+                                &partial->integer_sum)) {
+          partial->double_sum += static_cast<double>(partial->integer_sum);
+          partial->integer_sum = integer;
+          partial->integer_only = false;
+        }
+      } else if (value.is_double()) {
+        partial->double_sum += value.double_value();
+        partial->integer_only = false;
+      } else {
+        break;
+      }
+      ++partial->count;
+      break;
+    case Function::kMin:
+    case Function::kMax: {
+      if (!partial->has_extreme) {
+        partial->extreme = value;
+        partial->has_extreme = true;
+        break;
+      }
+      int cmp = CompareFieldValues(value, partial->extreme);
+      if (aggregate.function == Function::kMin ? cmp < 0 : cmp > 0) {
+        partial->extreme = value;
+      }
+      break;
+    }
+  }
+}
+
+void AggregationAccumulator::Merge(const AggregationAccumulator& other) {
+  for (const auto& entry : other.groups_) {
+    Group& group = groups_[entry.first];
+    group.resize(spec_.aggregates().size());
+    for (size_t i = 0; i < group.size() && i < entry.second.size(); ++i) {
+      MergePartial(spec_.aggregates()[i].function, entry.second[i],
+                   &group[i]);
+    }
+  }
+  document_count_ += other.document_count_;
+}
+
+void AggregationAccumulator::MergePartial(Function function,
+                                          const Partial& from,
+                                          Partial* into) const {
+  into->count += from.count;
+  if (!AddWithoutOverflow(into->integer_sum, from.integer_sum,
+                          &into->integer_sum)) {
+    into->double_sum += static_cast<double>(into->integer_sum);
+    into->integer_sum = from.integer_sum;
+    into->integer_only = false;
+  }
+  into->double_sum += from.double_sum;
+  into->integer_only = into->integer_only && from.integer_only;
+
+  if (from.has_extreme) {
+    int cmp = into->has_extreme
+                  ? CompareFieldValues(from.extreme, into->extreme)
+                  : 0;
+    if (!into->has_extreme ||
+        (function == Function::kMin ? cmp < 0 : cmp > 0)) {
+      into->extreme = from.extreme;
+      into->has_extreme = true;
+    }
+  }
+}
+
+std::vector<AggregationGroup> AggregationAccumulator::Result() const {
+  std::vector<AggregationGroup> result;
+  auto add_group = [this, &result](const FieldValue& key, const Group& group) {
+    AggregationGroup out;
+    out.key = key;
+    for (size_t i = 0; i < spec_.aggregates().size(); ++i) {
+      Partial empty;
+      const Partial& partial = i < group.size() ? group[i] : empty;
+      double sum = static_cast<double>(partial.integer_sum) +
+                   partial.double_sum;
+      switch (spec_.aggregates()[i].function) {
+        case Function::kCount:
+          out.values.push_back(FieldValue::Integer(partial.count));
+          break;
+        case Function::kSum:
+          out.values.push_back(partial.integer_only
+                                   ? FieldValue::Integer(partial.integer_sum)
+                                   : FieldValue::Double(sum));
+          break;
+        case Function::kAverage:
+          out.values.push_back(
+              partial.count > 0
+                  ? FieldValue::Double(sum / static_cast<double>(partial.count))
+                  : FieldValue::Null());
+          break;
+        case Function::kMin:
+        case Function::kMax:
+          out.values.push_back(partial.has_extreme ? partial.extreme
+                                                   : FieldValue::Null());
+          break;
+      }
+    }
+    result.push_back(std::move(out));
+  };
+
+  if (groups_.empty() && spec_.group_by().empty()) {
+    add_group(FieldValue::Null(), Group());
+  }
+  for (const auto& entry : groups_) {
+    add_group(entry.first, entry.second);
+  }
+  return result;
+}
+
+void Aggregate(Query query, AggregationSpec spec, PagedScanOptions options,
+               AggregationCallback callback) {
+  // Pages are delivered one at a time, so the accumulator needs no lock.
+  auto accumulator = std::make_shared<AggregationAccumulator>(std::move(spec));
+  ScanPages(
+      std::move(query), options,
+      [accumulator](const std::vector<DocumentSnapshot>& page) {
+        for (const DocumentSnapshot& document : page) {
+          accumulator->Add(document);
+        }
+        return true;
+      },
+      [accumulator, callback](Error error, const std::string& error_message) {
+        if (error != Error::kErrorOk) {
+          callback({}, error, error_message);
+          return;
+        }
+        callback(accumulator->Result(), Error::kErrorOk, "");
+      });
+}
+
+void AggregatePartitioned(const Query& query, const FieldPath& order_field,
+                          const std::vector<FieldValue>& split_points,
+                          AggregationSpec spec, PagedScanOptions options,
+                          AggregationCallback callback) {
+  // One accumulator per range: pages of a range are delivered one at a time,
+  // so ranges never share state until the final merge.
+  auto partials =
+      std::make_shared<std::vector<std::unique_ptr<AggregationAccumulator>>>();
+  for (size_t i = 0; i <= split_points.size(); ++i) {
+    partials->emplace_back(new AggregationAccumulator(spec));
+  }
+  ScanPartitioned(
+      query, order_field, split_points, options,
+      [partials](size_t range, const std::vector<DocumentSnapshot>& page) {
+        AggregationAccumulator& accumulator = *(*partials)[range];
+        for (const DocumentSnapshot& document : page) {
+          accumulator.Add(document);
+        }
+        return true;
+      },
+      [partials, callback](Error error, const std::string& error_message) {
+        if (error != Error::kErrorOk) {
+          callback({}, error, error_message);
+          return;
+        }
+        AggregationAccumulator& total = *partials->front();
+        for (size_t i = 1; i < partials->size(); ++i) {
+          total.Merge(*(*partials)[i]);
+        }
+        callback(total.Result(), Error::kErrorOk, "");
+      });
+}
+
+}  // namespace snippets
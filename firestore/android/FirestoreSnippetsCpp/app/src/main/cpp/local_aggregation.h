@@ -0,0 +1,167 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_LOCAL_AGGREGATION_H
+#define FIRESTORESNIPPETSCPP_LOCAL_AGGREGATION_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "field_value_order.h"
+#include "firebase/firestore.h"
+#include "paged_scan.h"
+
+namespace snippets {
+
+// Describes the aggregates to compute over a query's results, optionally per
+// distinct value of a field.
+//
+//   AggregationSpec spec = AggregationSpec()
+//                              .GroupBy("country")
+//                              .Count()
+//                              .Sum("population");
+class AggregationSpec {
+ public:
+  enum class Function { kCount, kSum, kAverage, kMin, kMax };
+
+  struct Aggregate {
+    Function function;
+    // Empty for `kCount`.
+    std::string field;
+  };
+
+  // Counts documents.
+  AggregationSpec& Count();
+  // Sum and average only consider integer and double values of `field`, as
+  // Firestore's own aggregation queries do.
+  AggregationSpec& Sum(const std::string& field);
+  AggregationSpec& Average(const std::string& field);
+  // The smallest and largest values of `field`, of any type, in Firestore
+  // order.
+  AggregationSpec& Min(const std::string& field);
+  AggregationSpec& Max(const std::string& field);
+
+  // Computes the aggregates per distinct value of `field`. Documents without
+  // the field are grouped with those where it is null, and integer and double
+  // keys of equal value (1 and 1.0) share a group, as they match the same
+  // equality filter.
+  AggregationSpec& GroupBy(const std::string& field);
+
+  const std::vector<Aggregate>& aggregates() const { return aggregates_; }
+  const std::string& group_by() const { return group_by_; }
+
+ private:
+  std::vector<Aggregate> aggregates_;
+  std::string group_by_;
+};
+
+struct AggregationGroup {
+  // The group's value of the `GroupBy()` field; null without grouping.
+  firebase::firestore::FieldValue key;
+  // One value per aggregate, in the order they were added to the spec:
+  // counts are integers; sums are integers unless a double was added or the
+  // sum overflowed; averages are doubles; and averages, minimums and
+  // maximums are null if no document had a suitable value.
+  std::vector<firebase::firestore::FieldValue> values;
+};
+
+// Accumulates an `AggregationSpec` over documents added one at a time.
+//
+// Memory depends on the number of groups, not of documents: each group keeps
+// a running count, sum and extreme per aggregate. Accumulators over disjoint
+// sets of documents can be merged, so partial aggregates can be computed in
+// parallel.
+//
+// Not thread-safe.
+class AggregationAccumulator {
+ public:
+  explicit AggregationAccumulator(AggregationSpec spec);
+
+  void Add(const firebase::firestore::DocumentSnapshot& document);
+  // As above, for a document's data. Fields are looked up with
+  // `LookupField()`.
+  void Add(const firebase::firestore::MapFieldValue& data);
+
+  // Adds the state of `other`, which must have been built from the same
+  // spec.
+  void Merge(const AggregationAccumulator& other);
+
+  // One entry per group, in Firestore order of the keys. Without
+  // `GroupBy()`, a single group, even if no documents were added.
+  std::vector<AggregationGroup> Result() const;
+
+  int64_t document_count() const { return document_count_; }
+
+ private:
+  // Running state of one aggregate in one group.
+  struct Partial {
+    // Documents for `kCount`; numeric values for `kSum` and `kAverage`.
+    int64_t count = 0;
+    // The sum is `integer_sum + double_sum`. `integer_sum` holds integers
+    // until it would overflow, when it is moved into `double_sum`.
+    int64_t integer_sum = 0;
+    double double_sum = 0;
+    bool integer_only = true;
+    // For `kMin` and `kMax`; null until a value is seen.
+    firebase::firestore::FieldValue extreme;
+    bool has_extreme = false;
+  };
+
+  using Group = std::vector<Partial>;
+
+  // Adds one document; `get(field)` returns its value of `field`, or an
+  // invalid `FieldValue` if it has none.
+  template <typename GetField>
+  void AddDocument(const GetField& get);
+
+  void AddValue(const AggregationSpec::Aggregate& aggregate,
+                const firebase::firestore::FieldValue& value,
+                Partial* partial) const;
+  void MergePartial(AggregationSpec::Function function, const Partial& from,
+                    Partial* into) const;
+
+  AggregationSpec spec_;
+  std::map<firebase::firestore::FieldValue, Group, FieldValueLess> groups_;
+  int64_t document_count_ = 0;
+};
+
+using AggregationCallback =
+    std::function<void(const std::vector<AggregationGroup>& groups,
+                       firebase::firestore::Error error,
+                       const std::string& error_message)>;
+
+// Computes `spec` over the results of `query`, reading them page by page with
+// `ScanPages()`, so no more than two pages of documents are held at once.
+// `callback` is called once with the result, or with the first error.
+void Aggregate(firebase::firestore::Query query, AggregationSpec spec,
+               PagedScanOptions options, AggregationCallback callback);
+
+// As above, but scans ranges of `order_field` in parallel with
+// `ScanPartitioned()`. Each range accumulates its own partial result, and the
+// partials are merged once every range has finished.
+void AggregatePartitioned(
+    const firebase::firestore::Query& query,
+    const firebase::firestore::FieldPath& order_field,
+    const std::vector<firebase::firestore::FieldValue>& split_points,
+    AggregationSpec spec, PagedScanOptions options,
+    AggregationCallback callback);
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_LOCAL_AGGREGATION_H
@@ -0,0 +1,140 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "local_aggregation.h"
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "firebase/firestore.h"
+#include "gtest/gtest.h"
+
+namespace snippets {
+namespace {
+
+using firebase::firestore::FieldValue;
+using firebase::firestore::MapFieldValue;
+using Values = std::vector<FieldValue>;
+
+constexpr int64_t kMax = std::numeric_limits<int64_t>::max();
+
+MapFieldValue Document(const FieldValue& a) { return {{"a", a}}; }
+
+TEST(LocalAggregationTest, SumsStayIntegersUntilTheyOverflow) {
+  AggregationAccumulator small(AggregationSpec().Sum("a").Average("a"));
+  small.Add(Document(FieldValue::Integer(kMax - 1)));
+  small.Add(Document(FieldValue::Integer(1)));
+  small.Add(Document(FieldValue::String("ignored")));
+  small.Add(MapFieldValue{});
+  EXPECT_EQ(small.Result()[0].values,
+            (Values{FieldValue::Integer(kMax),
+                    FieldValue::Double(static_cast<double>(kMax) / 2)}));
+
+  AggregationAccumulator large(AggregationSpec().Sum("a").Count());
+  large.Add(Document(FieldValue::Integer(kMax)));
+  large.Add(Document(FieldValue::Integer(kMax)));
+  large.Add(Document(FieldValue::Integer(-kMax)));
+  large.Add(Document(FieldValue::Integer(1)));
+  // The second value overflows; the sum continues in a double.
+  std::vector<AggregationGroup> result = large.Result();
+  ASSERT_EQ(result.size(), 1u);
+  ASSERT_TRUE(result[0].values[0].is_double());
+  EXPECT_DOUBLE_EQ(result[0].values[0].double_value(),
+                   static_cast<double>(kMax) + 1);
+  EXPECT_EQ(result[0].values[1], FieldValue::Integer(4));
+}
+
+TEST(LocalAggregationTest, MergeMatchesASingleAccumulator) {
+  AggregationSpec spec =
+      AggregationSpec().GroupBy("k").Count().Sum("a").Min("a").Max("a");
+  std::vector<MapFieldValue> documents = {
+      {{"k", FieldValue::String("x")}, {"a", FieldValue::Integer(kMax)}},
+      {{"k", FieldValue::String("y")}, {"a", FieldValue::Integer(2)}},
+      {{"k", FieldValue::String("x")}, {"a", FieldValue::Integer(3)}},
+      {{"k", FieldValue::String("x")}, {"a", FieldValue::Integer(kMax)}},
+      {{"k", FieldValue::String("y")}, {"a", FieldValue::Double(0.5)}},
+      {{"a", FieldValue::Integer(7)}},
+  };
+  AggregationAccumulator all(spec);
+  AggregationAccumulator first(spec);
+  AggregationAccumulator second(spec);
+  for (size_t i = 0; i < documents.size(); ++i) {
+    all.Add(documents[i]);
+    (i < 3 ? first : second).Add(documents[i]);
+  }
+  first.Merge(second);
+  EXPECT_EQ(first.document_count(), 6);
+
+  std::vector<AggregationGroup> merged = first.Result();
+  std::vector<AggregationGroup> expected = all.Result();
+  ASSERT_EQ(merged.size(), 3u);
+  ASSERT_EQ(expected.size(), 3u);
+  // Groups come in Firestore order of their keys: null first.
+  EXPECT_TRUE(merged[0].key.is_null());
+  EXPECT_EQ(merged[0].values,
+            (Values{FieldValue::Integer(1), FieldValue::Integer(7),
+                    FieldValue::Integer(7), FieldValue::Integer(7)}));
+  EXPECT_EQ(merged[1].key, FieldValue::String("x"));
+  // The merge overflows the "x" sum, although neither partial did.
+  ASSERT_TRUE(merged[1].values[1].is_double());
+  EXPECT_DOUBLE_EQ(merged[1].values[1].double_value(),
+                   2 * static_cast<double>(kMax) + 3);
+  EXPECT_EQ(merged[2].values,
+            (Values{FieldValue::Integer(2), FieldValue::Double(2.5),
+                    FieldValue::Double(0.5), FieldValue::Integer(2)}));
+  for (size_t i = 0; i < merged.size(); ++i) {
+    EXPECT_EQ(merged[i].key, expected[i].key);
+    EXPECT_EQ(merged[i].values, expected[i].values);
+  }
+}
+
+TEST(LocalAggregationTest, MinAndMaxCompareAcrossTypes) {
+  AggregationAccumulator accumulator(AggregationSpec().Min("a").Max("a"));
+  accumulator.Add(Document(FieldValue::Integer(5)));
+  accumulator.Add(Document(FieldValue::String("a")));
+  accumulator.Add(Document(FieldValue::Double(2.5)));
+  accumulator.Add(Document(FieldValue::Boolean(true)));
+  accumulator.Add(MapFieldValue{});
+  // Booleans sort before numbers, and numbers before strings.
+  EXPECT_EQ(accumulator.Result()[0].values,
+            (Values{FieldValue::Boolean(true), FieldValue::String("a")}));
+
+  AggregationAccumulator empty(AggregationSpec().Min("a").Count());
+  EXPECT_EQ(empty.Result()[0].values,
+            (Values{FieldValue::Null(), FieldValue::Integer(0)}));
+}
+
+TEST(LocalAggregationTest, EqualIntegerAndDoubleKeysShareAGroup) {
+  AggregationAccumulator accumulator(AggregationSpec().GroupBy("k").Count());
+  accumulator.Add(MapFieldValue{{"k", FieldValue::Integer(1)}});
+  accumulator.Add(MapFieldValue{{"k", FieldValue::Double(1.0)}});
+  accumulator.Add(MapFieldValue{{"k", FieldValue::Double(1.5)}});
+  accumulator.Add(MapFieldValue{{"k", FieldValue::Null()}});
+  accumulator.Add(MapFieldValue{});
+
+  std::vector<AggregationGroup> result = accumulator.Result();
+  ASSERT_EQ(result.size(), 3u);
+  EXPECT_TRUE(result[0].key.is_null());
+  EXPECT_EQ(result[0].values, (Values{FieldValue::Integer(2)}));
+  // The group keeps the first key it saw.
+  EXPECT_EQ(result[1].key, FieldValue::Integer(1));
+  EXPECT_EQ(result[1].values, (Values{FieldValue::Integer(2)}));
+  EXPECT_EQ(result[2].key, FieldValue::Double(1.5));
+}
+
+}  // namespace
+}  // namespace snippets
@@ -0,0 +1,176 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "ordered_merge.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "field_value_order.h"
+
+namespace snippets {
+
+using firebase::firestore::DocumentSnapshot;
+using firebase::firestore::Error;
+using firebase::firestore::FieldValue;
+using firebase::firestore::Query;
+
+namespace {
+
+std::vector<std::string> SplitPath(const std::string& path) {
+  std::vector<std::string> segments;
+  size_t start = 0;
+  while (start <= path.size()) {
+    size_t slash = path.find('/', start);
+    if (slash == std::string::npos) slash = path.size();
+    segments.push_back(path.substr(start, slash - start));
+    start = slash + 1;
+  }
+  return segments;
+}
+
+int ComparePaths(const std::vector<std::string>& lhs,
+                 const std::vector<std::string>& rhs) {
+  size_t common = std::min(lhs.size(), rhs.size());
+  for (size_t i = 0; i < common; ++i) {
+    int cmp = lhs[i].compare(rhs[i]);
+    if (cmp != 0) return cmp < 0 ? -1 : 1;
+  }
+  if (lhs.size() == rhs.size()) return 0;
+  return lhs.size() < rhs.size() ? -1 : 1;
+}
+
+}  // namespace
+
+DocumentOrder::DocumentOrder(std::vector<QuerySpec::Order> orders)
+    : orders_(std::move(orders)) {}
+
+DocumentOrder::Key DocumentOrder::KeyOf(
+    const DocumentSnapshot& document) const {
+  Key key;
+  key.values.reserve(orders_.size());
+  for (const QuerySpec::Order& order : orders_) {
+    key.values.push_back(order.field == kDocumentIdField
+                             ? FieldValue::Null()
+                             : document.Get(order.field));
+  }
+  key.path = SplitPath(document.reference().path());
+  return key;
+}
+
+int DocumentOrder::Compare(const Key& lhs, const Key& rhs) const {
+  for (size_t i = 0; i < orders_.size(); ++i) {
+    int cmp = orders_[i].field == kDocumentIdField
+                  ? ComparePaths(lhs.path, rhs.path)
+                  : CompareFieldValues(lhs.values[i], rhs.values[i]);
+    if (cmp != 0) {
+      return orders_[i].direction == Query::Direction::kAscending ? cmp : -cmp;
+    }
+  }
+  int cmp = ComparePaths(lhs.path, rhs.path);
+  bool descending = !orders_.empty() &&
+                    orders_.back().direction == Query::Direction::kDescending;
+  return descending ? -cmp : cmp;
+}
+
+std::vector<DocumentSnapshot> MergeOrdered(
+    const std::vector<std::vector<DocumentSnapshot>>& lists,
+    const DocumentOrder& order, int32_t limit) {
+  return MergeOrderedBy(
+      lists, order,
+      [&order](const DocumentSnapshot& document) {
+        return order.KeyOf(document);
+      },
+      limit);
+}
+
+struct MergedScan::Source {
+  Source(Query query, PagedScanOptions options)
+      : scan(std::move(query), options) {}
+
+  PagedScan scan;
+  std::vector<DocumentSnapshot> page;
+  // The next document of `page` to hand out.
+  size_t position = 0;
+};
+
+MergedScan::MergedScan(const std::vector<Query>& queries, DocumentOrder order,
+                       PagedScanOptions options)
+    : order_(std::move(order)) {
+  for (const Query& query : queries) {
+    sources_.push_back(std::make_unique<Source>(query, options));
+  }
+}
+
+MergedScan::~MergedScan() = default;
+
+bool MergedScan::After(const Head& lhs, const Head& rhs) const {
+  int cmp = order_.Compare(lhs.key, rhs.key);
+  return cmp != 0 ? cmp > 0 : lhs.source > rhs.source;
+}
+
+bool MergedScan::Refill(size_t index) {
+  Source& source = *sources_[index];
+  while (source.position == source.page.size()) {
+    source.position = 0;
+    if (!source.scan.Next(&source.page)) {
+      // Exhausted, or failed; either way drop the last page.
+      source.page = std::vector<DocumentSnapshot>();
+      if (source.scan.error() != Error::kErrorOk) {
+        error_ = source.scan.error();
+        error_message_ = source.scan.error_message();
+        return false;
+      }
+      return true;
+    }
+  }
+  heap_.push_back({order_.KeyOf(source.page[source.position]), index});
+  std::push_heap(heap_.begin(), heap_.end(),
+                 [this](const Head& lhs, const Head& rhs) {
+                   return After(lhs, rhs);
+                 });
+  return true;
+}
+
+bool MergedScan::Next(DocumentSnapshot* document) {
+  if (error_ != Error::kErrorOk) {
+    return false;
+  }
+  if (!started_) {
+    started_ = true;
+    // The scans are already fetching in parallel; this only waits for them.
+    for (size_t i = 0; i < sources_.size(); ++i) {
+      if (!Refill(i)) return false;
+    }
+  }
+  if (heap_.empty()) {
+    return false;
+  }
+
+  std::pop_heap(heap_.begin(), heap_.end(),
+                [this](const Head& lhs, const Head& rhs) {
+                  return After(lhs, rhs);
+                });
+  size_t index = heap_.back().source;
+  heap_.pop_back();
+  Source& source = *sources_[index];
+  *document = source.page[source.position++];
+  // An error here surfaces on the next call, after this document.
+  Refill(index);
+  return true;
+}
+
+}  // namespace snippets
@@ -0,0 +1,177 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_ORDERED_MERGE_H
+#define FIRESTORESNIPPETSCPP_ORDERED_MERGE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "firebase/firestore.h"
+#include "paged_scan.h"
+#include "query_spec.h"
+
+namespace snippets {
+
+// Orders documents the way the backend orders query results: by each order
+// field in turn, with values compared as in `CompareFieldValues()`, and then
+// by document path, segment by segment, in the direction of the last order.
+class DocumentOrder {
+ public:
+  // What a document is sorted by, extracted once so that comparisons don't
+  // look up fields again.
+  struct Key {
+    std::vector<firebase::firestore::FieldValue> values;
+    std::vector<std::string> path;
+  };
+
+  // `orders` is usually `QuerySpec::EffectiveOrders()`. Orders on
+  // `kDocumentIdField` compare paths.
+  explicit DocumentOrder(std::vector<QuerySpec::Order> orders);
+
+  Key KeyOf(const firebase::firestore::DocumentSnapshot& document) const;
+
+  // Returns a negative number, zero or a positive number when `lhs` sorts
+  // before, together with or after `rhs`.
+  int Compare(const Key& lhs, const Key& rhs) const;
+
+  const std::vector<QuerySpec::Order>& orders() const { return orders_; }
+
+ private:
+  std::vector<QuerySpec::Order> orders_;
+};
+
+// Merges lists of documents that are each sorted by `order` into one sorted
+// list, keeping the first `limit` documents (all of them if `limit` is 0).
+//
+// A heap holds the head of each list, so merging n documents from k lists
+// takes O(n log k) comparisons instead of sorting all n again.
+std::vector<firebase::firestore::DocumentSnapshot> MergeOrdered(
+    const std::vector<std::vector<firebase::firestore::DocumentSnapshot>>&
+        lists,
+    const DocumentOrder& order, int32_t limit = 0);
+
+// As above, for lists of any type: `key_of(element)` returns the
+// `DocumentOrder::Key` of an element.
+template <typename T, typename KeyOf>
+std::vector<T> MergeOrderedBy(const std::vector<std::vector<T>>& lists,
+                              const DocumentOrder& order, const KeyOf& key_of,
+                              int32_t limit = 0) {
+  struct Head {
+    DocumentOrder::Key key;
+    size_t list;
+    size_t position;
+  };
+  // std::push_heap keeps the largest element on top, so the comparison is
+  // reversed to pop the smallest. Equal keys pop in list order.
+  auto after = [&order](const Head& lhs, const Head& rhs) {
+    int cmp = order.Compare(lhs.key, rhs.key);
+    return cmp != 0 ? cmp > 0 : lhs.list > rhs.list;
+  };
+
+  std::vector<Head> heap;
+  size_t total = 0;
+  for (size_t i = 0; i < lists.size(); ++i) {
+    total += lists[i].size();
+    if (!lists[i].empty()) {
+      heap.push_back({key_of(lists[i][0]), i, 0});
+    }
+  }
+  std::make_heap(heap.begin(), heap.end(), after);
+
+  size_t wanted = limit > 0 ? std::min(total, static_cast<size_t>(limit))
+                            : total;
+  std::vector<T> result;
+  result.reserve(wanted);
+  while (!heap.empty() && result.size() < wanted) {
+    std::pop_heap(heap.begin(), heap.end(), after);
+    Head& head = heap.back();
+    const std::vector<T>& list = lists[head.list];
+    result.push_back(list[head.position]);
+    if (++head.position < list.size()) {
+      head.key = key_of(list[head.position]);
+      std::push_heap(heap.begin(), heap.end(), after);
+    } else {
+      heap.pop_back();
+    }
+  }
+  return result;
+}
+
+// Streams the results of several queries that share an order as one ordered
+// sequence, e.g. the chunks of an `in` filter with too many values, or
+// partitions of a collection, each ordered by the same field.
+//
+// Each query is walked with its own `PagedScan`, and a heap holds the next
+// document of each, so at most two pages per query are buffered however
+// many results there are. The queries must return disjoint documents, be
+// ordered as `order` says, and have no limit; see `PagedScan`.
+//
+//   MergedScan scan(queries, DocumentOrder(spec.EffectiveOrders()));
+//   DocumentSnapshot document;
+//   while (scan.Next(&document)) {
+//     // ...
+//   }
+//   if (scan.error() != Error::kErrorOk) {
+//     // ...
+//   }
+//
+// `Next()` blocks, so it must not be called from a Firestore callback.
+class MergedScan {
+ public:
+  // Starts fetching the first page of every query immediately.
+  MergedScan(const std::vector<firebase::firestore::Query>& queries,
+             DocumentOrder order,
+             PagedScanOptions options = PagedScanOptions());
+  ~MergedScan();
+
+  MergedScan(const MergedScan&) = delete;
+  MergedScan& operator=(const MergedScan&) = delete;
+
+  // Waits for the next document in order and stores it in `document`.
+  // Returns false once every query is exhausted, or after a fetch fails.
+  bool Next(firebase::firestore::DocumentSnapshot* document);
+
+  firebase::firestore::Error error() const { return error_; }
+  const std::string& error_message() const { return error_message_; }
+
+ private:
+  struct Source;
+  struct Head {
+    DocumentOrder::Key key;
+    size_t source;
+  };
+
+  // Pushes the next document of `source` onto the heap, fetching its next
+  // page if needed. Returns false on error.
+  bool Refill(size_t source);
+  bool After(const Head& lhs, const Head& rhs) const;
+
+  DocumentOrder order_;
+  std::vector<std::unique_ptr<Source>> sources_;
+  std::vector<Head> heap_;
+  bool started_ = false;
+  firebase::firestore::Error error_ = firebase::firestore::Error::kErrorOk;
+  std::string error_message_;
+};
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_ORDERED_MERGE_H
@@ -0,0 +1,118 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "ordered_merge.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "firebase/firestore.h"
+#include "gtest/gtest.h"
+#include "query_spec.h"
+
+namespace snippets {
+namespace {
+
+using firebase::firestore::FieldValue;
+using firebase::firestore::Query;
+
+// A stand-in for a document: its value of "a" and its ID in collection "c".
+struct Item {
+  int64_t a;
+  std::string id;
+};
+
+DocumentOrder::Key KeyOf(const Item& item) {
+  return DocumentOrder::Key{{FieldValue::Integer(item.a)}, {"c", item.id}};
+}
+
+std::vector<std::string> MergeIds(const std::vector<std::vector<Item>>& lists,
+                                  Query::Direction direction,
+                                  int32_t limit = 0) {
+  DocumentOrder order({{"a", direction}});
+  std::vector<std::string> ids;
+  for (const Item& item : MergeOrderedBy(lists, order, KeyOf, limit)) {
+    ids.push_back(std::to_string(item.a) + item.id);
+  }
+  return ids;
+}
+
+TEST(OrderedMergeTest, MergesAscendingListsAndBreaksTiesByPath) {
+  std::vector<std::vector<Item>> lists = {
+      {{1, "b"}, {2, "a"}, {2, "d"}, {5, "a"}},
+      {{1, "a"}, {2, "c"}, {3, "a"}},
+      {},
+      {{0, "z"}, {2, "b"}, {5, "b"}, {6, "a"}},
+  };
+  EXPECT_EQ(MergeIds(lists, Query::Direction::kAscending),
+            (std::vector<std::string>{"0z", "1a", "1b", "2a", "2b", "2c", "2d",
+                                      "3a", "5a", "5b", "6a"}));
+  EXPECT_EQ(MergeIds(lists, Query::Direction::kAscending, 4),
+            (std::vector<std::string>{"0z", "1a", "1b", "2a"}));
+}
+
+TEST(OrderedMergeTest, MergesDescendingListsAndBreaksTiesByPathDescending) {
+  std::vector<std::vector<Item>> lists = {
+      {{5, "a"}, {2, "d"}, {2, "a"}, {1, "b"}},
+      {{3, "a"}, {2, "c"}, {1, "a"}},
+      {{6, "a"}, {5, "b"}, {2, "b"}, {0, "z"}},
+  };
+  EXPECT_EQ(MergeIds(lists, Query::Direction::kDescending),
+            (std::vector<std::string>{"6a", "5b", "5a", "3a", "2d", "2c", "2b",
+                                      "2a", "1b", "1a", "0z"}));
+}
+
+TEST(OrderedMergeTest, ComparesPathsSegmentBySegment) {
+  DocumentOrder order({});
+  DocumentOrder::Key short_path{{}, {"c", "a"}};
+  DocumentOrder::Key long_path{{}, {"c", "a", "sub", "x"}};
+  DocumentOrder::Key other{{}, {"c", "a-b"}};
+  // "a" < "a-b" segment-wise, though "a/" > "a-" as strings.
+  EXPECT_LT(order.Compare(short_path, long_path), 0);
+  EXPECT_LT(order.Compare(long_path, other), 0);
+  EXPECT_EQ(order.Compare(other, other), 0);
+
+  DocumentOrder by_id({{kDocumentIdField, Query::Direction::kDescending}});
+  EXPECT_GT(by_id.Compare(short_path, other), 0);
+}
+
+TEST(OrderedMergeTest, EqualKeysComeOutInListOrder) {
+  DocumentOrder order({{"a", Query::Direction::kAscending}});
+  // The same document read by two overlapping queries.
+  std::vector<std::vector<Item>> lists = {
+      {{1, "a"}, {2, "a"}},
+      {{1, "a"}, {1, "b"}},
+  };
+  std::vector<std::vector<std::pair<Item, size_t>>> tagged(lists.size());
+  for (size_t i = 0; i < lists.size(); ++i) {
+    for (const Item& item : lists[i]) tagged[i].push_back({item, i});
+  }
+  auto merged = MergeOrderedBy(
+      tagged, order,
+      [](const std::pair<Item, size_t>& entry) { return KeyOf(entry.first); });
+  ASSERT_EQ(merged.size(), 4u);
+  EXPECT_EQ(merged[0].first.id, "a");
+  EXPECT_EQ(merged[0].second, 0u);
+  EXPECT_EQ(merged[1].first.id, "a");
+  EXPECT_EQ(merged[1].second, 1u);
+  EXPECT_EQ(merged[2].first.id, "b");
+  EXPECT_EQ(merged[3].first.a, 2);
+}
+
+}  // namespace
+}  // namespace snippets
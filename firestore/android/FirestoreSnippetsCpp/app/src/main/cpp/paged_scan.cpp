@@ -0,0 +1,243 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "paged_scan.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+
+namespace snippets {
+
+using firebase::Future;
+using firebase::firestore::DocumentSnapshot;
+using firebase::firestore::Error;
+using firebase::firestore::Query;
+using firebase::firestore::QuerySnapshot;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct PageResult {
+  std::vector<DocumentSnapshot> documents;
+  Error error = Error::kErrorOk;
+  std::string error_message;
+  int32_t requested = 0;
+  Clock::duration latency{};
+};
+
+void FetchPage(const Query& query, const DocumentSnapshot* start_after,
+               int32_t page_size, const PagedScanOptions& options,
+               std::function<void(PageResult)> done) {
+  Query page = start_after ? query.StartAfter(*start_after).Limit(page_size)
+                           : query.Limit(page_size);
+  Clock::time_point started = Clock::now();
+  page.Get(options.source)
+      .OnCompletion(
+          [done, page_size, started](const Future<QuerySnapshot>& future) {
+            PageResult result;
+            result.requested = page_size;
+            result.latency = Clock::now() - started;
+            result.error = static_cast<Error>(future.error());
+            if (result.error == Error::kErrorOk) {
+              result.documents = future.result()->documents();
+            } else {
+              result.error_message = future.error_message();
+            }
+            done(std::move(result));
+          });
+}
+
+// Scales the page size towards the target latency, changing it by at most a
+// factor of two per page so a single slow fetch doesn't collapse it.
+int32_t AdaptPageSize(const PagedScanOptions& options, int32_t current,
+                      Clock::duration latency) {
+  double latency_ms =
+      std::chrono::duration<double, std::milli>(latency).count();
+  double target_ms = static_cast<double>(options.target_page_latency.count());
+  double scale = latency_ms > 0 ? target_ms / latency_ms : 2.0;
+  scale = std::max(0.5, std::min(2.0, scale));
+  int32_t next = static_cast<int32_t>(current * scale);
+  int32_t floor = std::max(1, options.min_page_size);
+  return std::max(floor, std::min(options.max_page_size, next));
+}
+
+// State for `ScanPages()`. Fetch callbacks and the consumer may run on
+// different threads, so delivery is serialized through `consumer_busy_`.
+class AsyncScan : public std::enable_shared_from_this<AsyncScan> {
+ public:
+  AsyncScan(Query query, PagedScanOptions options,
+            std::function<bool(const std::vector<DocumentSnapshot>&)> on_page,
+            std::function<void(Error, const std::string&)> on_done)
+      : query_(std::move(query)),
+        options_(std::move(options)),
+        on_page_(std::move(on_page)),
+        on_done_(std::move(on_done)),
+        page_size_(std::max(1, options_.initial_page_size)) {}
+
+  void Start() { StartFetch(nullptr); }
+
+ private:
+  void StartFetch(const DocumentSnapshot* start_after) {
+    std::shared_ptr<AsyncScan> self = shared_from_this();
+    FetchPage(query_, start_after, page_size_, options_,
+              [self](PageResult result) {
+                self->OnFetched(std::move(result));
+              });
+  }
+
+  void OnFetched(PageResult result) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (finished_) {
+      return;
+    }
+    ready_ = std::move(result);
+    has_ready_ = true;
+    if (consumer_busy_) {
+      // The consumer picks this page up once it returns.
+      return;
+    }
+    consumer_busy_ = true;
+
+    while (has_ready_) {
+      PageResult page = std::move(ready_);
+      has_ready_ = false;
+
+      if (page.error != Error::kErrorOk) {
+        Finish(&lock, page.error, page.error_message);
+        return;
+      }
+
+      bool last = static_cast<int32_t>(page.documents.size()) < page.requested;
+      if (!last) {
+        // Prefetch the next page before handing this one to the consumer.
+        page_size_ = AdaptPageSize(options_, page_size_, page.latency);
+        DocumentSnapshot last_visible = page.documents.back();
+        lock.unlock();
+        StartFetch(&last_visible);
+        lock.lock();
+      }
+
+      bool keep_going = true;
+      if (!page.documents.empty()) {
+        lock.unlock();
+        keep_going = on_page_(page.documents);
+        lock.lock();
+      }
+
+      if (last || !keep_going) {
+        Finish(&lock, Error::kErrorOk, "");
+        return;
+      }
+    }
+    consumer_busy_ = false;
+  }
+
+  void Finish(std::unique_lock<std::mutex>* lock, Error error,
+              const std::string& error_message) {
+    finished_ = true;
+    lock->unlock();
+    on_done_(error, error_message);
+  }
+
+  Query query_;
+  PagedScanOptions options_;
+  std::function<bool(const std::vector<DocumentSnapshot>&)> on_page_;
+  std::function<void(Error, const std::string&)> on_done_;
+
+  std::mutex mutex_;
+  int32_t page_size_ = 0;
+  bool consumer_busy_ = false;
+  bool finished_ = false;
+  bool has_ready_ = false;
+  PageResult ready_;
+};
+
+}  // namespace
+
+struct PagedScan::Fetch {
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool done = false;
+  PageResult result;
+};
+
+PagedScan::PagedScan(Query query, PagedScanOptions options)
+    : query_(std::move(query)),
+      options_(std::move(options)),
+      page_size_(std::max(1, options_.initial_page_size)) {
+  StartFetch();
+}
+
+bool PagedScan::Next(std::vector<DocumentSnapshot>* page) {
+  if (!in_flight_) {
+    return false;
+  }
+
+  PageResult result;
+  {
+    std::unique_lock<std::mutex> lock(in_flight_->mutex);
+    in_flight_->cv.wait(lock, [this] { return in_flight_->done; });
+    result = std::move(in_flight_->result);
+  }
+  in_flight_.reset();
+
+  if (result.error != Error::kErrorOk) {
+    error_ = result.error;
+    error_message_ = result.error_message;
+    return false;
+  }
+
+  // A short page is the last one.
+  if (static_cast<int32_t>(result.documents.size()) == result.requested) {
+    // Start fetching the following page before returning this one.
+    page_size_ = AdaptPageSize(options_, page_size_, result.latency);
+    last_visible_ = result.documents.back();
+    has_last_visible_ = true;
+    StartFetch();
+  }
+
+  if (result.documents.empty()) {
+    return false;
+  }
+  *page = std::move(result.documents);
+  return true;
+}
+
+void PagedScan::StartFetch() {
+  std::shared_ptr<Fetch> fetch = std::make_shared<Fetch>();
+  in_flight_ = fetch;
+  FetchPage(query_, has_last_visible_ ? &last_visible_ : nullptr, page_size_,
+            options_, [fetch](PageResult result) {
+              std::lock_guard<std::mutex> lock(fetch->mutex);
+              fetch->result = std::move(result);
+              fetch->done = true;
+              fetch->cv.notify_all();
+            });
+}
+
+void ScanPages(
+    Query query, PagedScanOptions options,
+    std::function<bool(const std::vector<DocumentSnapshot>&)> on_page,
+    std::function<void(Error, const std::string&)> on_done) {
+  std::make_shared<AsyncScan>(std::move(query), std::move(options),
+                              std::move(on_page), std::move(on_done))
+      ->Start();
+}
+
+}  // namespace snippets
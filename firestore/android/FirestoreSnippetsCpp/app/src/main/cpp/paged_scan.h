@@ -0,0 +1,115 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_PAGED_SCAN_H
+#define FIRESTORESNIPPETSCPP_PAGED_SCAN_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "firebase/firestore.h"
+
+namespace snippets {
+
+struct PagedScanOptions {
+  // Size of the first page. Later pages are resized so that each fetch takes
+  // about `target_page_latency`, within [min_page_size, max_page_size].
+  int32_t initial_page_size = 25;
+  int32_t min_page_size = 10;
+  int32_t max_page_size = 1000;
+  std::chrono::milliseconds target_page_latency{250};
+
+  firebase::firestore::Source source = firebase::firestore::Source::kDefault;
+};
+
+// Walks the results of a query page by page, using the `Limit()` plus
+// `StartAfter(last_visible)` pattern from the pagination guide.
+//
+// While the caller processes page N, page N+1 is already being fetched, so at
+// most two pages are held in memory at any time. The page size adapts to the
+// observed latency of each fetch.
+//
+// The query must not already have a limit. A start cursor on the query only
+// bounds the first page and an end cursor bounds the whole scan. Ordering is
+// taken from the query; without an `OrderBy()` the scan is in document ID
+// order.
+//
+//   PagedScan scan(db->Collection("cities").OrderBy("population"));
+//   std::vector<DocumentSnapshot> page;
+//   while (scan.Next(&page)) {
+//     // ...
+//   }
+//   if (scan.error() != Error::kErrorOk) {
+//     // ...
+//   }
+//
+// `Next()` blocks, so it must not be called from a Firestore callback; use
+// `ScanPages()` there instead.
+class PagedScan {
+ public:
+  // Starts fetching the first page immediately.
+  explicit PagedScan(firebase::firestore::Query query,
+                     PagedScanOptions options = PagedScanOptions());
+
+  PagedScan(const PagedScan&) = delete;
+  PagedScan& operator=(const PagedScan&) = delete;
+
+  // Waits for the next page and stores it in `page`. Returns false once the
+  // results are exhausted or a fetch fails.
+  bool Next(std::vector<firebase::firestore::DocumentSnapshot>* page);
+
+  firebase::firestore::Error error() const { return error_; }
+  const std::string& error_message() const { return error_message_; }
+
+  // The number of documents requested for the page currently being fetched.
+  int32_t page_size() const { return page_size_; }
+
+ private:
+  struct Fetch;
+
+  void StartFetch();
+
+  firebase::firestore::Query query_;
+  PagedScanOptions options_;
+  std::shared_ptr<Fetch> in_flight_;
+  firebase::firestore::DocumentSnapshot last_visible_;
+  bool has_last_visible_ = false;
+  int32_t page_size_ = 0;
+  firebase::firestore::Error error_ = firebase::firestore::Error::kErrorOk;
+  std::string error_message_;
+};
+
+// Non-blocking counterpart of `PagedScan`.
+//
+// `on_page` is called once per page, in order, and never concurrently with
+// itself; the next page is prefetched while it runs. Returning false from
+// `on_page` stops the scan. `on_done` is called exactly once, after the last
+// page, on error, or when the scan is stopped.
+void ScanPages(
+    firebase::firestore::Query query, PagedScanOptions options,
+    std::function<
+        bool(const std::vector<firebase::firestore::DocumentSnapshot>&)>
+        on_page,
+    std::function<void(firebase::firestore::Error, const std::string&)>
+        on_done);
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_PAGED_SCAN_H
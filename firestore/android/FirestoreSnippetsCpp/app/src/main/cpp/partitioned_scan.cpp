@@ -0,0 +1,131 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "partitioned_scan.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace snippets {
+
+using firebase::firestore::DocumentSnapshot;
+using firebase::firestore::Error;
+using firebase::firestore::FieldPath;
+using firebase::firestore::FieldValue;
+using firebase::firestore::Query;
+
+namespace {
+
+// The characters used in auto-generated document IDs, in the order Firestore
+// sorts them.
+constexpr char kAutoIdAlphabet[] =
+    "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+constexpr int kAutoIdAlphabetSize = sizeof(kAutoIdAlphabet) - 1;
+
+struct PartitionedScanState {
+  explicit PartitionedScanState(
+      size_t partitions,
+      std::function<void(Error, const std::string&)> on_done)
+      : remaining(partitions), on_done(std::move(on_done)) {}
+
+  std::atomic<bool> stopped{false};
+  std::mutex mutex;
+  size_t remaining = 0;
+  Error error = Error::kErrorOk;
+  std::string error_message;
+  std::function<void(Error, const std::string&)> on_done;
+};
+
+}  // namespace
+
+std::vector<FieldValue> AutoIdSplitPoints(int partitions) {
+  // Two-character prefixes give 3844 evenly spaced candidates, which is fine
+  // grained enough for any sensible number of partitions.
+  const int prefixes = kAutoIdAlphabetSize * kAutoIdAlphabetSize;
+  std::vector<FieldValue> result;
+  for (int i = 1; i < partitions; ++i) {
+    int prefix =
+        static_cast<int>(static_cast<int64_t>(prefixes) * i / partitions);
+    std::string id;
+    id.push_back(kAutoIdAlphabet[prefix / kAutoIdAlphabetSize]);
+    id.push_back(kAutoIdAlphabet[prefix % kAutoIdAlphabetSize]);
+    result.push_back(FieldValue::String(id));
+  }
+  return result;
+}
+
+std::vector<FieldValue> IntegerSplitPoints(int64_t min, int64_t max,
+                                           int partitions) {
+  std::vector<FieldValue> result;
+  double width = (static_cast<double>(max) - static_cast<double>(min)) /
+                 std::max(1, partitions);
+  for (int i = 1; i < partitions; ++i) {
+    result.push_back(
+        FieldValue::Integer(min + static_cast<int64_t>(width * i)));
+  }
+  return result;
+}
+
+void ScanPartitioned(
+    const Query& query, const FieldPath& order_field,
+    const std::vector<FieldValue>& split_points, PagedScanOptions options,
+    std::function<bool(size_t, const std::vector<DocumentSnapshot>&)> on_page,
+    std::function<void(Error, const std::string&)> on_done) {
+  size_t partitions = split_points.size() + 1;
+  auto state = std::make_shared<PartitionedScanState>(partitions,
+                                                      std::move(on_done));
+
+  Query ordered = query.OrderBy(order_field);
+  for (size_t i = 0; i < partitions; ++i) {
+    Query range = ordered;
+    if (i > 0) {
+      range = range.StartAt({split_points[i - 1]});
+    }
+    if (i < split_points.size()) {
+      range = range.EndBefore({split_points[i]});
+    }
+
+    ScanPages(
+        range, options,
+        [state, on_page, i](const std::vector<DocumentSnapshot>& page) {
+          if (state->stopped.load()) {
+            return false;
+          }
+          if (!on_page(i, page)) {
+            state->stopped.store(true);
+            return false;
+          }
+          return true;
+        },
+        [state](Error error, const std::string& error_message) {
+          std::unique_lock<std::mutex> lock(state->mutex);
+          if (error != Error::kErrorOk && state->error == Error::kErrorOk) {
+            state->error = error;
+            state->error_message = error_message;
+            state->stopped.store(true);
+          }
+          if (--state->remaining == 0) {
+            lock.unlock();
+            state->on_done(state->error, state->error_message);
+          }
+        });
+  }
+}
+
+}  // namespace snippets
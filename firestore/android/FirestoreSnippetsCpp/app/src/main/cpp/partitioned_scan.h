@@ -0,0 +1,70 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_PARTITIONED_SCAN_H
+#define FIRESTORESNIPPETSCPP_PARTITIONED_SCAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "firebase/firestore.h"
+#include "paged_scan.h"
+
+namespace snippets {
+
+// Returns `partitions - 1` document IDs that split the space of
+// auto-generated document IDs (see `CollectionReference::Document()`) into
+// `partitions` ranges of about equal size.
+std::vector<firebase::firestore::FieldValue> AutoIdSplitPoints(int partitions);
+
+// Returns `partitions - 1` integers that split [min, max] into `partitions`
+// ranges of equal width.
+std::vector<firebase::firestore::FieldValue> IntegerSplitPoints(
+    int64_t min, int64_t max, int partitions);
+
+// Scans `query` as several disjoint ranges of `order_field` in parallel.
+//
+// Each range is bounded with `StartAt()`/`EndBefore()` cursors on
+// `order_field` and walked with `ScanPages()`, so a collection is read over
+// `split_points.size() + 1` concurrent page streams instead of one serial
+// one. `split_points` must be sorted in ascending Firestore order. Use
+// `FieldPath::DocumentId()` as `order_field` to split by document ID.
+//
+// The query must not have its own `OrderBy()`, limit or cursors. As with any
+// `OrderBy()`, documents that do not contain `order_field` are skipped.
+//
+// `on_page` receives the index of the range the page belongs to. Pages of
+// one range arrive in order, but different ranges are delivered concurrently,
+// so `on_page` must be thread-safe. Returning false stops every range.
+// `on_done` is called once after all ranges finish, with the first error
+// encountered, if any.
+void ScanPartitioned(
+    const firebase::firestore::Query& query,
+    const firebase::firestore::FieldPath& order_field,
+    const std::vector<firebase::firestore::FieldValue>& split_points,
+    PagedScanOptions options,
+    std::function<bool(
+        size_t, const std::vector<firebase::firestore::DocumentSnapshot>&)>
+        on_page,
+    std::function<void(firebase::firestore::Error, const std::string&)>
+        on_done);
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_PARTITIONED_SCAN_H
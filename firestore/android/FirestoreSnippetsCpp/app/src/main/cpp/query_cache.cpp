@@ -0,0 +1,174 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "query_cache.h"
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace snippets {
+
+using firebase::Future;
+using firebase::firestore::Error;
+using firebase::firestore::QuerySnapshot;
+using firebase::firestore::Source;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+}  // namespace
+
+struct QueryCache::State {
+  struct Entry {
+    QuerySnapshot snapshot;
+    Clock::time_point fetched;
+    std::list<std::string>::iterator lru_position;
+  };
+
+  // A read of one key and the callers waiting for it.
+  struct Fetch {
+    std::vector<Callback> waiters;
+  };
+
+  void Store(const std::string& key, const QuerySnapshot& snapshot) {
+    auto existing = entries.find(key);
+    if (existing != entries.end()) {
+      lru.erase(existing->second.lru_position);
+      entries.erase(existing);
+    }
+
+    lru.push_front(key);
+    entries.emplace(key, Entry{snapshot, Clock::now(), lru.begin()});
+
+    while (entries.size() > options.max_entries && !lru.empty()) {
+      entries.erase(lru.back());
+      lru.pop_back();
+      ++stats.evictions;
+    }
+  }
+
+  QueryCacheOptions options;
+  mutable std::mutex mutex;
+  std::unordered_map<std::string, Entry> entries;
+  // Most recently used key first.
+  std::list<std::string> lru;
+  // `Invalidate()` and `Clear()` detach reads from here, so that later
+  // callers start a fresh read, and the detached reads don't store their
+  // possibly stale results.
+  std::unordered_map<std::string, std::shared_ptr<Fetch>> in_flight;
+  QueryCacheStats stats;
+};
+
+QueryCache::QueryCache(firebase::firestore::Firestore* db,
+                       QueryCacheOptions options)
+    : db_(db), state_(std::make_shared<State>()) {
+  state_->options = std::move(options);
+}
+
+void QueryCache::Get(const QuerySpec& spec, Callback callback) {
+  std::string key = spec.CanonicalKey();
+
+  std::unique_lock<std::mutex> lock(state_->mutex);
+  auto cached = state_->entries.find(key);
+  if (cached != state_->entries.end()) {
+    State::Entry& entry = cached->second;
+    if (Clock::now() - entry.fetched < state_->options.ttl) {
+      ++state_->stats.hits;
+      state_->lru.splice(state_->lru.begin(), state_->lru, entry.lru_position);
+      QuerySnapshot snapshot = entry.snapshot;
+      lock.unlock();
+      callback(snapshot, Error::kErrorOk, "");
+      return;
+    }
+    state_->lru.erase(entry.lru_position);
+    state_->entries.erase(cached);
+  }
+
+  auto pending = state_->in_flight.find(key);
+  if (pending != state_->in_flight.end()) {
+    ++state_->stats.coalesced;
+    pending->second->waiters.push_back(std::move(callback));
+    return;
+  }
+
+  ++state_->stats.misses;
+  auto fetch = std::make_shared<State::Fetch>();
+  fetch->waiters.push_back(std::move(callback));
+  state_->in_flight[key] = fetch;
+  Source source = state_->options.source;
+  lock.unlock();
+
+  std::shared_ptr<State> state = state_;
+  spec.ToQuery(db_).Get(source).OnCompletion(
+      [state, key, fetch](const Future<QuerySnapshot>& future) {
+        Error error = static_cast<Error>(future.error());
+        QuerySnapshot snapshot;
+        std::string error_message;
+        if (error == Error::kErrorOk) {
+          snapshot = *future.result();
+        } else {
+          error_message = future.error_message();
+        }
+
+        std::vector<Callback> waiters;
+        {
+          std::lock_guard<std::mutex> lock(state->mutex);
+          waiters = std::move(fetch->waiters);
+          auto attached = state->in_flight.find(key);
+          if (attached != state->in_flight.end() &&
+              attached->second == fetch) {
+            state->in_flight.erase(attached);
+            if (error == Error::kErrorOk) {
+              state->Store(key, snapshot);
+            }
+          }
+        }
+
+        for (const Callback& waiter : waiters) {
+          waiter(snapshot, error, error_message);
+        }
+      });
+}
+
+void QueryCache::Invalidate(const QuerySpec& spec) {
+  std::string key = spec.CanonicalKey();
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  state_->in_flight.erase(key);
+  auto cached = state_->entries.find(key);
+  if (cached != state_->entries.end()) {
+    state_->lru.erase(cached->second.lru_position);
+    state_->entries.erase(cached);
+  }
+}
+
+void QueryCache::Clear() {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  state_->in_flight.clear();
+  state_->entries.clear();
+  state_->lru.clear();
+}
+
+QueryCacheStats QueryCache::stats() const {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  return state_->stats;
+}
+
+}  // namespace snippets
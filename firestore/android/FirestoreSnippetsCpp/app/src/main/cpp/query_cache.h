@@ -0,0 +1,100 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_QUERY_CACHE_H
+#define FIRESTORESNIPPETSCPP_QUERY_CACHE_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "firebase/firestore.h"
+#include "query_spec.h"
+
+namespace snippets {
+
+struct QueryCacheOptions {
+  // How long a result is served from the cache before the query is re-run.
+  std::chrono::milliseconds ttl{30000};
+
+  // Maximum number of cached results. The least recently used result is
+  // evicted first.
+  size_t max_entries = 256;
+
+  firebase::firestore::Source source = firebase::firestore::Source::kDefault;
+};
+
+struct QueryCacheStats {
+  // Requests answered from a cached result.
+  int64_t hits = 0;
+  // Requests that ran the query.
+  int64_t misses = 0;
+  // Requests that joined an identical query already in flight.
+  int64_t coalesced = 0;
+  int64_t evictions = 0;
+
+  double hit_rate() const {
+    int64_t total = hits + misses + coalesced;
+    return total > 0 ? static_cast<double>(hits + coalesced) / total : 0;
+  }
+};
+
+// An application-level cache of query results, keyed by
+// `QuerySpec::CanonicalKey()`.
+//
+// Results are reused for `ttl` and the cache holds at most `max_entries` of
+// them. Concurrent requests for the same query share a single `Get()`.
+// Failed queries are not cached.
+//
+// This is separate from the SDK's persistence cache: a hit here does not read
+// any documents at all, but it also does not notice changes made since the
+// result was fetched. Call `Invalidate()` after writing to the queried
+// collection, or use a snapshot listener for data that must be live.
+class QueryCache {
+ public:
+  using Callback = std::function<void(const firebase::firestore::QuerySnapshot&,
+                                      firebase::firestore::Error,
+                                      const std::string&)>;
+
+  explicit QueryCache(firebase::firestore::Firestore* db,
+                      QueryCacheOptions options = QueryCacheOptions());
+
+  // Calls `callback` with the results of `spec`. On a hit the callback runs
+  // before `Get()` returns; otherwise it runs on a Firestore callback thread.
+  void Get(const QuerySpec& spec, Callback callback);
+
+  // Drops the cached result of `spec`. A `Get()` after this reads the query
+  // again instead of joining a read started before it, and that earlier
+  // read's result isn't cached.
+  void Invalidate(const QuerySpec& spec);
+  // Like `Invalidate()`, for every query.
+  void Clear();
+
+  QueryCacheStats stats() const;
+
+ private:
+  struct State;
+
+  firebase::firestore::Firestore* db_ = nullptr;
+  std::shared_ptr<State> state_;
+};
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_QUERY_CACHE_H
@@ -0,0 +1,399 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "query_evaluator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "field_value_order.h"
+
+namespace snippets {
+
+using firebase::firestore::FieldValue;
+using firebase::firestore::MapFieldValue;
+using firebase::firestore::Query;
+
+namespace {
+
+using Operator = QuerySpec::Operator;
+
+// The type order shared by integers and doubles.
+constexpr int8_t kNumberOrder = 2;
+constexpr int8_t kMissing = -1;
+
+// Doubles represent every integer up to 2^53 exactly.
+constexpr int64_t kMaxExactInteger = int64_t{1} << 53;
+
+bool IsNaN(const FieldValue& value) {
+  return value.is_double() && std::isnan(value.double_value());
+}
+
+bool IsNumber(const FieldValue& value) {
+  return value.is_integer() || value.is_double();
+}
+
+bool Equal(const FieldValue& lhs, const FieldValue& rhs) {
+  return CompareFieldValues(lhs, rhs) == 0;
+}
+
+bool Contains(const std::vector<FieldValue>& values, const FieldValue& value) {
+  for (const FieldValue& candidate : values) {
+    if (Equal(candidate, value)) return true;
+  }
+  return false;
+}
+
+// Whether a comparison result `cmp` satisfies a range or equality operator.
+bool Satisfies(Operator op, int cmp) {
+  switch (op) {
+    case Operator::kEqual:
+      return cmp == 0;
+    case Operator::kLessThan:
+      return cmp < 0;
+    case Operator::kLessThanOrEqual:
+      return cmp <= 0;
+    case Operator::kGreaterThan:
+      return cmp > 0;
+    case Operator::kGreaterThanOrEqual:
+      return cmp >= 0;
+    default:
+      return false;
+  }
+}
+
+bool IsRange(Operator op) {
+  return op == Operator::kLessThan || op == Operator::kLessThanOrEqual ||
+         op == Operator::kGreaterThan || op == Operator::kGreaterThanOrEqual;
+}
+
+}  // namespace
+
+bool LookupField(const MapFieldValue& data, const std::string& field_path,
+                 FieldValue* out) {
+  size_t dot = field_path.find('.');
+  auto found = data.find(field_path.substr(0, dot));
+  if (found == data.end()) {
+    return false;
+  }
+  if (dot == std::string::npos) {
+    *out = found->second;
+    return true;
+  }
+  if (!found->second.is_map()) {
+    return false;
+  }
+  return LookupField(found->second.map_value(), field_path.substr(dot + 1),
+                     out);
+}
+
+bool MatchesFilter(const QuerySpec::Filter& filter, const FieldValue* value) {
+  if (value == nullptr || filter.values.empty()) {
+    return false;
+  }
+  const FieldValue& operand = filter.values[0];
+  switch (filter.op) {
+    case Operator::kEqual:
+    case Operator::kLessThan:
+    case Operator::kLessThanOrEqual:
+    case Operator::kGreaterThan:
+    case Operator::kGreaterThanOrEqual:
+      // Only == and != can be used with null and NaN.
+      if (IsRange(filter.op) && (operand.is_null() || IsNaN(operand))) {
+        return false;
+      }
+      return FieldValueTypeOrder(*value) == FieldValueTypeOrder(operand) &&
+             Satisfies(filter.op, CompareFieldValues(*value, operand));
+    case Operator::kNotEqual:
+      return !Equal(*value, operand);
+    case Operator::kArrayContains:
+      return value->is_array() && Contains(value->array_value(), operand);
+    case Operator::kArrayContainsAny:
+      if (!value->is_array()) return false;
+      for (const FieldValue& element : value->array_value()) {
+        if (Contains(filter.values, element)) return true;
+      }
+      return false;
+    case Operator::kIn:
+      return Contains(filter.values, *value);
+    case Operator::kNotIn:
+      for (const FieldValue& excluded : filter.values) {
+        if (excluded.is_null()) return false;
+      }
+      return !Contains(filter.values, *value);
+  }
+  return false;
+}
+
+// One field of every document, split into typed arrays.
+struct QueryEvaluator::Column {
+  explicit Column(size_t size)
+      : values(size),
+        type_order(size, kMissing),
+        integers(size, 0),
+        numbers(size, 0),
+        is_integer(size, 0),
+        exact(size, 0) {}
+
+  void Set(size_t i, FieldValue value) {
+    type_order[i] = static_cast<int8_t>(FieldValueTypeOrder(value));
+    if (value.is_integer()) {
+      integers[i] = value.integer_value();
+      numbers[i] = static_cast<double>(integers[i]);
+      is_integer[i] = 1;
+      exact[i] = integers[i] >= -kMaxExactInteger &&
+                 integers[i] <= kMaxExactInteger;
+    } else if (value.is_double()) {
+      numbers[i] = value.double_value();
+      exact[i] = !std::isnan(numbers[i]);
+    }
+    values[i] = std::move(value);
+  }
+
+  bool present(size_t i) const { return type_order[i] != kMissing; }
+
+  std::vector<FieldValue> values;
+  std::vector<int8_t> type_order;
+  // For numbers only: the value as an integer and as a double, whether it is
+  // an integer, and whether `numbers` holds it exactly and it isn't NaN.
+  std::vector<int64_t> integers;
+  std::vector<double> numbers;
+  std::vector<uint8_t> is_integer;
+  std::vector<uint8_t> exact;
+};
+
+namespace {
+
+// Compares every number in `column` with `operand`, which must be a number
+// other than NaN, into `cmp`. Values that aren't numbers get garbage.
+template <typename Column>
+void CompareNumbers(const Column& column, const FieldValue& operand,
+                    std::vector<int8_t>* cmp) {
+  size_t size = column.values.size();
+  int8_t* out = cmp->data();
+  if (operand.is_integer()) {
+    int64_t x = operand.integer_value();
+    const int64_t* integers = column.integers.data();
+    for (size_t i = 0; i < size; ++i) {
+      out[i] = static_cast<int8_t>((integers[i] > x) - (integers[i] < x));
+    }
+    // Doubles, which are rare in integer columns, are compared exactly.
+    for (size_t i = 0; i < size; ++i) {
+      if (column.type_order[i] == kNumberOrder && !column.is_integer[i]) {
+        out[i] = static_cast<int8_t>(
+            CompareFieldValues(column.values[i], operand));
+      }
+    }
+  } else {
+    double x = operand.double_value();
+    const double* numbers = column.numbers.data();
+    for (size_t i = 0; i < size; ++i) {
+      out[i] = static_cast<int8_t>((numbers[i] > x) - (numbers[i] < x));
+    }
+    // NaN and integers beyond 2^53 don't compare correctly as doubles.
+    for (size_t i = 0; i < size; ++i) {
+      if (column.type_order[i] == kNumberOrder && !column.exact[i]) {
+        out[i] = static_cast<int8_t>(
+            CompareFieldValues(column.values[i], operand));
+      }
+    }
+  }
+}
+
+}  // namespace
+
+QueryEvaluator::QueryEvaluator(const std::vector<MapFieldValue>& documents,
+                               const std::vector<std::string>* ids)
+    : documents_(documents), ids_(ids) {}
+
+QueryEvaluator::~QueryEvaluator() = default;
+
+const QueryEvaluator::Column& QueryEvaluator::GetColumn(
+    const std::string& field) const {
+  std::unique_ptr<Column>& column = columns_[field];
+  if (column) {
+    return *column;
+  }
+
+  size_t size = documents_.size();
+  column.reset(new Column(size));
+  if (field == kDocumentIdField) {
+    for (size_t i = 0; i < size; ++i) {
+      column->Set(i, FieldValue::String(ids_ != nullptr ? (*ids_)[i] : ""));
+    }
+    return *column;
+  }
+  for (size_t i = 0; i < size; ++i) {
+    FieldValue value;
+    if (LookupField(documents_[i], field, &value)) {
+      column->Set(i, std::move(value));
+    }
+  }
+  return *column;
+}
+
+std::vector<size_t> QueryEvaluator::Filter(
+    const std::vector<QuerySpec::Filter>& filters) const {
+  size_t size = documents_.size();
+  std::vector<uint8_t> selected(size, 1);
+  std::vector<int8_t> cmp(size);
+
+  for (const QuerySpec::Filter& filter : filters) {
+    const Column& column = GetColumn(filter.field);
+    const FieldValue* operand =
+        filter.values.empty() ? nullptr : &filter.values[0];
+    bool numeric = operand != nullptr && IsNumber(*operand) &&
+                   !IsNaN(*operand) &&
+                   (filter.op == Operator::kEqual ||
+                    filter.op == Operator::kNotEqual || IsRange(filter.op));
+
+    if (!numeric) {
+      for (size_t i = 0; i < size; ++i) {
+        if (selected[i]) {
+          selected[i] = MatchesFilter(
+              filter, column.present(i) ? &column.values[i] : nullptr);
+        }
+      }
+      continue;
+    }
+
+    CompareNumbers(column, *operand, &cmp);
+    const int8_t* order = column.type_order.data();
+    const int8_t* c = cmp.data();
+    uint8_t* out = selected.data();
+    switch (filter.op) {
+      case Operator::kEqual:
+        for (size_t i = 0; i < size; ++i)
+          out[i] &= (order[i] == kNumberOrder) & (c[i] == 0);
+        break;
+      case Operator::kNotEqual:
+        for (size_t i = 0; i < size; ++i)
+          out[i] &= (order[i] != kMissing) &
+                    !((order[i] == kNumberOrder) & (c[i] == 0));
+        break;
+      case Operator::kLessThan:
+        for (size_t i = 0; i < size; ++i)
+          out[i] &= (order[i] == kNumberOrder) & (c[i] < 0);
+        break;
+      case Operator::kLessThanOrEqual:
+        for (size_t i = 0; i < size; ++i)
+          out[i] &= (order[i] == kNumberOrder) & (c[i] <= 0);
+        break;
+      case Operator::kGreaterThan:
+        for (size_t i = 0; i < size; ++i)
+          out[i] &= (order[i] == kNumberOrder) & (c[i] > 0);
+        break;
+      case Operator::kGreaterThanOrEqual:
+        for (size_t i = 0; i < size; ++i)
+          out[i] &= (order[i] == kNumberOrder) & (c[i] >= 0);
+        break;
+      default:
+        break;
+    }
+  }
+
+  std::vector<size_t> result;
+  for (size_t i = 0; i < size; ++i) {
+    if (selected[i]) result.push_back(i);
+  }
+  return result;
+}
+
+std::vector<size_t> QueryEvaluator::Run(const QuerySpec& spec) const {
+  std::vector<size_t> result = Filter(spec.filters());
+
+  // The backend breaks ties by document ID last.
+  std::vector<QuerySpec::Order> orders = spec.EffectiveOrders();
+  bool has_id_order = false;
+  for (const QuerySpec::Order& order : orders) {
+    has_id_order = has_id_order || order.field == kDocumentIdField;
+  }
+  if (!has_id_order) {
+    orders.push_back({kDocumentIdField, orders.empty()
+                                            ? Query::Direction::kAscending
+                                            : orders.back().direction});
+  }
+
+  std::vector<const Column*> columns;
+  for (const QuerySpec::Order& order : orders) {
+    const Column& column = GetColumn(order.field);
+    columns.push_back(&column);
+    result.erase(std::remove_if(result.begin(), result.end(),
+                                [&column](size_t i) {
+                                  return !column.present(i);
+                                }),
+                 result.end());
+  }
+
+  // Compares document `i` with the values of the first `count` orders in
+  // `position`, which are either another document's or a cursor's.
+  auto compare = [&orders, &columns](size_t i, size_t count,
+                                     const std::vector<FieldValue>& position,
+                                     size_t j) {
+    for (size_t k = 0; k < count; ++k) {
+      const FieldValue& other =
+          position.empty() ? columns[k]->values[j] : position[k];
+      int cmp = CompareFieldValues(columns[k]->values[i], other);
+      if (cmp != 0) {
+        return orders[k].direction == Query::Direction::kAscending ? cmp
+                                                                   : -cmp;
+      }
+    }
+    return 0;
+  };
+
+  // Without IDs, ties keep the documents' input order.
+  const std::vector<FieldValue> none;
+  std::stable_sort(result.begin(), result.end(),
+                   [&compare, &orders, &none](size_t lhs, size_t rhs) {
+                     return compare(lhs, orders.size(), none, rhs) < 0;
+                   });
+
+  auto outside = [&](QuerySpec::Bound bound,
+                     const std::vector<FieldValue>& values, size_t i) {
+    size_t count = std::min(values.size(), orders.size());
+    if (count == 0) return false;
+    int cmp = compare(i, count, values, 0);
+    switch (bound) {
+      case QuerySpec::Bound::kStartAt:
+        return cmp < 0;
+      case QuerySpec::Bound::kStartAfter:
+        return cmp <= 0;
+      case QuerySpec::Bound::kEndAt:
+        return cmp > 0;
+      case QuerySpec::Bound::kEndBefore:
+        return cmp >= 0;
+      default:
+        return false;
+    }
+  };
+  result.erase(std::remove_if(result.begin(), result.end(),
+                              [&](size_t i) {
+                                return outside(spec.start_bound(),
+                                               spec.start_values(), i) ||
+                                       outside(spec.end_bound(),
+                                               spec.end_values(), i);
+                              }),
+               result.end());
+
+  if (spec.limit() > 0 && result.size() > static_cast<size_t>(spec.limit())) {
+    result.resize(static_cast<size_t>(spec.limit()));
+  }
+  return result;
+}
+
+}  // namespace snippets
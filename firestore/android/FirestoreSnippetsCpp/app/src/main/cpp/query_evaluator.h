@@ -0,0 +1,94 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_QUERY_EVALUATOR_H
+#define FIRESTORESNIPPETSCPP_QUERY_EVALUATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "firebase/firestore.h"
+#include "query_spec.h"
+
+namespace snippets {
+
+// Finds the value at `field_path` in `data`, where the path is a field name
+// or names separated by dots ("address.city"). Returns false if there is no
+// such field. Backtick-quoted segments are not supported.
+bool LookupField(const firebase::firestore::MapFieldValue& data,
+                 const std::string& field_path,
+                 firebase::firestore::FieldValue* out);
+
+// Returns whether a document whose `field` has `value` matches `filter`.
+// `value` is null if the document doesn't have the field.
+//
+// This follows the backend: ==, <, <=, > and >= only match values of the
+// same type as the operand (numbers match numbers, whether integer or
+// double); != and not-in match any value of another type, but never a
+// missing field; in and array-contains-any compare with ==.
+bool MatchesFilter(const QuerySpec::Filter& filter,
+                   const firebase::firestore::FieldValue* value);
+
+// Evaluates queries over documents that are already in memory, e.g. the
+// results of an earlier `Get()` or a listener, without reading anything
+// from Firestore.
+//
+// Filters are evaluated a field at a time: the field is extracted from every
+// document into a column, and the filter runs over the whole column.
+// Numeric comparisons run over plain integer and double arrays, in loops
+// without branches that compilers vectorize. Columns are kept for
+// later filters and queries on the same field.
+//
+// Not thread-safe. `documents` and `ids` must outlive the evaluator.
+class QueryEvaluator {
+ public:
+  // `ids` holds the document IDs, for filters and orders on
+  // `kDocumentIdField`. It may be null, in which case documents are ordered
+  // by position where the query orders them by ID.
+  explicit QueryEvaluator(
+      const std::vector<firebase::firestore::MapFieldValue>& documents,
+      const std::vector<std::string>* ids = nullptr);
+  ~QueryEvaluator();
+
+  // Returns the indices of the documents that match all `filters`, in
+  // increasing order.
+  std::vector<size_t> Filter(
+      const std::vector<QuerySpec::Filter>& filters) const;
+
+  // Runs `spec` as the backend would: filters, then ordering (including the
+  // implicit order by the inequality field and by document ID), cursors and
+  // limit. Documents without one of the ordered fields are left out.
+  // Returns document indices in result order. The collection in `spec` is
+  // not checked.
+  std::vector<size_t> Run(const QuerySpec& spec) const;
+
+ private:
+  struct Column;
+
+  const Column& GetColumn(const std::string& field) const;
+
+  const std::vector<firebase::firestore::MapFieldValue>& documents_;
+  const std::vector<std::string>* ids_;
+  mutable std::unordered_map<std::string, std::unique_ptr<Column>> columns_;
+};
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_QUERY_EVALUATOR_H
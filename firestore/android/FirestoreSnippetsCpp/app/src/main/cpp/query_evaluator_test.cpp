@@ -0,0 +1,238 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "query_evaluator.h"
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "firebase/firestore.h"
+#include "gtest/gtest.h"
+#include "query_spec.h"
+
+namespace snippets {
+namespace {
+
+using firebase::firestore::FieldValue;
+using firebase::firestore::MapFieldValue;
+using firebase::firestore::Query;
+using Operator = QuerySpec::Operator;
+using Indices = std::vector<size_t>;
+
+QuerySpec::Filter MakeFilter(const std::string& field, Operator op,
+                             std::vector<FieldValue> values) {
+  return QuerySpec::Filter{field, op, std::move(values)};
+}
+
+Indices RunFilter(const std::vector<MapFieldValue>& documents,
+                  const QuerySpec::Filter& filter) {
+  return QueryEvaluator(documents).Filter({filter});
+}
+
+// Checks the column path of `Filter()` against `MatchesFilter()`.
+Indices MatchOneByOne(const std::vector<MapFieldValue>& documents,
+                      const QuerySpec::Filter& filter) {
+  Indices result;
+  for (size_t i = 0; i < documents.size(); ++i) {
+    FieldValue value;
+    bool present = LookupField(documents[i], filter.field, &value);
+    if (MatchesFilter(filter, present ? &value : nullptr)) {
+      result.push_back(i);
+    }
+  }
+  return result;
+}
+
+TEST(QueryEvaluatorTest, IntegersEqualDoublesOfTheSameValue) {
+  std::vector<MapFieldValue> documents = {
+      {{"a", FieldValue::Integer(1)}},
+      {{"a", FieldValue::Double(1.0)}},
+      {{"a", FieldValue::Integer(2)}},
+      {{"a", FieldValue::String("1")}},
+  };
+  for (const FieldValue& operand :
+       {FieldValue::Integer(1), FieldValue::Double(1.0)}) {
+    QuerySpec::Filter filter = MakeFilter("a", Operator::kEqual, {operand});
+    EXPECT_EQ(RunFilter(documents, filter), (Indices{0, 1}));
+    EXPECT_EQ(MatchOneByOne(documents, filter), (Indices{0, 1}));
+  }
+  EXPECT_EQ(RunFilter(documents, MakeFilter("a", Operator::kLessThan,
+                                            {FieldValue::Double(1.5)})),
+            (Indices{0, 1}));
+  EXPECT_EQ(RunFilter(documents, MakeFilter("a", Operator::kGreaterThan,
+                                            {FieldValue::Integer(1)})),
+            (Indices{2}));
+}
+
+TEST(QueryEvaluatorTest, NaNOnlyEqualsNaN) {
+  FieldValue nan = FieldValue::Double(std::nan(""));
+  std::vector<MapFieldValue> documents = {
+      {{"a", nan}},
+      {{"a", FieldValue::Double(1.0)}},
+      {{"a", FieldValue::Integer(-5)}},
+  };
+  EXPECT_EQ(RunFilter(documents, MakeFilter("a", Operator::kEqual, {nan})),
+            (Indices{0}));
+  EXPECT_EQ(RunFilter(documents, MakeFilter("a", Operator::kNotEqual, {nan})),
+            (Indices{1, 2}));
+  // NaN sorts before every other number, so ranges treat it that way. NaN
+  // itself can't be a range operand.
+  QuerySpec::Filter less =
+      MakeFilter("a", Operator::kLessThan, {FieldValue::Integer(10)});
+  EXPECT_EQ(RunFilter(documents, less), (Indices{0, 1, 2}));
+  EXPECT_EQ(MatchOneByOne(documents, less), (Indices{0, 1, 2}));
+  EXPECT_EQ(RunFilter(documents, MakeFilter("a", Operator::kGreaterThanOrEqual,
+                                            {FieldValue::Double(-100)})),
+            (Indices{1, 2}));
+  EXPECT_EQ(RunFilter(documents, MakeFilter("a", Operator::kLessThan, {nan})),
+            (Indices{}));
+}
+
+TEST(QueryEvaluatorTest, IntegersBeyondDoublePrecision) {
+  const int64_t big = (int64_t{1} << 53) + 1;
+  std::vector<MapFieldValue> documents = {
+      {{"a", FieldValue::Integer(big)}},
+      {{"a", FieldValue::Integer(big - 1)}},
+      {{"a", FieldValue::Double(static_cast<double>(big - 1))}},
+  };
+  // 2^53 + 1 rounds to 2^53 as a double, but is still larger.
+  QuerySpec::Filter greater = MakeFilter(
+      "a", Operator::kGreaterThan,
+      {FieldValue::Double(static_cast<double>(big - 1))});
+  EXPECT_EQ(RunFilter(documents, greater), (Indices{0}));
+  EXPECT_EQ(MatchOneByOne(documents, greater), (Indices{0}));
+
+  QuerySpec::Filter equal =
+      MakeFilter("a", Operator::kEqual, {FieldValue::Integer(big)});
+  EXPECT_EQ(RunFilter(documents, equal), (Indices{0}));
+  EXPECT_EQ(MatchOneByOne(documents, equal), (Indices{0}));
+
+  QuerySpec::Filter less =
+      MakeFilter("a", Operator::kLessThan, {FieldValue::Integer(big)});
+  EXPECT_EQ(RunFilter(documents, less), (Indices{1, 2}));
+  EXPECT_EQ(MatchOneByOne(documents, less), (Indices{1, 2}));
+}
+
+TEST(QueryEvaluatorTest, NotEqualAndNotInSkipMissingFields) {
+  std::vector<MapFieldValue> documents = {
+      {{"a", FieldValue::Integer(1)}},
+      {{"a", FieldValue::Integer(2)}},
+      {{"a", FieldValue::Null()}},
+      {{"b", FieldValue::Integer(1)}},
+      {{"a", FieldValue::String("x")}},
+  };
+  QuerySpec::Filter not_equal =
+      MakeFilter("a", Operator::kNotEqual, {FieldValue::Integer(1)});
+  EXPECT_EQ(RunFilter(documents, not_equal), (Indices{1, 2, 4}));
+  EXPECT_EQ(MatchOneByOne(documents, not_equal), (Indices{1, 2, 4}));
+
+  QuerySpec::Filter not_null =
+      MakeFilter("a", Operator::kNotEqual, {FieldValue::Null()});
+  EXPECT_EQ(RunFilter(documents, not_null), (Indices{0, 1, 4}));
+
+  QuerySpec::Filter not_in =
+      MakeFilter("a", Operator::kNotIn,
+                 {FieldValue::Integer(1), FieldValue::String("x")});
+  EXPECT_EQ(RunFilter(documents, not_in), (Indices{1, 2}));
+
+  // `not-in` with null in the list matches nothing.
+  QuerySpec::Filter not_in_null = MakeFilter(
+      "a", Operator::kNotIn, {FieldValue::Integer(1), FieldValue::Null()});
+  EXPECT_EQ(RunFilter(documents, not_in_null), (Indices{}));
+}
+
+TEST(QueryEvaluatorTest, InComparesWholeValuesArrayContainsAnyElements) {
+  std::vector<MapFieldValue> documents = {
+      {{"a", FieldValue::Array(
+                 {FieldValue::Integer(1), FieldValue::Integer(2)})}},
+      {{"a", FieldValue::Integer(1)}},
+      {{"a", FieldValue::Array({FieldValue::Integer(3)})}},
+  };
+  EXPECT_EQ(RunFilter(documents,
+                      MakeFilter("a", Operator::kIn, {FieldValue::Integer(1)})),
+            (Indices{1}));
+  FieldValue pair =
+      FieldValue::Array({FieldValue::Integer(1), FieldValue::Integer(2)});
+  EXPECT_EQ(RunFilter(documents, MakeFilter("a", Operator::kIn, {pair})),
+            (Indices{0}));
+  EXPECT_EQ(RunFilter(documents, MakeFilter("a", Operator::kArrayContainsAny,
+                                            {FieldValue::Integer(1),
+                                             FieldValue::Double(3.0)})),
+            (Indices{0, 2}));
+  EXPECT_EQ(RunFilter(documents, MakeFilter("a", Operator::kArrayContains,
+                                            {FieldValue::Integer(2)})),
+            (Indices{0}));
+}
+
+TEST(QueryEvaluatorTest, OrdersByDocumentIdLast) {
+  std::vector<MapFieldValue> documents = {
+      {{"a", FieldValue::Integer(1)}},
+      {{"a", FieldValue::Integer(2)}},
+      {{"a", FieldValue::Integer(1)}},
+      {{"b", FieldValue::Integer(1)}},
+  };
+  std::vector<std::string> ids = {"c", "a", "b", "d"};
+  QueryEvaluator evaluator(documents, &ids);
+
+  EXPECT_EQ(evaluator.Run(QuerySpec::Collection("c")), (Indices{1, 2, 0, 3}));
+
+  // Ties on "a" are broken by ID, in the direction of the last order, and
+  // documents without "a" are left out.
+  EXPECT_EQ(evaluator.Run(QuerySpec::Collection("c").OrderBy("a")),
+            (Indices{2, 0, 1}));
+  EXPECT_EQ(evaluator.Run(QuerySpec::Collection("c").OrderBy(
+                "a", Query::Direction::kDescending)),
+            (Indices{1, 0, 2}));
+
+  // An inequality filter without an order orders by its field.
+  EXPECT_EQ(evaluator.Run(QuerySpec::Collection("c").Where(
+                "a", Operator::kGreaterThanOrEqual, FieldValue::Integer(1))),
+            (Indices{2, 0, 1}));
+}
+
+TEST(QueryEvaluatorTest, CursorsWithFewerValuesThanOrders) {
+  std::vector<MapFieldValue> documents;
+  std::vector<std::string> ids;
+  for (int64_t a = 1; a <= 3; ++a) {
+    for (int64_t b = 1; b <= 2; ++b) {
+      documents.push_back(
+          {{"a", FieldValue::Integer(a)}, {"b", FieldValue::Integer(b)}});
+      ids.push_back(std::to_string(a) + std::to_string(b));
+    }
+  }
+  // Documents 0..5 are (1,1) (1,2) (2,1) (2,2) (3,1) (3,2).
+  QueryEvaluator evaluator(documents, &ids);
+  QuerySpec base = QuerySpec::Collection("c").OrderBy("a").OrderBy("b");
+  std::vector<FieldValue> two = {FieldValue::Integer(2)};
+
+  EXPECT_EQ(evaluator.Run(QuerySpec(base).StartAt(two)),
+            (Indices{2, 3, 4, 5}));
+  EXPECT_EQ(evaluator.Run(QuerySpec(base).StartAfter(two)), (Indices{4, 5}));
+  EXPECT_EQ(evaluator.Run(QuerySpec(base).EndAt(two)), (Indices{0, 1, 2, 3}));
+  EXPECT_EQ(evaluator.Run(QuerySpec(base).EndBefore(two)), (Indices{0, 1}));
+
+  // A full cursor splits the documents with a == 2.
+  EXPECT_EQ(evaluator.Run(QuerySpec(base).StartAfter(
+                {FieldValue::Integer(2), FieldValue::Integer(1)})),
+            (Indices{3, 4, 5}));
+  EXPECT_EQ(evaluator.Run(QuerySpec(base).StartAt(two).Limit(3)),
+            (Indices{2, 3, 4}));
+}
+
+}  // namespace
+}  // namespace snippets
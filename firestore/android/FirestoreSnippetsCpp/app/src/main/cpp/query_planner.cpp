@@ -0,0 +1,306 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "query_planner.h"
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <utility>
+
+#include "query_evaluator.h"
+
+namespace snippets {
+
+using firebase::Future;
+using firebase::firestore::DocumentSnapshot;
+using firebase::firestore::Error;
+using firebase::firestore::Firestore;
+using firebase::firestore::MapFieldValue;
+using firebase::firestore::Query;
+using firebase::firestore::QuerySnapshot;
+using firebase::firestore::Source;
+
+namespace {
+
+using Operator = QuerySpec::Operator;
+
+// Selectivities assumed for each kind of filter when there is no sample.
+constexpr double kDefaultEqualSelectivity = 0.1;
+constexpr double kDefaultRangeSelectivity = 0.5;
+
+bool IsDisjunction(Operator op) {
+  return op == Operator::kIn || op == Operator::kArrayContainsAny ||
+         op == Operator::kNotIn;
+}
+
+double DefaultSelectivity(const QuerySpec::Filter& filter) {
+  double values = static_cast<double>(filter.values.size());
+  switch (filter.op) {
+    case Operator::kEqual:
+    case Operator::kArrayContains:
+      return kDefaultEqualSelectivity;
+    case Operator::kIn:
+    case Operator::kArrayContainsAny:
+      return std::min(1.0, kDefaultEqualSelectivity * values);
+    case Operator::kNotEqual:
+      return 1 - kDefaultEqualSelectivity;
+    case Operator::kNotIn:
+      return std::max(0.0, 1 - kDefaultEqualSelectivity * values);
+    default:
+      return kDefaultRangeSelectivity;
+  }
+}
+
+QuerySpec EmptyLike(const QuerySpec& spec) {
+  return spec.is_collection_group() ? QuerySpec::CollectionGroup(spec.path())
+                                    : QuerySpec::Collection(spec.path());
+}
+
+void CopyBound(QuerySpec::Bound bound,
+               const std::vector<firebase::firestore::FieldValue>& values,
+               QuerySpec* spec) {
+  switch (bound) {
+    case QuerySpec::Bound::kStartAt:
+      spec->StartAt(values);
+      break;
+    case QuerySpec::Bound::kStartAfter:
+      spec->StartAfter(values);
+      break;
+    case QuerySpec::Bound::kEndAt:
+      spec->EndAt(values);
+      break;
+    case QuerySpec::Bound::kEndBefore:
+      spec->EndBefore(values);
+      break;
+    case QuerySpec::Bound::kNone:
+      break;
+  }
+}
+
+void CopyCursorsAndLimit(const QuerySpec& from, QuerySpec* to) {
+  CopyBound(from.start_bound(), from.start_values(), to);
+  CopyBound(from.end_bound(), from.end_values(), to);
+  if (from.limit() > 0) {
+    to->Limit(from.limit());
+  }
+}
+
+bool SameOrders(const std::vector<QuerySpec::Order>& lhs,
+                const std::vector<QuerySpec::Order>& rhs) {
+  if (lhs.size() != rhs.size()) return false;
+  for (size_t i = 0; i < lhs.size(); ++i) {
+    if (lhs[i].field != rhs[i].field ||
+        lhs[i].direction != rhs[i].direction) {
+      return false;
+    }
+  }
+  return true;
+}
+
+struct StatisticsState {
+  CollectionStatistics statistics;
+  size_t sample_size = 0;
+  std::mt19937_64 rng{std::random_device{}()};
+};
+
+}  // namespace
+
+void CollectStatistics(
+    Query query, size_t sample_size, PagedScanOptions options,
+    std::function<void(const CollectionStatistics&, Error, const std::string&)>
+        callback) {
+  auto state = std::make_shared<StatisticsState>();
+  state->sample_size = sample_size;
+  // Pages are delivered one at a time, so the state needs no lock.
+  ScanPages(
+      std::move(query), options,
+      [state](const std::vector<DocumentSnapshot>& page) {
+        CollectionStatistics& statistics = state->statistics;
+        for (const DocumentSnapshot& document : page) {
+          int64_t seen = statistics.document_count++;
+          if (statistics.sample.size() < state->sample_size) {
+            statistics.sample.push_back(document.GetData());
+            continue;
+          }
+          // Keep the document with probability sample_size / (seen + 1).
+          std::uniform_int_distribution<int64_t> slot(0, seen);
+          int64_t replaced = slot(state->rng);
+          if (replaced < static_cast<int64_t>(state->sample_size)) {
+            statistics.sample[static_cast<size_t>(replaced)] =
+                document.GetData();
+          }
+        }
+        return true;
+      },
+      [state, callback](Error error, const std::string& error_message) {
+        callback(state->statistics, error, error_message);
+      });
+}
+
+QueryPlanner::QueryPlanner(CollectionStatistics statistics)
+    : statistics_(std::move(statistics)) {}
+
+double QueryPlanner::EstimateSelectivity(
+    const std::vector<QuerySpec::Filter>& filters) const {
+  const std::vector<MapFieldValue>& sample = statistics_.sample;
+  if (sample.empty()) {
+    double selectivity = 1;
+    for (const QuerySpec::Filter& filter : filters) {
+      selectivity *= DefaultSelectivity(filter);
+    }
+    return selectivity;
+  }
+  size_t matches = QueryEvaluator(sample).Filter(filters).size();
+  // Smoothed, so that a filter no sampled document matches isn't assumed to
+  // read nothing.
+  return (static_cast<double>(matches) + 0.5) /
+         (static_cast<double>(sample.size()) + 1);
+}
+
+std::vector<QueryPlan> QueryPlanner::Candidates(const QuerySpec& spec) const {
+  std::vector<std::string> inequality_fields;
+  for (const QuerySpec::Filter& filter : spec.filters()) {
+    if (IsInequality(filter.op) &&
+        std::find(inequality_fields.begin(), inequality_fields.end(),
+                  filter.field) == inequality_fields.end()) {
+      inequality_fields.push_back(filter.field);
+    }
+  }
+  // Pushing no inequality at all leaves the backend free to use the
+  // requested order, which may let a limit through.
+  inequality_fields.push_back("");
+
+  std::vector<QuerySpec::Order> orders = spec.EffectiveOrders();
+  double documents = static_cast<double>(statistics_.document_count);
+
+  std::vector<QueryPlan> plans;
+  for (const std::string& field : inequality_fields) {
+    QueryPlan plan;
+    plan.server = EmptyLike(spec);
+    plan.client = EmptyLike(spec);
+    plan.server_inequality_field = field;
+
+    // A query may have one `array-contains` or one `array-contains-any`
+    // filter, but not both.
+    bool has_array_contains = false;
+    bool has_disjunction = false;
+    bool has_not_equal = false;
+    for (const QuerySpec::Filter& filter : spec.filters()) {
+      bool is_array_contains = filter.op == Operator::kArrayContains ||
+                               filter.op == Operator::kArrayContainsAny;
+      bool push = true;
+      if (IsInequality(filter.op) && filter.field != field) {
+        push = false;
+      } else if (is_array_contains && has_array_contains) {
+        push = false;
+      } else if (IsDisjunction(filter.op) && has_disjunction) {
+        push = false;
+      } else if ((filter.op == Operator::kNotEqual ||
+                  filter.op == Operator::kNotIn) &&
+                 has_not_equal) {
+        push = false;
+      }
+      if (push) {
+        has_array_contains = has_array_contains || is_array_contains;
+        has_disjunction = has_disjunction || IsDisjunction(filter.op);
+        has_not_equal = has_not_equal || filter.op == Operator::kNotEqual ||
+                        filter.op == Operator::kNotIn;
+        plan.server.Where(filter.field, filter.op, filter.values);
+      } else {
+        plan.client.Where(filter.field, filter.op, filter.values);
+      }
+    }
+
+    // The backend requires the inequality field to be ordered first.
+    std::vector<QuerySpec::Order> server_orders = orders;
+    if (!field.empty() && (orders.empty() || orders[0].field != field)) {
+      server_orders = {{field, Query::Direction::kAscending}};
+    }
+    for (const QuerySpec::Order& order : server_orders) {
+      plan.server.OrderBy(order.field, order.direction);
+    }
+    for (const QuerySpec::Order& order : orders) {
+      plan.client.OrderBy(order.field, order.direction);
+    }
+
+    // Limits and cursors only mean the same on the backend if its results
+    // need no further filtering or reordering.
+    bool exact = plan.client.filters().empty() &&
+                 SameOrders(server_orders, orders);
+    CopyCursorsAndLimit(spec, &plan.client);
+    if (exact) {
+      CopyCursorsAndLimit(spec, &plan.server);
+    }
+
+    plan.estimated_reads =
+        documents * EstimateSelectivity(plan.server.filters());
+    if (exact && spec.limit() > 0) {
+      plan.estimated_reads =
+          std::min(plan.estimated_reads, static_cast<double>(spec.limit()));
+    }
+    plans.push_back(std::move(plan));
+  }
+
+  // Ties go to the plan that filters least on the client.
+  std::stable_sort(plans.begin(), plans.end(),
+                   [](const QueryPlan& lhs, const QueryPlan& rhs) {
+                     if (lhs.estimated_reads != rhs.estimated_reads) {
+                       return lhs.estimated_reads < rhs.estimated_reads;
+                     }
+                     return lhs.client.filters().size() <
+                            rhs.client.filters().size();
+                   });
+  return plans;
+}
+
+QueryPlan QueryPlanner::Plan(const QuerySpec& spec) const {
+  return Candidates(spec).front();
+}
+
+void RunQueryPlan(
+    Firestore* db, const QueryPlan& plan, Source source,
+    std::function<void(const std::vector<DocumentSnapshot>&, Error,
+                       const std::string&)>
+        callback) {
+  QuerySpec client = plan.client;
+  plan.server.ToQuery(db).Get(source).OnCompletion(
+      [client, callback](const Future<QuerySnapshot>& future) {
+        Error error = static_cast<Error>(future.error());
+        if (error != Error::kErrorOk) {
+          callback({}, error, future.error_message());
+          return;
+        }
+        std::vector<DocumentSnapshot> documents =
+            future.result()->documents();
+        std::vector<MapFieldValue> data;
+        std::vector<std::string> ids;
+        data.reserve(documents.size());
+        ids.reserve(documents.size());
+        for (const DocumentSnapshot& document : documents) {
+          data.push_back(document.GetData());
+          ids.push_back(document.id());
+        }
+
+        std::vector<DocumentSnapshot> result;
+        for (size_t i : QueryEvaluator(data, &ids).Run(client)) {
+          result.push_back(documents[i]);
+        }
+        callback(result, Error::kErrorOk, "");
+      });
+}
+
+}  // namespace snippets
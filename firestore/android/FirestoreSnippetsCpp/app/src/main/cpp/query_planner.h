@@ -0,0 +1,118 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_QUERY_PLANNER_H
+#define FIRESTORESNIPPETSCPP_QUERY_PLANNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "firebase/firestore.h"
+#include "paged_scan.h"
+#include "query_spec.h"
+
+namespace snippets {
+
+// What the planner knows about a collection: its size and a uniform sample
+// of its documents, against which filters are tried to estimate how many
+// documents they match.
+struct CollectionStatistics {
+  int64_t document_count = 0;
+  std::vector<firebase::firestore::MapFieldValue> sample;
+};
+
+// Scans the results of `query` with `ScanPages()`, counting them and keeping
+// a uniform sample of up to `sample_size` documents (reservoir sampling), so
+// memory stays bounded however large the collection is. This reads every
+// document, so statistics should be collected rarely and reused.
+void CollectStatistics(
+    firebase::firestore::Query query, size_t sample_size,
+    PagedScanOptions options,
+    std::function<void(const CollectionStatistics& statistics,
+                       firebase::firestore::Error error,
+                       const std::string& error_message)>
+        callback);
+
+// A way to run a query the backend can't run as given: a supported query
+// sent to the backend, and the rest applied to its results on the client.
+struct QueryPlan {
+  // Runs on the backend. Holds at most one inequality field, which is also
+  // its first order, and at most one array-contains and one in,
+  // array-contains-any or not-in filter.
+  QuerySpec server;
+
+  // Applied to the results of `server` with `QueryEvaluator::Run()`: the
+  // filters that couldn't be sent, and the requested ordering, cursors and
+  // limit. Its path is that of the original query.
+  QuerySpec client;
+
+  // The name of the inequality field filtered on the backend; empty if none.
+  std::string server_inequality_field;
+
+  // Documents `server` is expected to read.
+  double estimated_reads = 0;
+};
+
+// Rewrites queries with filter combinations that Firestore rejects, such as
+// range filters on two fields (see `ReadDataInvalidCompoundQuery()`) or a
+// range filter on one field ordered by another (see
+// `ReadDataInvalidOrderAndLimit()`), into a `QueryPlan`.
+//
+// Each candidate pushes a different inequality field, or none, to the
+// backend. Its cost is the number of documents the server query reads,
+// estimated by running its filters over the sampled documents, so that
+// correlated filters are estimated together rather than assumed
+// independent. Limits and cursors are only sent to the backend when nothing
+// is filtered or reordered on the client; otherwise they would cut results
+// short.
+//
+// Server queries with several filters may need composite indexes, as any
+// query would.
+class QueryPlanner {
+ public:
+  explicit QueryPlanner(CollectionStatistics statistics);
+
+  // Returns every candidate plan for `spec`, cheapest first. Queries the
+  // backend accepts as they are produce a plan with no client-side filters.
+  std::vector<QueryPlan> Candidates(const QuerySpec& spec) const;
+
+  // Returns the cheapest plan for `spec`.
+  QueryPlan Plan(const QuerySpec& spec) const;
+
+  // Estimates the fraction of documents that match all `filters`.
+  double EstimateSelectivity(
+      const std::vector<QuerySpec::Filter>& filters) const;
+
+ private:
+  CollectionStatistics statistics_;
+};
+
+// Runs `plan.server`, then applies `plan.client` to its results. `callback`
+// receives the matching documents in the requested order.
+void RunQueryPlan(
+    firebase::firestore::Firestore* db, const QueryPlan& plan,
+    firebase::firestore::Source source,
+    std::function<void(
+        const std::vector<firebase::firestore::DocumentSnapshot>& documents,
+        firebase::firestore::Error error, const std::string& error_message)>
+        callback);
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_QUERY_PLANNER_H
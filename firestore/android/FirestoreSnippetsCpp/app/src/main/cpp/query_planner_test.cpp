@@ -0,0 +1,182 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "query_planner.h"
+
+#include <string>
+#include <vector>
+
+#include "firebase/firestore.h"
+#include "gtest/gtest.h"
+#include "query_spec.h"
+
+namespace snippets {
+namespace {
+
+using firebase::firestore::FieldValue;
+using firebase::firestore::MapFieldValue;
+using firebase::firestore::Query;
+using Operator = QuerySpec::Operator;
+
+// 100 cities in 10 states, "AA" to "JJ", where 1 in 20 has a population
+// over 100000.
+CollectionStatistics Cities() {
+  CollectionStatistics statistics;
+  for (int i = 0; i < 100; ++i) {
+    std::string state(2, static_cast<char>('A' + i % 10));
+    statistics.sample.push_back(
+        {{"state", FieldValue::String(state)},
+         {"country", FieldValue::String(i % 2 ? "USA" : "Japan")},
+         {"population", FieldValue::Integer(i % 20 == 0 ? 500000 : 1000)},
+         {"regions", FieldValue::Array({FieldValue::String("west")})}});
+  }
+  statistics.document_count = 100;
+  return statistics;
+}
+
+std::vector<std::string> Fields(const std::vector<QuerySpec::Filter>& filters) {
+  std::vector<std::string> fields;
+  for (const QuerySpec::Filter& filter : filters) {
+    fields.push_back(filter.field);
+  }
+  return fields;
+}
+
+std::vector<std::string> Fields(const std::vector<QuerySpec::Order>& orders) {
+  std::vector<std::string> fields;
+  for (const QuerySpec::Order& order : orders) {
+    fields.push_back(order.field);
+  }
+  return fields;
+}
+
+using Names = std::vector<std::string>;
+
+// The shape of `ReadDataInvalidCompoundQuery()`: range filters on two
+// fields.
+TEST(QueryPlannerTest, SplitsRangeFiltersOnTwoFields) {
+  QuerySpec spec =
+      QuerySpec::Collection("cities")
+          .Where("state", Operator::kGreaterThanOrEqual,
+                 FieldValue::String("CA"))
+          .Where("population", Operator::kGreaterThan,
+                 FieldValue::Integer(100000))
+          .Limit(5);
+  std::vector<QueryPlan> plans = QueryPlanner(Cities()).Candidates(spec);
+  ASSERT_EQ(plans.size(), 3u);
+
+  // Population is the more selective filter.
+  const QueryPlan& best = plans[0];
+  EXPECT_EQ(best.server_inequality_field, "population");
+  EXPECT_EQ(Fields(best.server.filters()), (Names{"population"}));
+  EXPECT_EQ(Fields(best.server.orders()), (Names{"population"}));
+  EXPECT_EQ(Fields(best.client.filters()), (Names{"state"}));
+  EXPECT_LT(best.estimated_reads, plans[1].estimated_reads);
+
+  for (const QueryPlan& plan : plans) {
+    // The client filters, so the limit can't go to the backend.
+    EXPECT_EQ(plan.server.limit(), 0);
+    EXPECT_EQ(plan.client.limit(), 5);
+    EXPECT_EQ(plan.server.filters().size() + plan.client.filters().size(),
+              2u);
+    if (!plan.server_inequality_field.empty()) {
+      EXPECT_EQ(plan.server.orders()[0].field, plan.server_inequality_field);
+    }
+  }
+  // The candidate that pushes no inequality filters everything locally.
+  EXPECT_TRUE(plans[2].server_inequality_field.empty());
+  EXPECT_TRUE(plans[2].server.filters().empty());
+}
+
+// The shape of `ReadDataInvalidOrderAndLimit()`: a range filter on one field
+// and an order on another.
+TEST(QueryPlannerTest, ReordersOnTheClientWhenTheOrderFieldDiffers) {
+  QuerySpec spec = QuerySpec::Collection("cities")
+                       .Where("population", Operator::kGreaterThan,
+                              FieldValue::Integer(100000))
+                       .OrderBy("country")
+                       .Limit(2);
+  std::vector<QueryPlan> plans = QueryPlanner(Cities()).Candidates(spec);
+  ASSERT_EQ(plans.size(), 2u);
+
+  const QueryPlan& pushed = plans[0];
+  EXPECT_EQ(pushed.server_inequality_field, "population");
+  EXPECT_EQ(Fields(pushed.server.filters()), (Names{"population"}));
+  // The backend must order by the inequality field first.
+  EXPECT_EQ(Fields(pushed.server.orders()), (Names{"population"}));
+  EXPECT_TRUE(pushed.client.filters().empty());
+  EXPECT_EQ(Fields(pushed.client.orders()), (Names{"country"}));
+  // Results are reordered, so the first two on the server aren't the first
+  // two overall.
+  EXPECT_EQ(pushed.server.limit(), 0);
+  EXPECT_EQ(pushed.client.limit(), 2);
+
+  const QueryPlan& local = plans[1];
+  EXPECT_TRUE(local.server_inequality_field.empty());
+  EXPECT_EQ(Fields(local.server.orders()), (Names{"country"}));
+  EXPECT_EQ(Fields(local.client.filters()), (Names{"population"}));
+  EXPECT_EQ(local.server.limit(), 0);
+}
+
+TEST(QueryPlannerTest, SendsLimitAndCursorsWhenNothingIsLeftToTheClient) {
+  QuerySpec spec = QuerySpec::Collection("cities")
+                       .Where("population", Operator::kGreaterThan,
+                              FieldValue::Integer(100000))
+                       .OrderBy("population", Query::Direction::kAscending)
+                       .StartAfter({FieldValue::Integer(200000)})
+                       .Limit(2);
+  QueryPlan plan = QueryPlanner(Cities()).Plan(spec);
+  EXPECT_EQ(plan.server_inequality_field, "population");
+  EXPECT_TRUE(plan.client.filters().empty());
+  EXPECT_EQ(plan.server.limit(), 2);
+  EXPECT_EQ(plan.server.start_bound(), QuerySpec::Bound::kStartAfter);
+  EXPECT_LE(plan.estimated_reads, 2);
+}
+
+TEST(QueryPlannerTest, SendsAtMostOneFilterOfEachRestrictedKind) {
+  QuerySpec spec =
+      QuerySpec::Collection("cities")
+          .Where("regions", Operator::kArrayContains,
+                 FieldValue::String("west"))
+          .Where("regions", Operator::kArrayContainsAny,
+                 {FieldValue::String("east")})
+          .Where("country", Operator::kIn, {FieldValue::String("USA")})
+          .Where("state", Operator::kIn, {FieldValue::String("AA")})
+          .Where("country", Operator::kNotEqual, FieldValue::String("UK"))
+          .Where("country", Operator::kNotIn, {FieldValue::String("FR")});
+  for (const QueryPlan& plan : QueryPlanner(Cities()).Candidates(spec)) {
+    int array_contains = 0;
+    int disjunctions = 0;
+    int not_equal = 0;
+    for (const QuerySpec::Filter& filter : plan.server.filters()) {
+      array_contains += filter.op == Operator::kArrayContains ||
+                        filter.op == Operator::kArrayContainsAny;
+      disjunctions += filter.op == Operator::kIn ||
+                      filter.op == Operator::kArrayContainsAny ||
+                      filter.op == Operator::kNotIn;
+      not_equal +=
+          filter.op == Operator::kNotEqual || filter.op == Operator::kNotIn;
+    }
+    EXPECT_LE(array_contains, 1);
+    EXPECT_LE(disjunctions, 1);
+    EXPECT_LE(not_equal, 1);
+    EXPECT_EQ(plan.server.filters().size() + plan.client.filters().size(),
+              spec.filters().size());
+  }
+}
+
+}  // namespace
+}  // namespace snippets
@@ -0,0 +1,416 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "query_spec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <utility>
+
+namespace snippets {
+
+using firebase::firestore::FieldPath;
+using firebase::firestore::FieldValue;
+using firebase::firestore::Firestore;
+using firebase::firestore::MapFieldValue;
+using firebase::firestore::Query;
+
+const char kDocumentIdField[] = "__name__";
+
+namespace {
+
+template <typename F>
+Query ApplyFilter(const Query& query, const F& field,
+                  const QuerySpec::Filter& filter) {
+  switch (filter.op) {
+    case QuerySpec::Operator::kEqual:
+      return query.WhereEqualTo(field, filter.values[0]);
+    case QuerySpec::Operator::kNotEqual:
+      return query.WhereNotEqualTo(field, filter.values[0]);
+    case QuerySpec::Operator::kLessThan:
+      return query.WhereLessThan(field, filter.values[0]);
+    case QuerySpec::Operator::kLessThanOrEqual:
+      return query.WhereLessThanOrEqualTo(field, filter.values[0]);
+    case QuerySpec::Operator::kGreaterThan:
+      return query.WhereGreaterThan(field, filter.values[0]);
+    case QuerySpec::Operator::kGreaterThanOrEqual:
+      return query.WhereGreaterThanOrEqualTo(field, filter.values[0]);
+    case QuerySpec::Operator::kArrayContains:
+      return query.WhereArrayContains(field, filter.values[0]);
+    case QuerySpec::Operator::kArrayContainsAny:
+      return query.WhereArrayContainsAny(field, filter.values);
+    case QuerySpec::Operator::kIn:
+      return query.WhereIn(field, filter.values);
+    case QuerySpec::Operator::kNotIn:
+      return query.WhereNotIn(field, filter.values);
+  }
+  return query;
+}
+
+Query ApplyBound(const Query& query, QuerySpec::Bound bound,
+                 const std::vector<FieldValue>& values) {
+  switch (bound) {
+    case QuerySpec::Bound::kNone:
+      return query;
+    case QuerySpec::Bound::kStartAt:
+      return query.StartAt(values);
+    case QuerySpec::Bound::kStartAfter:
+      return query.StartAfter(values);
+    case QuerySpec::Bound::kEndAt:
+      return query.EndAt(values);
+    case QuerySpec::Bound::kEndBefore:
+      return query.EndBefore(values);
+  }
+  return query;
+}
+
+const char* OperatorName(QuerySpec::Operator op) {
+  switch (op) {
+    case QuerySpec::Operator::kEqual:
+      return "==";
+    case QuerySpec::Operator::kNotEqual:
+      return "!=";
+    case QuerySpec::Operator::kLessThan:
+      return "<";
+    case QuerySpec::Operator::kLessThanOrEqual:
+      return "<=";
+    case QuerySpec::Operator::kGreaterThan:
+      return ">";
+    case QuerySpec::Operator::kGreaterThanOrEqual:
+      return ">=";
+    case QuerySpec::Operator::kArrayContains:
+      return "array-contains";
+    case QuerySpec::Operator::kArrayContainsAny:
+      return "array-contains-any";
+    case QuerySpec::Operator::kIn:
+      return "in";
+    case QuerySpec::Operator::kNotIn:
+      return "not-in";
+  }
+  return "?";
+}
+
+const char* BoundName(QuerySpec::Bound bound) {
+  switch (bound) {
+    case QuerySpec::Bound::kNone:
+      return "";
+    case QuerySpec::Bound::kStartAt:
+      return "start-at";
+    case QuerySpec::Bound::kStartAfter:
+      return "start-after";
+    case QuerySpec::Bound::kEndAt:
+      return "end-at";
+    case QuerySpec::Bound::kEndBefore:
+      return "end-before";
+  }
+  return "?";
+}
+
+void AppendQuoted(const std::string& s, std::string* out) {
+  out->push_back('"');
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out->push_back('\\');
+    }
+    out->push_back(c);
+  }
+  out->push_back('"');
+}
+
+void AppendCanonical(const FieldValue& value, std::string* out);
+
+void AppendValues(const std::vector<FieldValue>& values, bool sorted,
+                  std::string* out) {
+  std::vector<std::string> parts;
+  parts.reserve(values.size());
+  for (const FieldValue& value : values) {
+    parts.push_back(CanonicalString(value));
+  }
+  if (sorted) {
+    std::sort(parts.begin(), parts.end());
+  }
+
+  out->push_back('[');
+  for (size_t i = 0; i < parts.size(); ++i) {
+    if (i > 0) out->push_back(',');
+    out->append(parts[i]);
+  }
+  out->push_back(']');
+}
+
+void AppendCanonical(const FieldValue& value, std::string* out) {
+  char buffer[64];
+  switch (value.type()) {
+    case FieldValue::Type::kNull:
+      out->append("null");
+      return;
+    case FieldValue::Type::kBoolean:
+      out->append(value.boolean_value() ? "true" : "false");
+      return;
+    case FieldValue::Type::kInteger:
+      out->append("n:");
+      out->append(std::to_string(value.integer_value()));
+      return;
+    case FieldValue::Type::kDouble: {
+      // Firestore compares integers and doubles by numeric value, so a whole
+      // double gets the same key as the equivalent integer.
+      double d = value.double_value();
+      if (std::floor(d) == d && std::fabs(d) < 9007199254740992.0) {
+        std::snprintf(buffer, sizeof(buffer), "n:%lld",
+                      static_cast<long long>(d));
+      } else {
+        std::snprintf(buffer, sizeof(buffer), "n:%.17g", d);
+      }
+      out->append(buffer);
+      return;
+    }
+    case FieldValue::Type::kTimestamp: {
+      firebase::Timestamp ts = value.timestamp_value();
+      std::snprintf(buffer, sizeof(buffer), "t:%lld.%09d",
+                    static_cast<long long>(ts.seconds()), ts.nanoseconds());
+      out->append(buffer);
+      return;
+    }
+    case FieldValue::Type::kString:
+      out->append("s:");
+      AppendQuoted(value.string_value(), out);
+      return;
+    case FieldValue::Type::kBlob: {
+      out->append("b:");
+      const uint8_t* data = value.blob_value();
+      for (size_t i = 0; i < value.blob_size(); ++i) {
+        std::snprintf(buffer, sizeof(buffer), "%02x", data[i]);
+        out->append(buffer);
+      }
+      return;
+    }
+    case FieldValue::Type::kReference:
+      out->append("r:");
+      AppendQuoted(value.reference_value().path(), out);
+      return;
+    case FieldValue::Type::kGeoPoint: {
+      firebase::GeoPoint point = value.geo_point_value();
+      std::snprintf(buffer, sizeof(buffer), "g:%.17g,%.17g", point.latitude(),
+                    point.longitude());
+      out->append(buffer);
+      return;
+    }
+    case FieldValue::Type::kArray:
+      AppendValues(value.array_value(), /*sorted=*/false, out);
+      return;
+    case FieldValue::Type::kMap: {
+      MapFieldValue map = value.map_value();
+      std::vector<std::pair<std::string, const FieldValue*>> entries;
+      entries.reserve(map.size());
+      for (const auto& kv : map) {
+        entries.emplace_back(kv.first, &kv.second);
+      }
+      std::sort(entries.begin(), entries.end(),
+                [](const std::pair<std::string, const FieldValue*>& a,
+                   const std::pair<std::string, const FieldValue*>& b) {
+                  return a.first < b.first;
+                });
+
+      out->push_back('{');
+      for (size_t i = 0; i < entries.size(); ++i) {
+        if (i > 0) out->push_back(',');
+        AppendQuoted(entries[i].first, out);
+        out->push_back(':');
+        AppendCanonical(*entries[i].second, out);
+      }
+      out->push_back('}');
+      return;
+    }
+    default:
+      // Sentinels such as Delete() or Increment() cannot appear in queries.
+      out->append("?");
+      return;
+  }
+}
+
+}  // namespace
+
+QuerySpec QuerySpec::Collection(const std::string& path) {
+  QuerySpec spec;
+  spec.path_ = path;
+  return spec;
+}
+
+QuerySpec QuerySpec::CollectionGroup(const std::string& collection_id) {
+  QuerySpec spec;
+  spec.collection_group_ = true;
+  spec.path_ = collection_id;
+  return spec;
+}
+
+QuerySpec& QuerySpec::Where(const std::string& field, Operator op,
+                            const FieldValue& value) {
+  filters_.push_back(Filter{field, op, {value}});
+  return *this;
+}
+
+QuerySpec& QuerySpec::Where(const std::string& field, Operator op,
+                            const std::vector<FieldValue>& values) {
+  filters_.push_back(Filter{field, op, values});
+  return *this;
+}
+
+QuerySpec& QuerySpec::OrderBy(const std::string& field,
+                              Query::Direction direction) {
+  orders_.push_back(Order{field, direction});
+  return *this;
+}
+
+QuerySpec& QuerySpec::Limit(int32_t limit) {
+  limit_ = limit;
+  return *this;
+}
+
+QuerySpec& QuerySpec::StartAt(const std::vector<FieldValue>& values) {
+  start_bound_ = Bound::kStartAt;
+  start_values_ = values;
+  return *this;
+}
+
+QuerySpec& QuerySpec::StartAfter(const std::vector<FieldValue>& values) {
+  start_bound_ = Bound::kStartAfter;
+  start_values_ = values;
+  return *this;
+}
+
+QuerySpec& QuerySpec::EndAt(const std::vector<FieldValue>& values) {
+  end_bound_ = Bound::kEndAt;
+  end_values_ = values;
+  return *this;
+}
+
+QuerySpec& QuerySpec::EndBefore(const std::vector<FieldValue>& values) {
+  end_bound_ = Bound::kEndBefore;
+  end_values_ = values;
+  return *this;
+}
+
+Query QuerySpec::ToQuery(Firestore* db) const {
+  Query query = collection_group_ ? db->CollectionGroup(path_)
+                                  : Query(db->Collection(path_));
+
+  for (const Filter& filter : filters_) {
+    if (filter.field == kDocumentIdField) {
+      query = ApplyFilter(query, FieldPath::DocumentId(), filter);
+    } else {
+      query = ApplyFilter(query, filter.field, filter);
+    }
+  }
+  for (const Order& order : orders_) {
+    if (order.field == kDocumentIdField) {
+      query = query.OrderBy(FieldPath::DocumentId(), order.direction);
+    } else {
+      query = query.OrderBy(order.field, order.direction);
+    }
+  }
+  if (limit_ > 0) {
+    query = query.Limit(limit_);
+  }
+  query = ApplyBound(query, start_bound_, start_values_);
+  query = ApplyBound(query, end_bound_, end_values_);
+  return query;
+}
+
+std::vector<QuerySpec::Order> QuerySpec::EffectiveOrders() const {
+  if (!orders_.empty()) {
+    return orders_;
+  }
+  for (const Filter& filter : filters_) {
+    if (IsInequality(filter.op)) {
+      return {{filter.field, Query::Direction::kAscending}};
+    }
+  }
+  return {};
+}
+
+std::string QuerySpec::CanonicalKey() const {
+  std::string key = collection_group_ ? "group:" : "collection:";
+  key.append(path_);
+
+  // Filters are ANDed together, so their order does not matter.
+  std::vector<std::string> filters;
+  for (const Filter& filter : filters_) {
+    std::string part = filter.field;
+    part.push_back(' ');
+    part.append(OperatorName(filter.op));
+    part.push_back(' ');
+    bool is_set = filter.op == Operator::kIn || filter.op == Operator::kNotIn ||
+                  filter.op == Operator::kArrayContainsAny;
+    if (is_set) {
+      AppendValues(filter.values, /*sorted=*/true, &part);
+    } else {
+      AppendCanonical(filter.values[0], &part);
+    }
+    filters.push_back(std::move(part));
+  }
+  std::sort(filters.begin(), filters.end());
+  for (const std::string& filter : filters) {
+    key.append("|where ");
+    key.append(filter);
+  }
+
+  for (const Order& order : orders_) {
+    key.append("|order ");
+    key.append(order.field);
+    key.append(order.direction == Query::Direction::kAscending ? " asc"
+                                                               : " desc");
+  }
+  if (limit_ > 0) {
+    key.append("|limit ");
+    key.append(std::to_string(limit_));
+  }
+  if (start_bound_ != Bound::kNone) {
+    key.append("|");
+    key.append(BoundName(start_bound_));
+    key.push_back(' ');
+    AppendValues(start_values_, /*sorted=*/false, &key);
+  }
+  if (end_bound_ != Bound::kNone) {
+    key.append("|");
+    key.append(BoundName(end_bound_));
+    key.push_back(' ');
+    AppendValues(end_values_, /*sorted=*/false, &key);
+  }
+  return key;
+}
+
+std::string CanonicalString(const FieldValue& value) {
+  std::string result;
+  AppendCanonical(value, &result);
+  return result;
+}
+
+bool IsInequality(QuerySpec::Operator op) {
+  switch (op) {
+    case QuerySpec::Operator::kNotEqual:
+    case QuerySpec::Operator::kLessThan:
+    case QuerySpec::Operator::kLessThanOrEqual:
+    case QuerySpec::Operator::kGreaterThan:
+    case QuerySpec::Operator::kGreaterThanOrEqual:
+    case QuerySpec::Operator::kNotIn:
+      return true;
+    default:
+      return false;
+  }
+}
+
+}  // namespace snippets
@@ -0,0 +1,145 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_QUERY_SPEC_H
+#define FIRESTORESNIPPETSCPP_QUERY_SPEC_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "firebase/firestore.h"
+
+namespace snippets {
+
+// Field name that stands for the document ID, as in
+// `FieldPath::DocumentId()`.
+extern const char kDocumentIdField[];
+
+// A plain description of a Firestore query.
+//
+// `firebase::firestore::Query` is opaque: its filters, orders and cursors
+// cannot be read back once the query is built. `QuerySpec` records them, so
+// the same description can be turned into a `Query`, inspected, and reduced
+// to a canonical key that is identical for equivalent queries regardless of
+// the order in which their filters were added.
+//
+//   QuerySpec spec = QuerySpec::Collection("cities")
+//                        .Where("capital", QuerySpec::Operator::kEqual,
+//                               FieldValue::Boolean(true));
+//   spec.ToQuery(db).Get()...
+class QuerySpec {
+ public:
+  enum class Operator {
+    kEqual,
+    kNotEqual,
+    kLessThan,
+    kLessThanOrEqual,
+    kGreaterThan,
+    kGreaterThanOrEqual,
+    kArrayContains,
+    kArrayContainsAny,
+    kIn,
+    kNotIn,
+  };
+
+  struct Filter {
+    std::string field;
+    Operator op;
+    // A single value for comparison and array-contains filters, the list of
+    // values for `kIn`, `kNotIn` and `kArrayContainsAny`.
+    std::vector<firebase::firestore::FieldValue> values;
+  };
+
+  struct Order {
+    std::string field;
+    firebase::firestore::Query::Direction direction;
+  };
+
+  enum class Bound { kNone, kStartAt, kStartAfter, kEndAt, kEndBefore };
+
+  // A query over the collection at `path`, e.g. "cities" or
+  // "cities/SF/landmarks".
+  static QuerySpec Collection(const std::string& path);
+
+  // A query over every collection with the given ID.
+  static QuerySpec CollectionGroup(const std::string& collection_id);
+
+  QuerySpec& Where(const std::string& field, Operator op,
+                   const firebase::firestore::FieldValue& value);
+  QuerySpec& Where(const std::string& field, Operator op,
+                   const std::vector<firebase::firestore::FieldValue>& values);
+  QuerySpec& OrderBy(const std::string& field,
+                     firebase::firestore::Query::Direction direction =
+                         firebase::firestore::Query::Direction::kAscending);
+  QuerySpec& Limit(int32_t limit);
+  QuerySpec& StartAt(
+      const std::vector<firebase::firestore::FieldValue>& values);
+  QuerySpec& StartAfter(
+      const std::vector<firebase::firestore::FieldValue>& values);
+  QuerySpec& EndAt(const std::vector<firebase::firestore::FieldValue>& values);
+  QuerySpec& EndBefore(
+      const std::vector<firebase::firestore::FieldValue>& values);
+
+  bool is_collection_group() const { return collection_group_; }
+  const std::string& path() const { return path_; }
+  const std::vector<Filter>& filters() const { return filters_; }
+  const std::vector<Order>& orders() const { return orders_; }
+  // 0 means no limit.
+  int32_t limit() const { return limit_; }
+  Bound start_bound() const { return start_bound_; }
+  const std::vector<firebase::firestore::FieldValue>& start_values() const {
+    return start_values_;
+  }
+  Bound end_bound() const { return end_bound_; }
+  const std::vector<firebase::firestore::FieldValue>& end_values() const {
+    return end_values_;
+  }
+
+  // The order results come in: `orders()`, or, if there are none, the first
+  // inequality field ascending. The backend breaks remaining ties by
+  // document ID, which isn't included.
+  std::vector<Order> EffectiveOrders() const;
+
+  // Builds the equivalent `Query`.
+  firebase::firestore::Query ToQuery(firebase::firestore::Firestore* db) const;
+
+  // Returns a string that identifies the query's results: two specs with the
+  // same key return the same documents in the same order.
+  std::string CanonicalKey() const;
+
+ private:
+  bool collection_group_ = false;
+  std::string path_;
+  std::vector<Filter> filters_;
+  std::vector<Order> orders_;
+  int32_t limit_ = 0;
+  Bound start_bound_ = Bound::kNone;
+  std::vector<firebase::firestore::FieldValue> start_values_;
+  Bound end_bound_ = Bound::kNone;
+  std::vector<firebase::firestore::FieldValue> end_values_;
+};
+
+// Returns a deterministic string form of `value`, with map keys sorted.
+std::string CanonicalString(const firebase::firestore::FieldValue& value);
+
+// Whether `op` is `!=`, `not-in` or a range comparison: the operators that
+// constrain the query's first order.
+bool IsInequality(QuerySpec::Operator op);
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_QUERY_SPEC_H
@@ -0,0 +1,457 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "query_spec_json.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "field_value_json.h"
+
+namespace snippets {
+
+using firebase::firestore::FieldValue;
+using firebase::firestore::Firestore;
+using firebase::firestore::MapFieldValue;
+using firebase::firestore::Query;
+
+namespace {
+
+// The range of `firebase::Timestamp`: 0001-01-01 to 9999-12-31, UTC.
+constexpr int64_t kMinTimestampSeconds = -62135596800;
+constexpr int64_t kMaxTimestampSeconds = 253402300799;
+constexpr int64_t kMaxNanos = 999999999;
+
+struct OperatorName {
+  QuerySpec::Operator op;
+  const char* name;
+};
+
+const OperatorName kOperatorNames[] = {
+    {QuerySpec::Operator::kEqual, "=="},
+    {QuerySpec::Operator::kNotEqual, "!="},
+    {QuerySpec::Operator::kLessThan, "<"},
+    {QuerySpec::Operator::kLessThanOrEqual, "<="},
+    {QuerySpec::Operator::kGreaterThan, ">"},
+    {QuerySpec::Operator::kGreaterThanOrEqual, ">="},
+    {QuerySpec::Operator::kArrayContains, "array-contains"},
+    {QuerySpec::Operator::kArrayContainsAny, "array-contains-any"},
+    {QuerySpec::Operator::kIn, "in"},
+    {QuerySpec::Operator::kNotIn, "not-in"},
+};
+
+void AppendNumber(double value, std::string* out) {
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "%.17g", value);
+  out->append(buffer);
+}
+
+void AppendValue(const FieldValue& value, std::string* out);
+
+void AppendArray(const std::vector<FieldValue>& values, std::string* out) {
+  out->push_back('[');
+  for (size_t i = 0; i < values.size(); ++i) {
+    if (i > 0) out->push_back(',');
+    AppendValue(values[i], out);
+  }
+  out->push_back(']');
+}
+
+void AppendValue(const FieldValue& value, std::string* out) {
+  switch (value.type()) {
+    case FieldValue::Type::kBoolean:
+      out->append(value.boolean_value() ? "true" : "false");
+      return;
+    case FieldValue::Type::kInteger:
+      out->append(std::to_string(value.integer_value()));
+      return;
+    case FieldValue::Type::kDouble: {
+      double d = value.double_value();
+      if (std::isnan(d)) {
+        out->append("{\"$double\":\"NaN\"}");
+      } else if (std::isinf(d)) {
+        out->append(d > 0 ? "{\"$double\":\"Infinity\"}"
+                          : "{\"$double\":\"-Infinity\"}");
+      } else {
+        size_t start = out->size();
+        AppendNumber(d, out);
+        // Keep whole doubles from being read back as integers.
+        if (out->find_first_of(".e", start) == std::string::npos) {
+          out->append(".0");
+        }
+      }
+      return;
+    }
+    case FieldValue::Type::kTimestamp: {
+      firebase::Timestamp timestamp = value.timestamp_value();
+      out->append("{\"$timestamp\":[");
+      out->append(std::to_string(timestamp.seconds()));
+      out->push_back(',');
+      out->append(std::to_string(timestamp.nanoseconds()));
+      out->append("]}");
+      return;
+    }
+    case FieldValue::Type::kString:
+      AppendJsonString(value.string_value(), out);
+      return;
+    case FieldValue::Type::kBlob: {
+      static const char kHex[] = "0123456789abcdef";
+      out->append("{\"$bytes\":\"");
+      const uint8_t* data = value.blob_value();
+      for (size_t i = 0; i < value.blob_size(); ++i) {
+        out->push_back(kHex[data[i] >> 4]);
+        out->push_back(kHex[data[i] & 0xf]);
+      }
+      out->append("\"}");
+      return;
+    }
+    case FieldValue::Type::kReference:
+      out->append("{\"$reference\":");
+      AppendJsonString(value.reference_value().path(), out);
+      out->push_back('}');
+      return;
+    case FieldValue::Type::kGeoPoint:
+      out->append("{\"$geopoint\":[");
+      AppendNumber(value.geo_point_value().latitude(), out);
+      out->push_back(',');
+      AppendNumber(value.geo_point_value().longitude(), out);
+      out->append("]}");
+      return;
+    case FieldValue::Type::kArray:
+      AppendArray(value.array_value(), out);
+      return;
+    case FieldValue::Type::kMap: {
+      MapFieldValue map = value.map_value();
+      std::vector<const MapFieldValue::value_type*> entries;
+      for (const auto& entry : map) {
+        entries.push_back(&entry);
+      }
+      std::sort(entries.begin(), entries.end(),
+                [](const MapFieldValue::value_type* left,
+                   const MapFieldValue::value_type* right) {
+                  return left->first < right->first;
+                });
+      out->append("{\"$map\":{");
+      for (size_t i = 0; i < entries.size(); ++i) {
+        if (i > 0) out->push_back(',');
+        AppendJsonString(entries[i]->first, out);
+        out->push_back(':');
+        AppendValue(entries[i]->second, out);
+      }
+      out->append("}}");
+      return;
+    }
+    default:
+      out->append("null");
+      return;
+  }
+}
+
+class SpecParser {
+ public:
+  SpecParser(Firestore* db, std::string* error_message)
+      : db_(db), error_message_(error_message) {}
+
+  bool ParseSpec(const FieldValue& json, QuerySpec* out) {
+    if (!json.is_map()) {
+      return Fail("query is not an object");
+    }
+    MapFieldValue fields = json.map_value();
+    if (fields["collection"].is_string()) {
+      *out = QuerySpec::Collection(fields["collection"].string_value());
+    } else if (fields["collection_group"].is_string()) {
+      *out =
+          QuerySpec::CollectionGroup(fields["collection_group"].string_value());
+    } else {
+      return Fail("query has no collection");
+    }
+
+    for (const FieldValue& filter : Elements(fields["where"])) {
+      if (!ParseFilter(filter, out)) return false;
+    }
+    for (const FieldValue& order : Elements(fields["order_by"])) {
+      std::vector<FieldValue> parts = Elements(order);
+      if (parts.size() != 2 || !parts[0].is_string() ||
+          !parts[1].is_string()) {
+        return Fail("malformed order");
+      }
+      out->OrderBy(parts[0].string_value(),
+                   parts[1].string_value() == "desc"
+                       ? Query::Direction::kDescending
+                       : Query::Direction::kAscending);
+    }
+    if (fields["limit"].is_integer()) {
+      out->Limit(static_cast<int32_t>(fields["limit"].integer_value()));
+    }
+
+    std::vector<FieldValue> values;
+    if (fields.count("start_at")) {
+      if (!ParseValues(fields["start_at"], &values)) return false;
+      out->StartAt(values);
+    } else if (fields.count("start_after")) {
+      if (!ParseValues(fields["start_after"], &values)) return false;
+      out->StartAfter(values);
+    }
+    if (fields.count("end_at")) {
+      if (!ParseValues(fields["end_at"], &values)) return false;
+      out->EndAt(values);
+    } else if (fields.count("end_before")) {
+      if (!ParseValues(fields["end_before"], &values)) return false;
+      out->EndBefore(values);
+    }
+    return true;
+  }
+
+ private:
+  bool ParseFilter(const FieldValue& json, QuerySpec* out) {
+    std::vector<FieldValue> parts = Elements(json);
+    if (parts.size() != 3 || !parts[0].is_string() || !parts[1].is_string()) {
+      return Fail("malformed filter");
+    }
+    std::string name = parts[1].string_value();
+    const OperatorName* op = std::find_if(
+        std::begin(kOperatorNames), std::end(kOperatorNames),
+        [&name](const OperatorName& entry) { return name == entry.name; });
+    if (op == std::end(kOperatorNames)) {
+      return Fail("unknown operator " + name);
+    }
+    std::vector<FieldValue> values;
+    if (!ParseValues(parts[2], &values) || values.empty()) {
+      return Fail("filter has no values");
+    }
+    out->Where(parts[0].string_value(), op->op, values);
+    return true;
+  }
+
+  bool ParseValues(const FieldValue& json, std::vector<FieldValue>* out) {
+    if (!json.is_array()) {
+      return Fail("expected an array of values");
+    }
+    out->clear();
+    for (const FieldValue& element : json.array_value()) {
+      FieldValue value;
+      if (!ParseValue(element, &value)) return false;
+      out->push_back(std::move(value));
+    }
+    return true;
+  }
+
+  bool ParseValue(const FieldValue& json, FieldValue* out) {
+    if (json.is_array()) {
+      std::vector<FieldValue> values;
+      if (!ParseValues(json, &values)) return false;
+      *out = FieldValue::Array(std::move(values));
+      return true;
+    }
+    if (!json.is_map()) {
+      *out = json;
+      return true;
+    }
+
+    MapFieldValue tagged = json.map_value();
+    if (tagged.size() != 1) {
+      return Fail("malformed value");
+    }
+    const std::string& tag = tagged.begin()->first;
+    const FieldValue& body = tagged.begin()->second;
+    std::vector<FieldValue> parts = Elements(body);
+    if (tag == "$double" && body.is_string()) {
+      double infinity = std::numeric_limits<double>::infinity();
+      const std::string& name = body.string_value();
+      if (name == "NaN") {
+        *out = FieldValue::Double(std::nan(""));
+      } else if (name == "Infinity") {
+        *out = FieldValue::Double(infinity);
+      } else if (name == "-Infinity") {
+        *out = FieldValue::Double(-infinity);
+      } else {
+        return Fail("unknown double " + name);
+      }
+    } else if (tag == "$timestamp" && parts.size() == 2 &&
+               parts[0].is_integer() && parts[1].is_integer()) {
+      int64_t seconds = parts[0].integer_value();
+      int64_t nanos = parts[1].integer_value();
+      if (seconds < kMinTimestampSeconds || seconds > kMaxTimestampSeconds ||
+          nanos < 0 || nanos > kMaxNanos) {
+        return Fail("timestamp out of range");
+      }
+      *out = FieldValue::Timestamp(
+          firebase::Timestamp(seconds, static_cast<int32_t>(nanos)));
+    } else if (tag == "$bytes" && body.is_string()) {
+      std::string hex = body.string_value();
+      std::vector<uint8_t> bytes;
+      for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+        char digits[3] = {hex[i], hex[i + 1], '\0'};
+        bytes.push_back(
+            static_cast<uint8_t>(std::strtoul(digits, nullptr, 16)));
+      }
+      *out = FieldValue::Blob(bytes.data(), bytes.size());
+    } else if (tag == "$reference" && body.is_string()) {
+      if (!IsDocumentPath(body.string_value())) {
+        return Fail("invalid document path " + body.string_value());
+      }
+      *out = FieldValue::Reference(db_->Document(body.string_value()));
+    } else if (tag == "$geopoint" && parts.size() == 2 &&
+               IsNumber(parts[0]) && IsNumber(parts[1])) {
+      double latitude = Number(parts[0]);
+      double longitude = Number(parts[1]);
+      // Written so that NaN fails too.
+      if (!(latitude >= -90 && latitude <= 90) ||
+          !(longitude >= -180 && longitude <= 180)) {
+        return Fail("geopoint out of range");
+      }
+      *out = FieldValue::GeoPoint(firebase::GeoPoint(latitude, longitude));
+    } else if (tag == "$map" && body.is_map()) {
+      MapFieldValue map;
+      for (const auto& entry : body.map_value()) {
+        if (!ParseValue(entry.second, &map[entry.first])) return false;
+      }
+      *out = FieldValue::Map(std::move(map));
+    } else {
+      return Fail("unknown value type " + tag);
+    }
+    return true;
+  }
+
+  // The elements of `value`, or none if it isn't an array.
+  static std::vector<FieldValue> Elements(const FieldValue& value) {
+    return value.is_array() ? value.array_value() : std::vector<FieldValue>();
+  }
+
+  static bool IsNumber(const FieldValue& value) {
+    return value.is_integer() || value.is_double();
+  }
+
+  // Whether `path` names a document: an even number of non-empty segments.
+  static bool IsDocumentPath(const std::string& path) {
+    size_t segments = 0;
+    size_t start = 0;
+    while (start <= path.size()) {
+      size_t end = std::min(path.find('/', start), path.size());
+      if (end == start) return false;
+      ++segments;
+      start = end + 1;
+    }
+    return segments % 2 == 0;
+  }
+
+  static double Number(const FieldValue& value) {
+    if (value.is_integer()) {
+      return static_cast<double>(value.integer_value());
+    }
+    return value.is_double() ? value.double_value() : 0;
+  }
+
+  bool Fail(const std::string& message) {
+    *error_message_ = message;
+    return false;
+  }
+
+  Firestore* db_;
+  std::string* error_message_;
+};
+
+}  // namespace
+
+std::string QuerySpecToJson(const QuerySpec& spec) {
+  std::string out = spec.is_collection_group() ? "{\"collection_group\":"
+                                               : "{\"collection\":";
+  AppendJsonString(spec.path(), &out);
+
+  if (!spec.filters().empty()) {
+    out.append(",\"where\":[");
+    for (size_t i = 0; i < spec.filters().size(); ++i) {
+      const QuerySpec::Filter& filter = spec.filters()[i];
+      const OperatorName* op = std::find_if(
+          std::begin(kOperatorNames), std::end(kOperatorNames),
+          [&filter](const OperatorName& entry) {
+            return entry.op == filter.op;
+          });
+      if (i > 0) out.push_back(',');
+      out.push_back('[');
+      AppendJsonString(filter.field, &out);
+      out.append(",\"");
+      out.append(op->name);
+      out.append("\",");
+      AppendArray(filter.values, &out);
+      out.push_back(']');
+    }
+    out.push_back(']');
+  }
+
+  if (!spec.orders().empty()) {
+    out.append(",\"order_by\":[");
+    for (size_t i = 0; i < spec.orders().size(); ++i) {
+      const QuerySpec::Order& order = spec.orders()[i];
+      if (i > 0) out.push_back(',');
+      out.push_back('[');
+      AppendJsonString(order.field, &out);
+      out.append(order.direction == Query::Direction::kAscending
+                     ? ",\"asc\"]"
+                     : ",\"desc\"]");
+    }
+    out.push_back(']');
+  }
+
+  if (spec.limit() > 0) {
+    out.append(",\"limit\":");
+    out.append(std::to_string(spec.limit()));
+  }
+
+  switch (spec.start_bound()) {
+    case QuerySpec::Bound::kStartAt:
+      out.append(",\"start_at\":");
+      AppendArray(spec.start_values(), &out);
+      break;
+    case QuerySpec::Bound::kStartAfter:
+      out.append(",\"start_after\":");
+      AppendArray(spec.start_values(), &out);
+      break;
+    default:
+      break;
+  }
+  switch (spec.end_bound()) {
+    case QuerySpec::Bound::kEndAt:
+      out.append(",\"end_at\":");
+      AppendArray(spec.end_values(), &out);
+      break;
+    case QuerySpec::Bound::kEndBefore:
+      out.append(",\"end_before\":");
+      AppendArray(spec.end_values(), &out);
+      break;
+    default:
+      break;
+  }
+  out.push_back('}');
+  return out;
+}
+
+bool ParseQuerySpecJson(Firestore* db, const std::string& json, QuerySpec* out,
+                        std::string* error_message) {
+  FieldValue value;
+  if (!ParseJson(json, &value, error_message)) {
+    return false;
+  }
+  return SpecParser(db, error_message).ParseSpec(value, out);
+}
+
+}  // namespace snippets
@@ -0,0 +1,46 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_QUERY_SPEC_JSON_H
+#define FIRESTORESNIPPETSCPP_QUERY_SPEC_JSON_H
+
+#include <string>
+
+#include "firebase/firestore.h"
+#include "query_spec.h"
+
+namespace snippets {
+
+// Serializes `spec` as a single line of JSON, e.g.
+//
+//   {"collection":"cities","where":[["capital","==",[true]]]}
+//
+// Values that JSON can't express are written as single-key objects:
+// {"$double":"NaN"}, {"$timestamp":[seconds,nanos]}, {"$bytes":"<hex>"},
+// {"$reference":"<path>"} and {"$geopoint":[latitude,longitude]}. Maps are
+// written as {"$map":{...}}, so that they can't be mistaken for these.
+std::string QuerySpecToJson(const QuerySpec& spec);
+
+// Parses the output of `QuerySpecToJson()`. `db` is needed to rebuild
+// reference values. Returns false and fills in `error_message` if `json` is
+// not a valid query.
+bool ParseQuerySpecJson(firebase::firestore::Firestore* db,
+                        const std::string& json, QuerySpec* out,
+                        std::string* error_message);
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_QUERY_SPEC_JSON_H
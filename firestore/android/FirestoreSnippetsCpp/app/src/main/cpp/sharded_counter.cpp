@@ -0,0 +1,211 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "sharded_counter.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace snippets {
+
+using firebase::Future;
+using firebase::firestore::CollectionReference;
+using firebase::firestore::DocumentReference;
+using firebase::firestore::DocumentSnapshot;
+using firebase::firestore::Error;
+using firebase::firestore::FieldValue;
+using firebase::firestore::QuerySnapshot;
+using firebase::firestore::SetOptions;
+using firebase::firestore::Source;
+using firebase::firestore::WriteBatch;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Firestore rejects batches with more writes than this.
+constexpr int kMaxBatchWrites = 500;
+
+int64_t ShardValue(const FieldValue& value) {
+  if (value.is_integer()) {
+    return value.integer_value();
+  }
+  if (value.is_double()) {
+    return static_cast<int64_t>(value.double_value());
+  }
+  return 0;
+}
+
+}  // namespace
+
+struct ShardedCounter::State {
+  DocumentReference counter;
+  CollectionReference shards;
+  ShardedCounterOptions options;
+
+  std::mutex mutex;
+  std::mt19937 rng{std::random_device{}()};
+  bool cached = false;
+  int64_t cached_count = 0;
+  Clock::time_point cached_at;
+  // Bumped whenever an increment starts or finishes, or the cache is
+  // dropped. A shard read only replaces the cached sum if nothing changed
+  // while it ran, since it may or may not include increments in flight,
+  // and those are added to the cached sum when they complete.
+  uint64_t generation = 0;
+  int pending_increments = 0;
+};
+
+ShardedCounter::ShardedCounter(DocumentReference counter,
+                               ShardedCounterOptions options)
+    : state_(std::make_shared<State>()) {
+  state_->counter = counter;
+  state_->shards = counter.Collection("shards");
+  state_->options = std::move(options);
+  state_->options.num_shards = std::max(1, state_->options.num_shards);
+}
+
+DocumentReference ShardedCounter::shard(int index) const {
+  return state_->shards.Document(std::to_string(index));
+}
+
+void ShardedCounter::Initialize(WriteCallback callback) {
+  const ShardedCounterOptions& options = state_->options;
+  std::vector<WriteBatch> batches(1, state_->counter.firestore()->batch());
+  batches.back().Set(state_->counter,
+                     {{"num_shards", FieldValue::Integer(options.num_shards)}},
+                     SetOptions::Merge());
+  // Incrementing by zero creates a missing shard at zero and leaves an
+  // existing one alone.
+  for (int i = 0; i < options.num_shards; ++i) {
+    if ((i + 1) % kMaxBatchWrites == 0) {
+      batches.push_back(state_->counter.firestore()->batch());
+    }
+    batches.back().Set(shard(i), {{options.field, FieldValue::Increment(0)}},
+                       SetOptions::Merge());
+  }
+
+  // The batches commit in parallel; `callback` gets the first error once
+  // all of them have finished.
+  struct Progress {
+    std::mutex mutex;
+    size_t pending = 0;
+    Error error = Error::kErrorOk;
+    std::string error_message;
+  };
+  auto progress = std::make_shared<Progress>();
+  progress->pending = batches.size();
+  for (WriteBatch& batch : batches) {
+    batch.Commit().OnCompletion(
+        [progress, callback](const Future<void>& future) {
+          Error error;
+          std::string error_message;
+          {
+            std::lock_guard<std::mutex> lock(progress->mutex);
+            if (progress->error == Error::kErrorOk &&
+                future.error() != Error::kErrorOk) {
+              progress->error = static_cast<Error>(future.error());
+              progress->error_message = future.error_message();
+            }
+            if (--progress->pending > 0) return;
+            error = progress->error;
+            error_message = progress->error_message;
+          }
+          callback(error, error_message);
+        });
+  }
+}
+
+void ShardedCounter::Increment(int64_t delta, WriteCallback callback) {
+  int index;
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    std::uniform_int_distribution<int> pick(0, state_->options.num_shards - 1);
+    index = pick(state_->rng);
+    ++state_->pending_increments;
+    ++state_->generation;
+  }
+
+  std::shared_ptr<State> state = state_;
+  shard(index)
+      .Set({{state->options.field, FieldValue::Increment(delta)}},
+           SetOptions::Merge())
+      .OnCompletion([state, delta, callback](const Future<void>& future) {
+        Error error = static_cast<Error>(future.error());
+        {
+          std::lock_guard<std::mutex> lock(state->mutex);
+          --state->pending_increments;
+          ++state->generation;
+          if (error == Error::kErrorOk) {
+            state->cached_count += delta;
+          }
+        }
+        callback(error, future.error_message());
+      });
+}
+
+void ShardedCounter::GetCount(Source source, CountCallback callback) {
+  uint64_t generation;
+  bool cacheable;
+  {
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    if (state_->cached &&
+        Clock::now() - state_->cached_at < state_->options.cache_ttl) {
+      int64_t count = state_->cached_count;
+      lock.unlock();
+      callback(count, Error::kErrorOk, "");
+      return;
+    }
+    generation = state_->generation;
+    cacheable = state_->pending_increments == 0;
+  }
+
+  std::shared_ptr<State> state = state_;
+  state->shards.Get(source).OnCompletion(
+      [state, generation, cacheable,
+       callback](const Future<QuerySnapshot>& future) {
+        Error error = static_cast<Error>(future.error());
+        if (error != Error::kErrorOk) {
+          callback(0, error, future.error_message());
+          return;
+        }
+        int64_t count = 0;
+        for (const DocumentSnapshot& shard : future.result()->documents()) {
+          count += ShardValue(shard.Get(state->options.field));
+        }
+        {
+          std::lock_guard<std::mutex> lock(state->mutex);
+          if (cacheable && state->generation == generation) {
+            state->cached = true;
+            state->cached_count = count;
+            state->cached_at = Clock::now();
+          }
+        }
+        callback(count, Error::kErrorOk, "");
+      });
+}
+
+void ShardedCounter::Invalidate() {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  state_->cached = false;
+  ++state_->generation;
+}
+
+}  // namespace snippets
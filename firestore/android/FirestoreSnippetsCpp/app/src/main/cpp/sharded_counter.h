@@ -0,0 +1,94 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_SHARDED_COUNTER_H
+#define FIRESTORESNIPPETSCPP_SHARDED_COUNTER_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "firebase/firestore.h"
+
+namespace snippets {
+
+struct ShardedCounterOptions {
+  // Number of shard documents that increments are spread over. Each shard
+  // sustains roughly one write per second, so this bounds the write rate.
+  int num_shards = 10;
+
+  // Integer field holding the count in each shard.
+  std::string field = "count";
+
+  // How long a sum read from the shards is served by `GetCount()` before the
+  // shards are read again.
+  std::chrono::milliseconds cache_ttl{5000};
+};
+
+// A counter that can take many more writes than a single document.
+//
+// Increments go to one of `num_shards` documents in the `shards` subcollection
+// of `counter`, picked at random, as a `FieldValue::Increment()` so that they
+// never conflict. The value is the sum of all shards, which `GetCount()`
+// caches for `cache_ttl`; increments made through this object are added to
+// the cached sum, so a client always sees its own writes. A read that
+// overlaps one of those increments is returned but not cached, so the cached
+// sum never double-counts or loses them.
+//
+// Reads sum every shard that exists, so `num_shards` can be changed between
+// runs without losing counts.
+//
+// Thread-safe. Callbacks run on the thread that completes the underlying
+// Firestore operation.
+class ShardedCounter {
+ public:
+  using WriteCallback =
+      std::function<void(firebase::firestore::Error, const std::string&)>;
+  using CountCallback = std::function<void(
+      int64_t count, firebase::firestore::Error, const std::string&)>;
+
+  explicit ShardedCounter(
+      firebase::firestore::DocumentReference counter,
+      ShardedCounterOptions options = ShardedCounterOptions());
+
+  // Records `num_shards` in the counter document and creates any missing
+  // shard at zero. Existing counts are kept. Optional: `Increment()` creates
+  // shards on demand. Writes go in batches of at most 500, so many shards
+  // take several commits, and a failure may leave some shards created.
+  void Initialize(WriteCallback callback);
+
+  void Increment(int64_t delta, WriteCallback callback);
+
+  // Calls `callback` with the cached sum if it is fresh, and otherwise reads
+  // all shards from `source`.
+  void GetCount(firebase::firestore::Source source, CountCallback callback);
+
+  // Drops the cached sum, so that the next `GetCount()` reads the shards.
+  void Invalidate();
+
+  firebase::firestore::DocumentReference shard(int index) const;
+
+ private:
+  struct State;
+
+  std::shared_ptr<State> state_;
+};
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_SHARDED_COUNTER_H
@@ -0,0 +1,159 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "sharded_counter_benchmark.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "benchmark_util.h"
+#include "sharded_counter.h"
+
+namespace snippets {
+
+using firebase::firestore::CollectionReference;
+using firebase::firestore::Error;
+using firebase::firestore::Source;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct RunState {
+  std::shared_ptr<ShardedCounter> counter;
+
+  std::mutex mutex;
+  std::condition_variable done;
+  int writers_running = 0;
+  int64_t increments = 0;
+  int64_t failed = 0;
+  std::vector<std::chrono::microseconds> latencies;
+};
+
+void RunIncrement(std::shared_ptr<RunState> state, int remaining) {
+  if (remaining == 0) {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (--state->writers_running == 0) {
+      state->done.notify_all();
+    }
+    return;
+  }
+
+  Clock::time_point start = Clock::now();
+  state->counter->Increment(
+      1, [state, remaining, start](Error error, const std::string&) {
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+            Clock::now() - start);
+        {
+          std::lock_guard<std::mutex> lock(state->mutex);
+          if (error == Error::kErrorOk) {
+            ++state->increments;
+          } else {
+            ++state->failed;
+          }
+          state->latencies.push_back(latency);
+        }
+        RunIncrement(state, remaining - 1);
+      });
+}
+
+// Returns -1 if the shards can't be read.
+int64_t ReadCount(ShardedCounter& counter) {
+  auto count = std::make_shared<std::promise<int64_t>>();
+  counter.Invalidate();
+  counter.GetCount(Source::kServer,
+                   [count](int64_t value, Error error, const std::string&) {
+                     count->set_value(error == Error::kErrorOk ? value : -1);
+                   });
+  return count->get_future().get();
+}
+
+ShardedCounterBenchmarkResult RunWithShards(
+    const CollectionReference& parent, int num_shards,
+    const ShardedCounterBenchmarkOptions& options) {
+  ShardedCounterOptions counter_options;
+  counter_options.num_shards = num_shards;
+  auto state = std::make_shared<RunState>();
+  state->counter = std::make_shared<ShardedCounter>(
+      parent.Document("sharded_" + std::to_string(num_shards)),
+      counter_options);
+
+  ShardedCounterBenchmarkResult result;
+  result.num_shards = num_shards;
+
+  // Counts from earlier runs are kept, so only the difference is checked.
+  std::promise<void> initialized;
+  state->counter->Initialize([&initialized, &result](
+                                 Error error, const std::string& message) {
+    result.error = error;
+    result.error_message = message;
+    initialized.set_value();
+  });
+  initialized.get_future().wait();
+  if (result.error != Error::kErrorOk) {
+    return result;
+  }
+  int64_t before = ReadCount(*state->counter);
+
+  int writers = std::max(1, options.writers);
+  state->writers_running = writers;
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < writers; ++i) {
+    RunIncrement(state, std::max(0, options.increments_per_writer));
+  }
+
+  std::vector<std::chrono::microseconds> latencies;
+  {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done.wait(lock, [&state] { return state->writers_running == 0; });
+    result.increments = state->increments;
+    result.failed = state->failed;
+    latencies = std::move(state->latencies);
+  }
+  result.elapsed_seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::sort(latencies.begin(), latencies.end());
+  result.p50_latency = Percentile(latencies, 0.50);
+  result.p99_latency = Percentile(latencies, 0.99);
+
+  int64_t after = ReadCount(*state->counter);
+  if (before >= 0 && after >= 0 && after - before != result.increments) {
+    std::cout << "Warning: counter with " << num_shards << " shards grew by "
+              << after - before << " but " << result.increments
+              << " increments succeeded" << std::endl;
+  }
+  return result;
+}
+
+}  // namespace
+
+std::vector<ShardedCounterBenchmarkResult> RunShardedCounterBenchmark(
+    const CollectionReference& parent, ShardedCounterBenchmarkOptions options) {
+  std::vector<ShardedCounterBenchmarkResult> results;
+  for (int num_shards : options.shard_counts) {
+    results.push_back(RunWithShards(parent, num_shards, options));
+  }
+  return results;
+}
+
+}  // namespace snippets
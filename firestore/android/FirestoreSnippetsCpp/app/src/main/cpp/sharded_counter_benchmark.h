@@ -0,0 +1,74 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_SHARDED_COUNTER_BENCHMARK_H
+#define FIRESTORESNIPPETSCPP_SHARDED_COUNTER_BENCHMARK_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "firebase/firestore.h"
+
+namespace snippets {
+
+struct ShardedCounterBenchmarkOptions {
+  // Shard counts to measure, one run each.
+  std::vector<int> shard_counts = {1, 2, 4, 8, 16};
+
+  // Number of writers running at the same time. Each sends its increments
+  // one after another.
+  int writers = 16;
+  int increments_per_writer = 20;
+};
+
+struct ShardedCounterBenchmarkResult {
+  int num_shards = 0;
+  // Set if the counter couldn't be initialized, in which case no increments
+  // were attempted.
+  firebase::firestore::Error error = firebase::firestore::Error::kErrorOk;
+  std::string error_message;
+  int64_t increments = 0;
+  int64_t failed = 0;
+  double elapsed_seconds = 0;
+
+  std::chrono::microseconds p50_latency{0};
+  std::chrono::microseconds p99_latency{0};
+
+  double increments_per_second() const {
+    return elapsed_seconds > 0 ? increments / elapsed_seconds : 0;
+  }
+};
+
+// Measures how increment throughput scales with the number of shards. For
+// each entry of `shard_counts`, a fresh counter `sharded_<n>` is created in
+// `parent` and `writers` concurrent writers increment it, and the sum is
+// checked against the number of successful increments.
+//
+// Per-document write limits are enforced by the production backend, not by
+// the emulator, and are only reached with many clients; run it from several
+// devices at once for numbers that reflect a hot document.
+//
+// Blocks until every run has finished, so it must not be called from a
+// Firestore callback.
+std::vector<ShardedCounterBenchmarkResult> RunShardedCounterBenchmark(
+    const firebase::firestore::CollectionReference& parent,
+    ShardedCounterBenchmarkOptions options = ShardedCounterBenchmarkOptions());
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_SHARDED_COUNTER_BENCHMARK_H
@@ -0,0 +1,303 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "snapshot_throttle.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace snippets {
+
+using firebase::firestore::DocumentChange;
+using firebase::firestore::DocumentSnapshot;
+using firebase::firestore::Error;
+using firebase::firestore::MetadataChanges;
+using firebase::firestore::QuerySnapshot;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+}  // namespace
+
+// Everything in a channel is guarded by the state's mutex.
+struct SnapshotThrottle::Channel {
+  virtual ~Channel() = default;
+
+  // Clears the held-back events and returns a function that delivers them,
+  // or null if there are none. `*calls` is set to the number of callbacks
+  // the function makes.
+  virtual std::function<void()> TakePending(int* calls) = 0;
+
+  bool scheduled = false;
+  Clock::time_point scheduled_for;
+  bool has_delivered = false;
+  Clock::time_point last_delivery;
+
+  bool has_error = false;
+  Error error = Error::kErrorOk;
+  std::string error_message;
+};
+
+struct SnapshotThrottle::DocumentChannel : Channel {
+  std::function<void()> TakePending(int* calls) override {
+    *calls = (has_snapshot ? 1 : 0) + (has_error ? 1 : 0);
+    if (*calls == 0) return nullptr;
+
+    std::function<void()> deliver = [this_callback = callback,
+                                     has_snapshot = has_snapshot,
+                                     snapshot = std::move(snapshot),
+                                     has_error = has_error, error = error,
+                                     error_message = error_message] {
+      if (has_snapshot) this_callback(snapshot, Error::kErrorOk, "");
+      if (has_error) this_callback(DocumentSnapshot(), error, error_message);
+    };
+    has_snapshot = false;
+    snapshot = DocumentSnapshot();
+    has_error = false;
+    return deliver;
+  }
+
+  DocumentCallback callback;
+  bool has_snapshot = false;
+  DocumentSnapshot snapshot;
+};
+
+struct SnapshotThrottle::QueryChannel : Channel {
+  // Folds the changes of `next` into the ones held back so far.
+  void Merge(const QuerySnapshot& next) {
+    for (const DocumentChange& change :
+         next.DocumentChanges(metadata_changes)) {
+      DocumentSnapshot document = change.document();
+      // Keyed by path, as a collection group query can return several
+      // documents with the same ID.
+      std::string key = document.reference().path();
+      auto found = changes.find(key);
+      if (found == changes.end()) {
+        order.push_back(key);
+        changes.emplace(std::move(key),
+                        CoalescedChange{change.type(), std::move(document)});
+        continue;
+      }
+
+      CoalescedChange& merged = found->second;
+      switch (change.type()) {
+        case DocumentChange::Type::kAdded:
+          // Removed and then added again is, overall, a modification.
+          merged.type = merged.type == DocumentChange::Type::kRemoved
+                            ? DocumentChange::Type::kModified
+                            : DocumentChange::Type::kAdded;
+          break;
+        case DocumentChange::Type::kModified:
+          // Added and then modified is still an addition.
+          break;
+        case DocumentChange::Type::kRemoved:
+          if (merged.type == DocumentChange::Type::kAdded) {
+            // Never seen by the callback; nothing to report.
+            changes.erase(found);
+            continue;
+          }
+          merged.type = DocumentChange::Type::kRemoved;
+          break;
+      }
+      merged.document = std::move(document);
+    }
+    has_snapshot = true;
+    snapshot = next;
+  }
+
+  std::function<void()> TakePending(int* calls) override {
+    *calls = (has_snapshot ? 1 : 0) + (has_error ? 1 : 0);
+    if (*calls == 0) return nullptr;
+
+    std::vector<CoalescedChange> merged;
+    merged.reserve(changes.size());
+    for (const std::string& key : order) {
+      // A key appears in `order` more than once if its document was added,
+      // removed and added again; only the first occurrence finds it.
+      auto found = changes.find(key);
+      if (found == changes.end()) continue;
+      merged.push_back(std::move(found->second));
+      changes.erase(found);
+    }
+
+    std::function<void()> deliver = [this_callback = callback,
+                                     has_snapshot = has_snapshot,
+                                     snapshot = std::move(snapshot),
+                                     merged = std::move(merged),
+                                     has_error = has_error, error = error,
+                                     error_message = error_message] {
+      if (has_snapshot) this_callback(snapshot, merged, Error::kErrorOk, "");
+      if (has_error) this_callback(QuerySnapshot(), {}, error, error_message);
+    };
+    has_snapshot = false;
+    snapshot = QuerySnapshot();
+    changes.clear();
+    order.clear();
+    has_error = false;
+    return deliver;
+  }
+
+  QueryCallback callback;
+  MetadataChanges metadata_changes = MetadataChanges::kExclude;
+  bool has_snapshot = false;
+  QuerySnapshot snapshot;
+  std::unordered_map<std::string, CoalescedChange> changes;
+  std::vector<std::string> order;
+};
+
+struct SnapshotThrottle::State {
+  explicit State(std::chrono::milliseconds window) : window(window) {}
+
+  const std::chrono::milliseconds window;
+
+  mutable std::mutex mutex;
+  std::condition_variable cv;
+  bool stopping = false;
+  // Channels by the time their held-back events are due. A channel can have
+  // more than one entry if an error moved its delivery forward; the later
+  // entries then find nothing to deliver.
+  std::multimap<Clock::time_point, std::weak_ptr<Channel>> due;
+  SnapshotThrottleStats stats;
+};
+
+SnapshotThrottle::SnapshotThrottle(std::chrono::milliseconds window)
+    : state_(std::make_shared<State>(window)), timer_(RunTimer, state_) {}
+
+SnapshotThrottle::~SnapshotThrottle() {
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->stopping = true;
+  }
+  state_->cv.notify_all();
+  timer_.join();
+}
+
+SnapshotThrottle::DocumentCallback SnapshotThrottle::WrapDocumentListener(
+    DocumentCallback callback) {
+  auto channel = std::make_shared<DocumentChannel>();
+  channel->callback = std::move(callback);
+  std::weak_ptr<State> weak_state = state_;
+
+  return [weak_state, channel](const DocumentSnapshot& snapshot, Error error,
+                               const std::string& error_message) {
+    std::shared_ptr<State> state = weak_state.lock();
+    if (!state) return;
+
+    std::lock_guard<std::mutex> lock(state->mutex);
+    ++state->stats.received;
+    if (error == Error::kErrorOk) {
+      channel->has_snapshot = true;
+      channel->snapshot = snapshot;
+    } else {
+      channel->has_error = true;
+      channel->error = error;
+      channel->error_message = error_message;
+    }
+    Schedule(state.get(), channel);
+  };
+}
+
+SnapshotThrottle::QueryListener SnapshotThrottle::WrapQueryListener(
+    QueryCallback callback, MetadataChanges metadata_changes) {
+  auto channel = std::make_shared<QueryChannel>();
+  channel->callback = std::move(callback);
+  channel->metadata_changes = metadata_changes;
+  std::weak_ptr<State> weak_state = state_;
+
+  return [weak_state, channel](const QuerySnapshot& snapshot, Error error,
+                               const std::string& error_message) {
+    std::shared_ptr<State> state = weak_state.lock();
+    if (!state) return;
+
+    std::lock_guard<std::mutex> lock(state->mutex);
+    ++state->stats.received;
+    if (error == Error::kErrorOk) {
+      channel->Merge(snapshot);
+    } else {
+      channel->has_error = true;
+      channel->error = error;
+      channel->error_message = error_message;
+    }
+    Schedule(state.get(), channel);
+  };
+}
+
+SnapshotThrottleStats SnapshotThrottle::stats() const {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  return state_->stats;
+}
+
+// Requires the state's mutex.
+void SnapshotThrottle::Schedule(State* state,
+                                const std::shared_ptr<Channel>& channel) {
+  Clock::time_point now = Clock::now();
+  Clock::time_point when = now;
+  if (!channel->has_error && channel->has_delivered) {
+    when = std::max(now, channel->last_delivery + state->window);
+  }
+  if (channel->scheduled && channel->scheduled_for <= when) return;
+
+  channel->scheduled = true;
+  channel->scheduled_for = when;
+  bool earliest = state->due.empty() || when < state->due.begin()->first;
+  state->due.emplace(when, channel);
+  if (earliest) {
+    state->cv.notify_one();
+  }
+}
+
+void SnapshotThrottle::RunTimer(std::shared_ptr<State> state) {
+  std::unique_lock<std::mutex> lock(state->mutex);
+  while (!state->stopping) {
+    if (state->due.empty()) {
+      state->cv.wait(lock);
+      continue;
+    }
+    Clock::time_point now = Clock::now();
+    auto first = state->due.begin();
+    if (first->first > now) {
+      state->cv.wait_until(lock, first->first);
+      continue;
+    }
+
+    std::shared_ptr<Channel> channel = first->second.lock();
+    state->due.erase(first);
+    if (!channel) continue;
+
+    int calls = 0;
+    std::function<void()> deliver = channel->TakePending(&calls);
+    channel->scheduled = false;
+    if (!deliver) continue;
+    channel->has_delivered = true;
+    channel->last_delivery = now;
+    state->stats.delivered += calls;
+
+    lock.unlock();
+    deliver();
+    // The listener may have been removed meanwhile; if so, its callback is
+    // destroyed here, outside the lock.
+    deliver = nullptr;
+    channel.reset();
+    lock.lock();
+  }
+}
+
+}  // namespace snippets
@@ -0,0 +1,113 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_SNAPSHOT_THROTTLE_H
+#define FIRESTORESNIPPETSCPP_SNAPSHOT_THROTTLE_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "firebase/firestore.h"
+
+namespace snippets {
+
+// The net effect on one document of all the `DocumentChange`s in a burst.
+// `document` is the latest version seen; for `kRemoved` it is the version
+// before removal.
+struct CoalescedChange {
+  firebase::firestore::DocumentChange::Type type;
+  firebase::firestore::DocumentSnapshot document;
+};
+
+struct SnapshotThrottleStats {
+  // Snapshots received from Firestore, and callbacks actually made.
+  int64_t received = 0;
+  int64_t delivered = 0;
+};
+
+// Collapses bursts of snapshots so that each wrapped listener is called at
+// most once per `window`.
+//
+// A hot document, or any listener with `MetadataChanges::kInclude`, can
+// produce many events per second. A wrapped listener receives the first
+// event of a quiet period right away; events that arrive within `window` of
+// the previous delivery are held back, and only the most recent one is
+// delivered when the window ends.
+//
+// For query listeners the `DocumentChange`s of the skipped snapshots are
+// merged, so the callback sees the net change since its previous call: a
+// document added and then modified is reported as added, one added and then
+// removed is not reported at all, and so on. Changes come in the order each
+// document first changed. The merged changes carry no indexes; use
+// `snapshot.documents()` for positions.
+//
+// All callbacks run on the throttle's own thread, one at a time, so they
+// never block the SDK's callback thread. Errors are delivered without delay,
+// after any held-back snapshot. The destructor discards held-back events;
+// wrapped listeners may outlive the throttle and then receive nothing.
+class SnapshotThrottle {
+ public:
+  using DocumentCallback =
+      std::function<void(const firebase::firestore::DocumentSnapshot&,
+                         firebase::firestore::Error, const std::string&)>;
+  using QueryCallback = std::function<void(
+      const firebase::firestore::QuerySnapshot& snapshot,
+      const std::vector<CoalescedChange>& changes,
+      firebase::firestore::Error, const std::string&)>;
+  using QueryListener =
+      std::function<void(const firebase::firestore::QuerySnapshot&,
+                         firebase::firestore::Error, const std::string&)>;
+
+  explicit SnapshotThrottle(std::chrono::milliseconds window);
+  ~SnapshotThrottle();
+
+  SnapshotThrottle(const SnapshotThrottle&) = delete;
+  SnapshotThrottle& operator=(const SnapshotThrottle&) = delete;
+
+  // Returns a callback for `DocumentReference::AddSnapshotListener()`.
+  DocumentCallback WrapDocumentListener(DocumentCallback callback);
+
+  // Returns a callback for `Query::AddSnapshotListener()`. Pass the same
+  // `metadata_changes` as to `AddSnapshotListener()`, so that metadata-only
+  // changes are included in `changes` when they are requested.
+  QueryListener WrapQueryListener(
+      QueryCallback callback,
+      firebase::firestore::MetadataChanges metadata_changes =
+          firebase::firestore::MetadataChanges::kExclude);
+
+  SnapshotThrottleStats stats() const;
+
+ private:
+  struct Channel;
+  struct DocumentChannel;
+  struct QueryChannel;
+  struct State;
+
+  static void Schedule(State* state, const std::shared_ptr<Channel>& channel);
+  static void RunTimer(std::shared_ptr<State> state);
+
+  std::shared_ptr<State> state_;
+  std::thread timer_;
+};
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_SNAPSHOT_THROTTLE_H
@@ -14,11 +14,47 @@
 //  limitations under the License.
 //
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <sstream>
 #include <string>
-
+#include <utility>
+#include <vector>
+
+#include "batched_get.h"
+#include "bulk_loader.h"
+#include "bundle_benchmark.h"
+#include "bundle_builder.h"
+#include "cache_first_reader.h"
+#include "callback_executor.h"
+#include "collection_group_fanout.h"
+#include "column_batch.h"
+#include "document_coalescer.h"
+#include "future_then.h"
+#include "future_combinators.h"
+#include "listener_hub.h"
+#include "listener_registry.h"
+#include "live_query_view.h"
+#include "local_aggregation.h"
+#include "ordered_merge.h"
+#include "paged_scan.h"
+#include "partitioned_scan.h"
+#include "query_cache.h"
+#include "query_evaluator.h"
+#include "query_planner.h"
+#include "query_spec.h"
+#include "sharded_counter.h"
+#include "sharded_counter_benchmark.h"
+#include "snapshot_throttle.h"
 #include "snippets.h"
+#include "streaming_bundle_loader.h"
+#include "transaction_benchmark.h"
+#include "transaction_retry.h"
+#include "warmup_planner.h"
 #include "firebase/app.h"
 #include "firebase/auth.h"
 #include "firebase/auth/user.h"
@@ -376,6 +412,86 @@ void AddDataTransactions(firebase::firestore::Firestore* db) {
   // [END simple_transaction]
 }
 
+void AddDataTransactionsWithBackoff(firebase::firestore::Firestore* db) {
+  using firebase::firestore::DocumentReference;
+  using firebase::firestore::DocumentSnapshot;
+  using firebase::firestore::Error;
+  using firebase::firestore::FieldValue;
+  using firebase::firestore::Transaction;
+
+  // When many clients update the same document, their transactions keep
+  // conflicting. TransactionRunner retries them after a jittered delay that
+  // grows with contention; counters can skip the transaction altogether:
+  // [START transaction_with_backoff]
+  DocumentReference sf_doc_ref = db->Collection("cities").Document("SF");
+  TransactionRunner runner(db);
+
+  runner.Run(
+      [sf_doc_ref](Transaction& transaction,
+                   std::string& out_error_message) -> Error {
+        Error error = Error::kErrorOk;
+        DocumentSnapshot snapshot =
+            transaction.Get(sf_doc_ref, &error, &out_error_message);
+        if (error != Error::kErrorOk) {
+          return error;
+        }
+        std::int64_t new_population =
+            snapshot.Get("population").integer_value() + 1;
+        transaction.Update(
+            sf_doc_ref, {{"population", FieldValue::Integer(new_population)}});
+        return Error::kErrorOk;
+      },
+      [](Error error, const std::string& error_message, int attempts) {
+        if (error == Error::kErrorOk) {
+          std::cout << "Transaction committed after " << attempts
+                    << " attempt(s)" << std::endl;
+        } else {
+          std::cout << "Transaction failure: " << error_message << std::endl;
+        }
+      });
+
+  runner.Increment(sf_doc_ref, "population", 1,
+                   [](Error error, const std::string& error_message, int) {
+                     if (error != Error::kErrorOk) {
+                       std::cout << "Increment failure: " << error_message
+                                 << std::endl;
+                     }
+                   });
+  // [END transaction_with_backoff]
+}
+
+// https://firebase.google.com/docs/firestore/solutions/counters
+void AddDataShardedCounter(firebase::firestore::Firestore* db) {
+  using firebase::firestore::Error;
+  using firebase::firestore::Source;
+
+  // A single document can only be updated about once per second. A counter
+  // that many clients update, such as a city's population, can be spread over
+  // several shard documents whose values are summed when read:
+  // [START sharded_counter]
+  ShardedCounterOptions options;
+  options.num_shards = 10;
+  options.field = "population";
+  ShardedCounter population(db->Collection("counters").Document("SF"),
+                            options);
+
+  population.Increment(1, [](Error error, const std::string& error_message) {
+    if (error != Error::kErrorOk) {
+      std::cout << "Increment failure: " << error_message << std::endl;
+    }
+  });
+
+  population.GetCount(Source::kDefault, [](std::int64_t count, Error error,
+                                           const std::string& error_message) {
+    if (error == Error::kErrorOk) {
+      std::cout << "Population: " << count << std::endl;
+    } else {
+      std::cout << "Error reading population: " << error_message << std::endl;
+    }
+  });
+  // [END sharded_counter]
+}
+
 // https://firebase.google.com/docs/firestore/manage-data/delete-data#delete_documents
 void AddDataDeleteDocuments(firebase::firestore::Firestore* db) {
   using firebase::Future;
@@ -543,6 +659,155 @@ void ReadDataSourceOptions(firebase::firestore::Firestore* db) {
   // [END get_document_options]
 }
 
+void ReadDataCacheFirst(firebase::firestore::Firestore* db) {
+  using firebase::firestore::DocumentSnapshot;
+  using firebase::firestore::Error;
+  using firebase::firestore::FieldValue;
+  using firebase::firestore::QuerySnapshot;
+
+  // Screens that must render immediately can read from the offline cache
+  // first, and update once fresher data arrives from the server. The
+  // strategy can be chosen per collection:
+  // [START get_cache_first]
+  ReadPolicy cities_policy;
+  cities_policy.strategy = ReadStrategy::kCacheFirst;
+  cities_policy.min_refresh_interval = std::chrono::seconds(60);
+
+  ReadPolicy default_policy;
+  default_policy.strategy = ReadStrategy::kServerFirst;
+
+  CacheFirstReader reader(db, default_policy);
+  reader.SetPolicy("cities", cities_policy);
+
+  reader.Get(
+      db->Collection("cities").Document("SF"),
+      [](const DocumentSnapshot& document, Error error,
+         const std::string& error_message) {
+        if (error == Error::kErrorOk) {
+          std::cout << "Showing " << document.id() << std::endl;
+        } else {
+          std::cout << "Get failed: " << error_message << std::endl;
+        }
+      },
+      [](const DocumentSnapshot& document, Error, const std::string&) {
+        std::cout << document.id() << " changed on the server" << std::endl;
+      });
+
+  reader.Get(
+      QuerySpec::Collection("cities").Where(
+          "capital", QuerySpec::Operator::kEqual, FieldValue::Boolean(true)),
+      [](const QuerySnapshot& snapshot, Error error, const std::string&) {
+        if (error == Error::kErrorOk) {
+          std::cout << "Showing " << snapshot.size() << " capitals"
+                    << std::endl;
+        }
+      },
+      [](const QuerySnapshot& snapshot, Error, const std::string&) {
+        std::cout << "Capitals changed, now " << snapshot.size() << std::endl;
+      });
+  // [END get_cache_first]
+}
+
+void ReadDataCoalescedGet(firebase::firestore::Firestore* db) {
+  using firebase::firestore::DocumentReference;
+  using firebase::firestore::DocumentSnapshot;
+  using firebase::firestore::Error;
+
+  // When several parts of an app read the same document at the same time,
+  // each Get() issues its own read. A DocumentCoalescer lets concurrent Get()s
+  // of one document share a single read, and optionally reuses the result for
+  // a short while afterwards.
+  // [START coalesced_get]
+  DocumentCoalescer coalescer(std::chrono::milliseconds(500));
+  DocumentReference doc_ref = db->Collection("cities").Document("SF");
+
+  for (int i = 0; i < 3; ++i) {
+    coalescer.Get(doc_ref, [](const DocumentSnapshot& document, Error error,
+                              const std::string& error_message) {
+      if (error == Error::kErrorOk) {
+        std::cout << "DocumentSnapshot id: " << document.id() << std::endl;
+      } else {
+        std::cout << "Get failed with: " << error_message << std::endl;
+      }
+    });
+  }
+  // [END coalesced_get]
+}
+
+void ReadDataGetAllDocuments(firebase::firestore::Firestore* db) {
+  using firebase::firestore::DocumentReference;
+  using firebase::firestore::DocumentSnapshot;
+  using firebase::firestore::Error;
+
+  // To read several documents whose IDs you already know, GetAll() fetches
+  // them with WhereIn() queries on the document ID instead of one Get() per
+  // document. The results come back in the order they were requested.
+  // [START get_all_documents]
+  std::vector<DocumentReference> refs = {
+      db->Collection("cities").Document("SF"),
+      db->Collection("cities").Document("LA"),
+      db->Collection("cities").Document("TOK"),
+  };
+  GetAll(refs, GetAllOptions(),
+         [](std::vector<DocumentSnapshot> documents, Error error,
+            const std::string& error_message) {
+           if (error != Error::kErrorOk) {
+             std::cout << "GetAll failed with: " << error_message << std::endl;
+             return;
+           }
+           for (const DocumentSnapshot& document : documents) {
+             if (document.is_valid()) {
+               std::cout << "DocumentSnapshot id: " << document.id()
+                         << std::endl;
+             } else {
+               std::cout << "no such document" << std::endl;
+             }
+           }
+         });
+  // [END get_all_documents]
+}
+
+void ReadDataJoinFutures(firebase::firestore::Firestore* db) {
+  using firebase::Future;
+  using firebase::firestore::DocumentSnapshot;
+  using firebase::firestore::Error;
+
+  // To act once several reads have finished, or on whichever finishes first,
+  // combine their futures instead of nesting OnCompletion() callbacks.
+  // [START join_futures]
+  std::vector<Future<DocumentSnapshot>> reads = {
+      db->Collection("cities").Document("SF").Get(),
+      db->Collection("cities").Document("LA").Get(),
+      db->Collection("cities").Document("DC").Get(),
+  };
+
+  WhenAll<Future<DocumentSnapshot>>(
+      reads, [](const std::vector<Future<DocumentSnapshot>>& done) {
+        for (const Future<DocumentSnapshot>& future : done) {
+          if (future.error() == Error::kErrorOk) {
+            std::cout << "Read " << future.result()->id() << std::endl;
+          }
+        }
+      });
+
+  WhenAny<Future<DocumentSnapshot>>(
+      reads, [](size_t index, const Future<DocumentSnapshot>& first) {
+        std::cout << "Read " << index << " finished first" << std::endl;
+      });
+
+  WithTimeout<Future<DocumentSnapshot>>(
+      db->Collection("cities").Document("BJ").Get(),
+      std::chrono::milliseconds(500),
+      [](const Future<DocumentSnapshot>& future, bool timed_out) {
+        if (timed_out) {
+          std::cout << "Still waiting for BJ after 500ms" << std::endl;
+        } else if (future.error() == Error::kErrorOk) {
+          std::cout << "Read " << future.result()->id() << std::endl;
+        }
+      });
+  // [END join_futures]
+}
+
 // https://firebase.google.com/docs/firestore/query-data/get-data#get_multiple_documents_from_a_collection
 void ReadDataGetMultipleDocumentsFromCollection(
     firebase::firestore::Firestore* db) {
@@ -599,6 +864,38 @@ void ReadDataGetAllDocumentsInCollection(firebase::firestore::Firestore* db) {
   // [END get_multiple_all]
 }
 
+void ReadDataColumnarAggregation(firebase::firestore::Firestore* db) {
+  using firebase::Future;
+  using firebase::firestore::Error;
+  using firebase::firestore::QuerySnapshot;
+
+  // To aggregate over many documents, convert the snapshot into a
+  // ColumnBatch once: each field becomes a contiguous typed array, and
+  // strings are dictionary-encoded so they can be grouped by code.
+  // [START columnar_aggregation]
+  db->Collection("cities").Get().OnCompletion(
+      [](const Future<QuerySnapshot>& future) {
+        if (future.error() != Error::kErrorOk) {
+          std::cout << "Error getting documents: " << future.error_message()
+                    << std::endl;
+          return;
+        }
+        ColumnBatch batch = ColumnBatch::FromSnapshot(
+            *future.result(), {"country", "population"});
+        const BatchColumn& country = *batch.column("country");
+        const BatchColumn& population = *batch.column("population");
+
+        std::cout << "Total population: " << SumColumn(population)
+                  << std::endl;
+        std::vector<double> by_country = SumByKey(country, population);
+        for (size_t i = 0; i < by_country.size(); ++i) {
+          std::cout << country.dictionary()[i] << ": " << by_country[i]
+                    << std::endl;
+        }
+      });
+  // [END columnar_aggregation]
+}
+
 // https://firebase.google.com/docs/firestore/query-data/listen
 void ReadDataListen(firebase::firestore::Firestore* db) {
   using firebase::firestore::DocumentReference;
@@ -626,6 +923,69 @@ void ReadDataListen(firebase::firestore::Firestore* db) {
   // [END listen_document]
 }
 
+void ReadDataListenOnExecutor(firebase::firestore::Firestore* db) {
+  using firebase::firestore::DocumentSnapshot;
+  using firebase::firestore::Error;
+
+  // Snapshot callbacks run on the SDK's callback thread, so a slow handler
+  // delays every other listener. Wrapping the handler moves it onto a worker
+  // pool with a bounded queue per listener.
+  // [START listen_on_executor]
+  // Usually one executor is shared by the whole app.
+  static CallbackExecutor executor(
+      CallbackExecutorOptions{/*worker_count=*/2,
+                              /*max_pending_per_listener=*/16,
+                              OverflowPolicy::kCoalesceLatest});
+
+  db->Collection("cities").Document("SF").AddSnapshotListener(
+      executor.Wrap<DocumentSnapshot>([](const DocumentSnapshot& snapshot,
+                                         Error error,
+                                         const std::string& errorMsg) {
+        if (error == Error::kErrorOk) {
+          // Runs on a worker thread; slow work here no longer holds up
+          // other listeners.
+          std::cout << "Current data: " << snapshot << std::endl;
+        } else {
+          std::cout << "Listen failed: " << error << std::endl;
+        }
+      }));
+
+  CallbackExecutorStats stats = executor.stats();
+  std::cout << "Queue depth: " << stats.queue_depth
+            << ", average handler time: "
+            << stats.average_handler_time().count() << "us" << std::endl;
+  // [END listen_on_executor]
+}
+
+void ReadDataGetOnExecutor(firebase::firestore::Firestore* db) {
+  using firebase::Future;
+  using firebase::firestore::DocumentSnapshot;
+  using firebase::firestore::Error;
+
+  // One-off reads can move their continuation off the SDK's callback thread
+  // too: ThenOn() runs it on any executor, such as a CallbackExecutor queue.
+  // [START get_on_executor]
+  static CallbackExecutor executor(
+      CallbackExecutorOptions{/*worker_count=*/2,
+                              /*max_pending_per_listener=*/16,
+                              OverflowPolicy::kCoalesceLatest});
+  uint64_t queue = executor.NewListener();
+  Executor on_worker = [queue](std::function<void()> task) {
+    executor.Post(queue, std::move(task));
+  };
+
+  ThenOn(db->Collection("cities").Document("SF").Get(), on_worker,
+         [](const Future<DocumentSnapshot>& future) {
+           if (future.error() == Error::kErrorOk) {
+             std::cout << "Document data: " << *future.result() << std::endl;
+           } else {
+             std::cout << "get failed with " << future.error_message()
+                       << std::endl;
+           }
+         });
+  // [END get_on_executor]
+}
+
 // https://firebase.google.com/docs/firestore/query-data/listen#events-local-changes
 void ReadDataEventsForLocalChanges(firebase::firestore::Firestore* db) {
   using firebase::firestore::DocumentReference;
@@ -694,6 +1054,47 @@ void ReadDataEventsForMetadataChanges(firebase::firestore::Firestore* db) {
   // [END listen_with_metadata]
 }
 
+void ReadDataThrottledListener(firebase::firestore::Firestore* db) {
+  using firebase::firestore::DocumentChange;
+  using firebase::firestore::Error;
+  using firebase::firestore::FieldValue;
+  using firebase::firestore::MetadataChanges;
+  using firebase::firestore::QuerySnapshot;
+
+  // With metadata changes included, a busy query can fire many events per
+  // second. A throttle collapses each burst into its latest snapshot, with the
+  // document changes of the whole burst merged, so the handler runs at most
+  // a few times per second.
+  // [START listen_throttled]
+  // Usually one throttle is shared by the whole app.
+  static SnapshotThrottle throttle(std::chrono::milliseconds(250));
+
+  db->Collection("cities")
+      .WhereEqualTo("state", FieldValue::String("CA"))
+      .AddSnapshotListener(
+          MetadataChanges::kInclude,
+          throttle.WrapQueryListener(
+              [](const QuerySnapshot& snapshot,
+                 const std::vector<CoalescedChange>& changes, Error error,
+                 const std::string& errorMsg) {
+                if (error != Error::kErrorOk) {
+                  std::cout << "Listen failed: " << error << std::endl;
+                  return;
+                }
+                for (const CoalescedChange& change : changes) {
+                  if (change.type == DocumentChange::Type::kRemoved) {
+                    std::cout << "Removed city: " << change.document.id()
+                              << std::endl;
+                  } else {
+                    std::cout << "Current city: " << change.document.id()
+                              << std::endl;
+                  }
+                }
+              },
+              MetadataChanges::kInclude));
+  // [END listen_throttled]
+}
+
 // https://firebase.google.com/docs/firestore/query-data/listen#listen_to_multiple_documents_in_a_collection
 void ReadDataListenToMultipleDocumentsInCollection(
     firebase::firestore::Firestore* db) {
@@ -765,6 +1166,54 @@ void ReadDataViewChangesBetweenSnapshots(firebase::firestore::Firestore* db) {
   // [END listen_diffs]
 }
 
+void ReadDataLiveQueryView(firebase::firestore::Firestore* db) {
+  using firebase::firestore::DocumentSnapshot;
+  using firebase::firestore::Error;
+  using firebase::firestore::FieldPath;
+  using firebase::firestore::FieldValue;
+  using firebase::firestore::Query;
+  using firebase::firestore::QuerySnapshot;
+
+  // Rather than walking every document of each snapshot, a listener can feed
+  // the changes into a view that keeps the decoded results indexed by ID and
+  // in query order.
+  // [START live_query_view]
+  struct City {
+    std::string name;
+    int64_t population = 0;
+  };
+  auto view = std::make_shared<LiveQueryView<City>>(
+      FieldPath{"population"}, Query::Direction::kDescending,
+      [](const DocumentSnapshot& document) {
+        City city;
+        city.name = document.Get("name").string_value();
+        city.population = document.Get("population").integer_value();
+        return city;
+      });
+
+  db->Collection("cities")
+      .WhereEqualTo("state", FieldValue::String("CA"))
+      .OrderBy("population", Query::Direction::kDescending)
+      .AddSnapshotListener([view](const QuerySnapshot& snapshot, Error error,
+                                  const std::string& errorMsg) {
+        if (error != Error::kErrorOk) {
+          std::cout << "Listen failed: " << error << std::endl;
+          return;
+        }
+        size_t changes = view->Apply(snapshot);
+        std::cout << changes << " change(s), " << view->size() << " cities"
+                  << std::endl;
+        if (const City* sf = view->Find("SF")) {
+          std::cout << "SF population: " << sf->population << std::endl;
+        }
+        view->ForEach([](const std::string& id, const City& city) {
+          std::cout << city.name << ": " << city.population << std::endl;
+          return true;
+        });
+      });
+  // [END live_query_view]
+}
+
 // https://firebase.google.com/docs/firestore/query-data/listen#detach_a_listener
 void ReadDataDetachListener(firebase::firestore::Firestore* db) {
   using firebase::firestore::Error;
@@ -790,6 +1239,107 @@ void ReadDataDetachListener(firebase::firestore::Firestore* db) {
   // listener.
 }
 
+void ReadDataSharedListeners(firebase::firestore::Firestore* db) {
+  using firebase::firestore::DocumentSnapshot;
+  using firebase::firestore::Error;
+
+  // Several parts of an app often watch the same document. Rather than opening
+  // one listener each, they can subscribe through a shared hub, which keeps a
+  // single listener per document or query and fans its snapshots out.
+  // [START shared_listeners]
+  ListenerHub hub(db);
+  ListenerSubscription header = hub.Subscribe(
+      db->Collection("cities").Document("SF"),
+      [](const DocumentSnapshot& snapshot, Error error,
+         const std::string& errorMsg) {
+        if (error == Error::kErrorOk && snapshot.exists()) {
+          std::cout << "Header: " << snapshot.Get("name") << std::endl;
+        }
+      });
+  ListenerSubscription details = hub.Subscribe(
+      db->Collection("cities").Document("SF"),
+      [](const DocumentSnapshot& snapshot, Error error,
+         const std::string& errorMsg) {
+        if (error == Error::kErrorOk && snapshot.exists()) {
+          std::cout << "Details: " << snapshot.Get("population") << std::endl;
+        }
+      });
+  // Both subscriptions share one listener.
+  std::cout << hub.listener_count() << " listener(s) for "
+            << hub.subscriber_count() << " subscribers" << std::endl;
+
+  // The listener is removed once the last subscription ends.
+  details.Remove();
+  header.Remove();
+  // [END shared_listeners]
+}
+
+// [START scoped_listeners]
+// A screen that shows a city and its landmarks. The registry and the
+// subscriptions are members, so the listeners live exactly as long as the
+// screen, however it is closed.
+class CityScreen {
+ public:
+  CityScreen(firebase::firestore::Firestore* db, const std::string& city)
+      : registry_(IdleListenerOptions()) {
+    using firebase::firestore::DocumentSnapshot;
+    using firebase::firestore::Error;
+    using firebase::firestore::QuerySnapshot;
+
+    city_ = registry_.Listen(
+        db->Collection("cities").Document(city), "CityScreen",
+        [](const DocumentSnapshot& snapshot, Error error,
+           const std::string& errorMsg) { /* ... */ });
+    // Listening through a QuerySpec records what the query is, so that
+    // ActiveListeners() can show it.
+    landmarks_ = registry_.Listen(
+        db, QuerySpec::Collection("cities/" + city + "/landmarks"),
+        "CityScreen",
+        [](const QuerySnapshot& snapshot, Error error,
+           const std::string& errorMsg) { /* ... */ });
+  }
+
+  // Call periodically, e.g. when the app comes to the foreground.
+  void CheckListeners() {
+    for (const ListenerInfo& info : registry_.ActiveListeners()) {
+      std::cout << info.owner << " listens to " << info.target << ": "
+                << info.events << " events, " << info.events_per_second()
+                << "/s" << std::endl;
+    }
+    // Reports, and here detaches, listeners that haven't received an event
+    // for 10 minutes.
+    registry_.CheckIdle();
+  }
+
+ private:
+  static ListenerRegistryOptions IdleListenerOptions() {
+    ListenerRegistryOptions options;
+    options.idle_threshold = std::chrono::minutes(10);
+    options.auto_detach_idle = true;
+    return options;
+  }
+
+  // Declared before the subscriptions, so that it outlives them.
+  ListenerRegistry registry_;
+  ListenerSubscription city_;
+  ListenerSubscription landmarks_;
+};
+// [END scoped_listeners]
+
+void ReadDataScopedListeners(firebase::firestore::Firestore* db) {
+  // A listener whose registration is dropped keeps running for the rest of
+  // the process. A ListenerSubscription removes it when it goes out of
+  // scope, so keep it, and the registry that tracks it, in the object whose
+  // lifetime the listener should share.
+  // [START scoped_listeners_lifetime]
+  // Stands in for whatever keeps the screen on display, e.g. the navigation
+  // stack. Replacing or resetting it removes the screen's listeners.
+  static std::unique_ptr<CityScreen> open_screen;
+  open_screen = std::make_unique<CityScreen>(db, "SF");
+  open_screen->CheckListeners();
+  // [END scoped_listeners_lifetime]
+}
+
 // https://firebase.google.com/docs/firestore/query-data/queries#simple_queries
 void ReadDataSimpleQueries(firebase::firestore::Firestore* db) {
   using firebase::firestore::CollectionReference;
@@ -841,6 +1391,72 @@ void ReadDataExecuteQuery(firebase::firestore::Firestore* db) {
       });
 }
 
+void ReadDataCachedQuery(firebase::firestore::Firestore* db) {
+  using firebase::firestore::Error;
+  using firebase::firestore::FieldValue;
+  using firebase::firestore::QuerySnapshot;
+
+  // Screens that re-run the same query can share its results through a
+  // QueryCache. Queries are described with a QuerySpec, which gives
+  // equivalent queries the same cache key. Identical requests made while the
+  // query is still running share a single read.
+  // [START cached_query]
+  QueryCache cache(db);
+  QuerySpec capitals = QuerySpec::Collection("cities").Where(
+      "capital", QuerySpec::Operator::kEqual, FieldValue::Boolean(true));
+
+  for (int i = 0; i < 2; ++i) {
+    cache.Get(capitals, [](const QuerySnapshot& snapshot, Error error,
+                           const std::string& error_message) {
+      if (error == Error::kErrorOk) {
+        std::cout << "Capital cities: " << snapshot.size() << std::endl;
+      } else {
+        std::cout << "Error getting documents: " << error_message << std::endl;
+      }
+    });
+  }
+  // [END cached_query]
+}
+
+void ReadDataWarmUpCache(firebase::firestore::Firestore* db,
+                         const std::string& history_path) {
+  using firebase::firestore::FieldValue;
+
+  // Queries that an app runs in most sessions can be run in the background
+  // right after startup, so that their results are already in the offline
+  // cache when the screens that need them open:
+  // [START warm_up_cache]
+  WarmupPlannerOptions options;
+  options.path = history_path;
+  options.top_k = 4;
+  WarmupPlanner planner(db, options);
+
+  std::string error_message;
+  if (!planner.Load(&error_message)) {
+    std::cout << "Error loading query history: " << error_message << std::endl;
+  }
+  planner.WarmUp([](const WarmupResult& result) {
+    std::cout << "Prefetched " << result.documents << " documents with "
+              << result.queries << " queries in " << result.elapsed_seconds
+              << "s" << std::endl;
+  });
+
+  // Record the queries as the app runs them...
+  planner.Record(QuerySpec::Collection("cities").Where(
+      "capital", QuerySpec::Operator::kEqual, FieldValue::Boolean(true)));
+  planner.Record(QuerySpec::Collection("cities")
+                     .Where("state", QuerySpec::Operator::kEqual,
+                            FieldValue::String("CA"))
+                     .Where("population", QuerySpec::Operator::kLessThan,
+                            FieldValue::Integer(1000000)));
+
+  // ...and save them for the next session, e.g. when the app is paused.
+  if (!planner.Save(&error_message)) {
+    std::cout << "Error saving query history: " << error_message << std::endl;
+  }
+  // [END warm_up_cache]
+}
+
 // https://firebase.google.com/docs/firestore/query-data/queries#query_operators
 void ReadDataQueryOperators(firebase::firestore::Firestore* db) {
   using firebase::firestore::CollectionReference;
@@ -922,6 +1538,48 @@ void ReadDataArrayContainsAnyOperators(firebase::firestore::Firestore* db) {
   // [END cpp_in_filter_with_array]
 }
 
+void ReadDataFilterInMemory(firebase::firestore::Firestore* db) {
+  using firebase::Future;
+  using firebase::firestore::DocumentSnapshot;
+  using firebase::firestore::Error;
+  using firebase::firestore::FieldValue;
+  using firebase::firestore::MapFieldValue;
+  using firebase::firestore::Query;
+  using firebase::firestore::QuerySnapshot;
+
+  // Documents that are already in memory can be queried again without
+  // another read, e.g. to refine results as the user types. QueryEvaluator
+  // applies a QuerySpec the way the backend would.
+  // [START filter_in_memory]
+  db->Collection("cities").Get().OnCompletion(
+      [](const Future<QuerySnapshot>& future) {
+        if (future.error() != Error::kErrorOk) {
+          std::cout << "Error getting documents: " << future.error_message()
+                    << std::endl;
+          return;
+        }
+        std::vector<MapFieldValue> documents;
+        std::vector<std::string> ids;
+        for (const DocumentSnapshot& document : future.result()->documents()) {
+          documents.push_back(document.GetData());
+          ids.push_back(document.id());
+        }
+
+        QueryEvaluator evaluator(documents, &ids);
+        QuerySpec large_west_coast_cities =
+            QuerySpec::Collection("cities")
+                .Where("regions", QuerySpec::Operator::kArrayContains,
+                       FieldValue::String("west_coast"))
+                .Where("population", QuerySpec::Operator::kGreaterThan,
+                       FieldValue::Integer(1000000))
+                .OrderBy("population", Query::Direction::kDescending);
+        for (size_t i : evaluator.Run(large_west_coast_cities)) {
+          std::cout << ids[i] << std::endl;
+        }
+      });
+  // [END filter_in_memory]
+}
+
 
 
 void QueryCollectionGroupFilterEq(firebase::firestore::Firestore* db) // 2 TODO
@@ -951,6 +1609,36 @@ void QueryCollectionGroupFilterEq(firebase::firestore::Firestore* db) // 2 TODO
 
 }
 
+void QueryCollectionGroupSubset(firebase::firestore::Firestore* db) {
+  using firebase::firestore::DocumentSnapshot;
+  using firebase::firestore::Error;
+  using firebase::firestore::FieldValue;
+
+  // When only some parents matter, querying each parent's subcollection
+  // reads fewer documents than the whole group. GetCollectionGroupSubset()
+  // picks between the two by the number of parents, and merges per-parent
+  // results back into query order.
+  // [START query_collection_group_subset]
+  QuerySpec museums = QuerySpec::CollectionGroup("landmarks")
+                          .Where("type", QuerySpec::Operator::kEqual,
+                                 FieldValue::String("museum"))
+                          .OrderBy("name");
+  GetCollectionGroupSubset(
+      db, museums, {"cities/SF", "cities/LA"}, CollectionGroupFanOutOptions(),
+      [](const std::vector<DocumentSnapshot>& documents, Error error,
+         const std::string& error_message) {
+        if (error != Error::kErrorOk) {
+          std::cout << "Error getting documents: " << error_message
+                    << std::endl;
+          return;
+        }
+        for (const DocumentSnapshot& document : documents) {
+          std::cout << document << std::endl;
+        }
+      });
+  // [END query_collection_group_subset]
+}
+
 
 void QueryCollectionGroupDataset(firebase::firestore::Firestore* db)
 {
@@ -1041,6 +1729,55 @@ void ReadDataInvalidCompoundQuery(firebase::firestore::Firestore* db) {
   // [END invalid_range_filters]
 }
 
+void ReadDataPlannedCompoundQuery(firebase::firestore::Firestore* db) {
+  using firebase::firestore::CollectionReference;
+  using firebase::firestore::DocumentSnapshot;
+  using firebase::firestore::Error;
+  using firebase::firestore::FieldValue;
+  using firebase::firestore::Source;
+
+  // A QueryPlanner runs such queries anyway: it sends the backend a query it
+  // accepts, with the range filter it estimates to be the most selective,
+  // and applies the other filter to the results. Estimates come from
+  // statistics gathered once over the collection.
+  // [START planned_compound_query]
+  CollectionReference cities_ref = db->Collection("cities");
+  QuerySpec query =
+      QuerySpec::Collection("cities")
+          .Where("state", QuerySpec::Operator::kGreaterThanOrEqual,
+                 FieldValue::String("CA"))
+          .Where("population", QuerySpec::Operator::kGreaterThan,
+                 FieldValue::Integer(100000));
+
+  CollectStatistics(
+      cities_ref, /*sample_size=*/100, PagedScanOptions(),
+      [db, query](const CollectionStatistics& statistics, Error error,
+                  const std::string& error_message) {
+        if (error != Error::kErrorOk) {
+          std::cout << "Error collecting statistics: " << error_message
+                    << std::endl;
+          return;
+        }
+        QueryPlan plan = QueryPlanner(statistics).Plan(query);
+        std::cout << "Filtering " << plan.server_inequality_field
+                  << " on the server, about " << plan.estimated_reads
+                  << " reads" << std::endl;
+        RunQueryPlan(db, plan, Source::kDefault,
+                     [](const std::vector<DocumentSnapshot>& documents,
+                        Error error, const std::string& error_message) {
+                       if (error != Error::kErrorOk) {
+                         std::cout << "Error getting documents: "
+                                   << error_message << std::endl;
+                         return;
+                       }
+                       for (const DocumentSnapshot& document : documents) {
+                         std::cout << document.id() << std::endl;
+                       }
+                     });
+      });
+  // [END planned_compound_query]
+}
+
 // https://firebase.google.com/docs/firestore/query-data/order-limit-data#order_and_limit_data
 void ReadDataOrderAndLimitData(firebase::firestore::Firestore* db) {
   using firebase::firestore::CollectionReference;
@@ -1202,6 +1939,150 @@ void ReadDataPaginateQuery(firebase::firestore::Firestore* db) {
   // [END paginate]
 }
 
+void ReadDataScanCollection(firebase::firestore::Firestore* db) {
+  using firebase::firestore::DocumentSnapshot;
+  using firebase::firestore::Error;
+
+  // To walk an entire collection, ScanPages() repeats the pagination pattern
+  // above until the results are exhausted. The next page is fetched while the
+  // current one is being processed, and the page size adapts to how long each
+  // fetch takes. Return false from the page callback to stop early.
+  // [START scan_collection]
+  ScanPages(
+      db->Collection("cities").OrderBy("population"), PagedScanOptions(),
+      [](const std::vector<DocumentSnapshot>& page) {
+        for (const DocumentSnapshot& document : page) {
+          std::cout << document.id() << std::endl;
+        }
+        return true;
+      },
+      [](Error error, const std::string& error_message) {
+        if (error != Error::kErrorOk) {
+          std::cout << "Scan failed: " << error_message << std::endl;
+        }
+      });
+  // [END scan_collection]
+
+  // Outside of Firestore callbacks, PagedScan offers the same walk as a
+  // blocking iterator:
+  //
+  //   PagedScan scan(db->Collection("cities").OrderBy("population"));
+  //   std::vector<DocumentSnapshot> page;
+  //   while (scan.Next(&page)) { /* ... */ }
+}
+
+void ReadDataPartitionedScan(firebase::firestore::Firestore* db) {
+  using firebase::firestore::DocumentSnapshot;
+  using firebase::firestore::Error;
+  using firebase::firestore::FieldPath;
+
+  // A paged scan is serial, because each page starts after the last document
+  // of the previous one. For large collections, ScanPartitioned() splits the
+  // key range into disjoint ranges bounded by StartAt() and EndBefore()
+  // cursors, and scans all of them at the same time. Pages from different
+  // ranges arrive concurrently, so the page callback must be thread-safe.
+  //
+  // The split points must divide the collection's actual keys. Documents
+  // created with Add() have random IDs, which AutoIdSplitPoints() divides
+  // evenly. For IDs chosen by the app, such as "SF" or "LA" in "cities", split
+  // on a field instead, e.g. IntegerSplitPoints() over "population".
+  // [START partitioned_scan]
+  auto count = std::make_shared<std::atomic<int64_t>>(0);
+  ScanPartitioned(
+      db->Collection("users"), FieldPath::DocumentId(), AutoIdSplitPoints(4),
+      PagedScanOptions(),
+      [count](size_t partition, const std::vector<DocumentSnapshot>& page) {
+        *count += static_cast<int64_t>(page.size());
+        return true;
+      },
+      [count](Error error, const std::string& error_message) {
+        if (error == Error::kErrorOk) {
+          std::cout << "Scanned " << count->load() << " users" << std::endl;
+        } else {
+          std::cout << "Scan failed: " << error_message << std::endl;
+        }
+      });
+  // [END partitioned_scan]
+}
+
+void ReadDataAggregateLocally(firebase::firestore::Firestore* db) {
+  using firebase::firestore::Error;
+  using firebase::firestore::FieldPath;
+
+  // Totals over a whole collection can be computed while it is scanned,
+  // without keeping the documents: an AggregationAccumulator only holds a
+  // running count, sum and extreme per group. AggregatePartitioned() scans
+  // ranges in parallel and merges their partial results at the end. City IDs
+  // are chosen by the app, so the ranges split "population" rather than the
+  // document ID; cities without a population are left out.
+  // [START aggregate_locally]
+  AggregationSpec spec = AggregationSpec()
+                             .GroupBy("country")
+                             .Count()
+                             .Sum("population")
+                             .Average("population")
+                             .Max("population");
+  AggregatePartitioned(
+      db->Collection("cities"), FieldPath{"population"},
+      IntegerSplitPoints(0, 20000000, 4), spec, PagedScanOptions(),
+      [](const std::vector<AggregationGroup>& groups, Error error,
+         const std::string& error_message) {
+        if (error != Error::kErrorOk) {
+          std::cout << "Aggregation failed: " << error_message << std::endl;
+          return;
+        }
+        for (const AggregationGroup& group : groups) {
+          std::cout << group.key.ToString() << ": "
+                    << group.values[0].integer_value() << " cities, "
+                    << group.values[1].ToString() << " people" << std::endl;
+        }
+      });
+  // [END aggregate_locally]
+}
+
+// This method is left unexecuted because it blocks until every query has been
+// read.
+void ReadDataMergeOrderedQueries(firebase::firestore::Firestore* db) {
+  using firebase::firestore::DocumentSnapshot;
+  using firebase::firestore::Error;
+  using firebase::firestore::FieldValue;
+  using firebase::firestore::Query;
+
+  // An `in` filter takes a limited number of values. Longer lists can be
+  // split across several queries with the same order, and MergedScan reads
+  // them page by page as a single ordered stream, without collecting and
+  // re-sorting every result.
+  // [START merge_ordered_queries]
+  std::vector<FieldValue> countries = {
+      FieldValue::String("USA"),    FieldValue::String("Japan"),
+      FieldValue::String("China"),  FieldValue::String("India"),
+      FieldValue::String("Brazil"), FieldValue::String("Mexico")};
+  const size_t values_per_query = 3;
+
+  std::vector<Query> queries;
+  for (size_t i = 0; i < countries.size(); i += values_per_query) {
+    size_t end = std::min(countries.size(), i + values_per_query);
+    std::vector<FieldValue> chunk(countries.begin() + i,
+                                  countries.begin() + end);
+    queries.push_back(db->Collection("cities")
+                          .WhereIn("country", chunk)
+                          .OrderBy("population"));
+  }
+
+  DocumentOrder order({{"population", Query::Direction::kAscending}});
+  MergedScan scan(queries, order);
+  DocumentSnapshot document;
+  while (scan.Next(&document)) {
+    std::cout << document.id() << ": " << document.Get("population")
+              << std::endl;
+  }
+  if (scan.error() != Error::kErrorOk) {
+    std::cout << "Error getting documents: " << scan.error_message()
+              << std::endl;
+  }
+  // [END merge_ordered_queries]
+}
+
 // https://firebase.google.com/docs/firestore/bundles#loading_data_bundles_in_the_client
 void LoadFirestoreBundles(firebase::firestore::Firestore* db) {
   using firebase::Future;
@@ -1250,6 +2131,164 @@ void LoadFirestoreBundles(firebase::firestore::Firestore* db) {
   // [END bundled_query]
 }
 
+void BuildFirestoreBundle(firebase::firestore::Firestore* db,
+                          const std::string& bundle_path) {
+  using firebase::firestore::DocumentReference;
+  using firebase::firestore::Error;
+  using firebase::firestore::Query;
+
+  // Bundles are usually built on a server, but the results of named queries
+  // can also be saved from a client, e.g. to ship with an app:
+  // [START build_bundle]
+  std::vector<std::pair<std::string, QuerySpec>> named_queries = {
+      {"latest_stories_query",
+       QuerySpec::Collection("stories")
+           .OrderBy("timestamp", Query::Direction::kDescending)
+           .Limit(20)},
+  };
+
+  // The bundle's read time comes from a server timestamp written here.
+  DocumentReference clock = db->Collection("admin").Document("bundle_clock");
+  BuildBundle(db, "latest-stories", named_queries, clock,
+              [bundle_path](const std::string& bundle, Error error,
+                            const std::string& error_message) {
+                if (error != Error::kErrorOk) {
+                  std::cout << "Error building bundle: " << error_message
+                            << std::endl;
+                  return;
+                }
+                std::ofstream out(bundle_path, std::ios::binary);
+                out.write(bundle.data(), bundle.size());
+                std::cout << "Wrote " << bundle.size() << " bytes to "
+                          << bundle_path << std::endl;
+              });
+  // [END build_bundle]
+}
+
+void LoadFirestoreBundleFromFile(firebase::firestore::Firestore* db,
+                                 const std::string& bundle_path) {
+  using firebase::firestore::Error;
+
+  // A large bundle can be loaded from a file in pieces, so that it never has
+  // to be held in memory as a whole:
+  // [START load_bundle_file]
+  StreamingBundleOptions options;
+  options.chunk_bytes = 512 * 1024;
+
+  LoadBundleFile(
+      db, bundle_path, options,
+      [](const StreamingBundleProgress& progress) {
+        std::cout << "Loaded " << progress.documents_loaded << " of "
+                  << progress.total_documents << " documents" << std::endl;
+      },
+      [db](Error error, const std::string& error_message) {
+        if (error != Error::kErrorOk) {
+          std::cout << "Bundle load failure: " << error_message << std::endl;
+          return;
+        }
+        // Named queries from the bundle are now available, as with
+        // LoadBundle().
+        db->NamedQuery("latest_stories_query");
+      });
+  // [END load_bundle_file]
+}
+
+// This method is left unexecuted because it blocks until every batch has been
+// committed.
+void BulkLoadExampleData(firebase::firestore::Firestore* db) {
+  // Seeding a collection one Set() at a time is slow for large datasets.
+  // BulkLoader groups writes into batches and commits several of them in
+  // parallel, retrying batches that fail because of contention. Documents can
+  // be read from newline-delimited JSON, one object per line:
+  // [START bulk_load]
+  std::istringstream input(
+      R"({"id": "SF", "name": "San Francisco", "population": 860000})" "\n"
+      R"({"id": "LA", "name": "Los Angeles", "population": 3900000})" "\n"
+      R"({"id": "TOK", "name": "Tokyo", "population": 9000000})" "\n");
+
+  BulkLoader loader(db);
+  loader.LoadNdjson(input, db->Collection("cities"));
+  BulkLoadStats stats = loader.Finish();
+
+  std::cout << "Wrote " << stats.documents_written << " documents ("
+            << stats.documents_per_second() << " docs/sec, " << stats.retries
+            << " retries)" << std::endl;
+  // [END bulk_load]
+}
+
+// This method is left unexecuted because it blocks until every transaction
+// has finished.
+void BenchmarkTransactionContention(firebase::firestore::Firestore* db) {
+  using firebase::firestore::DocumentReference;
+
+  // To see how a hot document behaves under load, compare the SDK's retries,
+  // TransactionRunner's backoff and plain increments with the same clients:
+  // [START transaction_benchmark]
+  DocumentReference sf_doc_ref = db->Collection("cities").Document("SF");
+
+  for (TransactionBenchmarkMode mode : {TransactionBenchmarkMode::kSdkRetry,
+                                        TransactionBenchmarkMode::kAdaptiveRetry,
+                                        TransactionBenchmarkMode::kIncrement}) {
+    TransactionBenchmarkOptions options;
+    options.clients = 16;
+    options.mode = mode;
+    TransactionBenchmarkResult result =
+        RunTransactionBenchmark(db, sf_doc_ref, options);
+
+    std::cout << result.commits_per_second() << " commits/sec, "
+              << result.failed << " failed, " << result.retries
+              << " retries, p50 " << result.p50_latency.count() << "us, p99 "
+              << result.p99_latency.count() << "us" << std::endl;
+  }
+  // [END transaction_benchmark]
+}
+
+// This method is left unexecuted because it blocks until every increment has
+// been written.
+void BenchmarkShardedCounter(firebase::firestore::Firestore* db) {
+  using firebase::firestore::Error;
+
+  // To choose a shard count, measure how increments scale as shards are
+  // added:
+  // [START sharded_counter_benchmark]
+  for (const ShardedCounterBenchmarkResult& result :
+       RunShardedCounterBenchmark(db->Collection("counters"))) {
+    if (result.error != Error::kErrorOk) {
+      std::cout << result.num_shards << " shards: " << result.error_message
+                << std::endl;
+      continue;
+    }
+    std::cout << result.num_shards << " shards: "
+              << result.increments_per_second() << " increments/sec, p50 "
+              << result.p50_latency.count() << "us, p99 "
+              << result.p99_latency.count() << "us" << std::endl;
+  }
+  // [END sharded_counter_benchmark]
+}
+
+// This method is left unexecuted because it blocks until every bundle has
+// been loaded.
+void BenchmarkBundleLoading(firebase::firestore::Firestore* db,
+                            const std::string& cache_directory) {
+  // To decide how much data to bundle with an app, measure how long bundles
+  // of different sizes take to load and query. Each result is printed as a
+  // line of JSON:
+  // [START bundle_benchmark]
+  BundleBenchmarkOptions options;
+  options.directory = cache_directory;
+
+  for (const BundleBenchmarkResult& result : RunBundleBenchmark(db, options)) {
+    std::cout << ToJson(result) << std::endl;
+  }
+
+  // The same sizes, loaded from the file in 1 MB chunks:
+  options.chunk_bytes = 1 << 20;
+  for (const BundleBenchmarkResult& result : RunBundleBenchmark(db, options)) {
+    std::cout << ToJson(result) << std::endl;
+  }
+  // [END bundle_benchmark]
+}
+
 }  // namespace snippets
 
 void RunAllSnippets(firebase::firestore::Firestore* db) {
@@ -1265,28 +2304,45 @@ void RunAllSnippets(firebase::firestore::Firestore* db) {
   snippets::AddDataUpdateNestedObjects(db);
   snippets::AddDataBatchedWrites(db);
   snippets::AddDataTransactions(db);
+  snippets::AddDataTransactionsWithBackoff(db);
+  snippets::AddDataShardedCounter(db);
   snippets::AddDataDeleteDocuments(db);
   snippets::AddDataDeleteFields(db);
 
   snippets::ReadDataExampleData(db);
   snippets::ReadDataGetDocument(db);
   snippets::ReadDataSourceOptions(db);
+  snippets::ReadDataCacheFirst(db);
+  snippets::ReadDataCoalescedGet(db);
+  snippets::ReadDataGetAllDocuments(db);
+  snippets::ReadDataJoinFutures(db);
   snippets::ReadDataGetMultipleDocumentsFromCollection(db);
   snippets::ReadDataGetAllDocumentsInCollection(db);
+  snippets::ReadDataColumnarAggregation(db);
 
   snippets::ReadDataListen(db);
+  snippets::ReadDataListenOnExecutor(db);
+  snippets::ReadDataGetOnExecutor(db);
   snippets::ReadDataEventsForLocalChanges(db);
   snippets::ReadDataEventsForMetadataChanges(db);
+  snippets::ReadDataThrottledListener(db);
   snippets::ReadDataListenToMultipleDocumentsInCollection(db);
   snippets::ReadDataViewChangesBetweenSnapshots(db);
+  snippets::ReadDataLiveQueryView(db);
   snippets::ReadDataDetachListener(db);
+  snippets::ReadDataSharedListeners(db);
+  snippets::ReadDataScopedListeners(db);
 
   snippets::ReadDataSimpleQueries(db);
   snippets::ReadDataExecuteQuery(db);
+  snippets::ReadDataCachedQuery(db);
   snippets::ReadDataQueryOperators(db);
+  snippets::ReadDataFilterInMemory(db);
   snippets::ReadDataCompoundQueries(db);
+  snippets::ReadDataPlannedCompoundQuery(db);
   snippets::QueryCollectionGroupDataset(db);
   snippets::QueryCollectionGroupFilterEq(db);
+  snippets::QueryCollectionGroupSubset(db);
 
   snippets::ReadDataOrderAndLimitData(db);
 
@@ -1294,6 +2350,9 @@ void RunAllSnippets(firebase::firestore::Firestore* db) {
 
   snippets::ReadDataDocumentSnapshotInCursor(db);
   snippets::ReadDataPaginateQuery(db);
+  snippets::ReadDataScanCollection(db);
+  snippets::ReadDataPartitionedScan(db);
+  snippets::ReadDataAggregateLocally(db);
 }
 
 SnippetsRunner::SnippetsRunner() {}
@@ -0,0 +1,367 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "streaming_bundle_loader.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "field_value_json.h"
+
+namespace snippets {
+
+using firebase::Future;
+using firebase::firestore::Error;
+using firebase::firestore::FieldValue;
+using firebase::firestore::Firestore;
+using firebase::firestore::LoadBundleTaskProgress;
+using firebase::firestore::MapFieldValue;
+
+namespace {
+
+// A read-only mapping of a whole file.
+class MappedFile {
+ public:
+  MappedFile() = default;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() {
+    if (data_ != nullptr) {
+      munmap(data_, size_);
+    }
+  }
+
+  bool Open(const std::string& path, std::string* error_message) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      *error_message = path + ": " + std::strerror(errno);
+      return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+      *error_message = path + ": empty or unreadable file";
+      close(fd);
+      return false;
+    }
+    size_ = static_cast<size_t>(info.st_size);
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+      *error_message = path + ": " + std::strerror(errno);
+      return false;
+    }
+    data_ = data;
+    madvise(data_, size_, MADV_SEQUENTIAL);
+    return true;
+  }
+
+  const char* data() const { return static_cast<const char*>(data_); }
+  size_t size() const { return size_; }
+
+  // Tells the OS that the pages before `end` won't be read again, so they
+  // don't count towards the app's memory.
+  void Release(size_t end) {
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t aligned_end = end / page * page;
+    if (aligned_end > released_) {
+      madvise(static_cast<char*>(data_) + released_, aligned_end - released_,
+              MADV_DONTNEED);
+      released_ = aligned_end;
+    }
+  }
+
+ private:
+  void* data_ = nullptr;
+  size_t size_ = 0;
+  size_t released_ = 0;
+};
+
+// One length-prefixed element of a bundle.
+struct Element {
+  // The whole element, including its length prefix.
+  const char* begin = nullptr;
+  size_t size = 0;
+  // The JSON object, without the prefix.
+  const char* json = nullptr;
+  size_t json_size = 0;
+  // The object's only key, e.g. "documentMetadata".
+  std::string kind;
+};
+
+bool ReadElement(const MappedFile& file, size_t offset, Element* out,
+                 std::string* error_message) {
+  const char* data = file.data();
+  size_t end = file.size();
+  size_t pos = offset;
+  uint64_t length = 0;
+  while (pos < end && data[pos] >= '0' && data[pos] <= '9' &&
+         pos - offset < 19) {
+    length = length * 10 + static_cast<uint64_t>(data[pos] - '0');
+    ++pos;
+  }
+  if (pos == offset || length > end - pos) {
+    *error_message =
+        "malformed bundle element at byte " + std::to_string(offset);
+    return false;
+  }
+
+  out->begin = data + offset;
+  out->json = data + pos;
+  out->json_size = static_cast<size_t>(length);
+  out->size = pos - offset + out->json_size;
+
+  // Elements are objects with a single key naming their kind, so reading up
+  // to the first key is enough to classify them.
+  const char* json_end = out->json + out->json_size;
+  const char* p = out->json;
+  auto skip_whitespace = [&p, json_end] {
+    while (p < json_end && (*p == ' ' || *p == '\n' || *p == '\r' ||
+                            *p == '\t')) {
+      ++p;
+    }
+  };
+  skip_whitespace();
+  if (p < json_end && *p == '{') ++p;
+  skip_whitespace();
+  const char* key_end = p < json_end && *p == '"'
+                            ? static_cast<const char*>(
+                                  std::memchr(p + 1, '"', json_end - p - 1))
+                            : nullptr;
+  if (key_end == nullptr) {
+    *error_message =
+        "malformed bundle element at byte " + std::to_string(offset);
+    return false;
+  }
+  out->kind.assign(p + 1, key_end);
+  return true;
+}
+
+int64_t IntegerField(const MapFieldValue& fields, const std::string& name) {
+  auto found = fields.find(name);
+  if (found == fields.end()) {
+    return 0;
+  }
+  if (found->second.is_integer()) {
+    return found->second.integer_value();
+  }
+  if (found->second.is_string()) {
+    return std::strtoll(found->second.string_value().c_str(), nullptr, 10);
+  }
+  return 0;
+}
+
+struct LoadState {
+  Firestore* db = nullptr;
+  MappedFile file;
+  StreamingBundleOptions options;
+  std::function<void(const StreamingBundleProgress&)> progress;
+  std::function<void(Error, const std::string&)> callback;
+
+  std::string bundle_id;
+  // The original creation time, as JSON.
+  std::string create_time;
+  // Offset of the first element after the metadata.
+  size_t body_begin = 0;
+  size_t offset = 0;
+  // Set once a named query is found; the rest of the bundle is then loaded
+  // as one piece.
+  bool has_named_queries = false;
+  StreamingBundleProgress totals;
+};
+
+bool ReadMetadata(LoadState* state, std::string* error_message) {
+  Element element;
+  if (!ReadElement(state->file, 0, &element, error_message)) {
+    return false;
+  }
+  if (element.kind != "metadata") {
+    *error_message = "bundle doesn't start with metadata";
+    return false;
+  }
+  FieldValue value;
+  if (!ParseJson(std::string(element.json, element.json_size), &value,
+                 error_message)) {
+    return false;
+  }
+  // The SDK asserts on accessors of the wrong type, so a malformed file must
+  // be caught here rather than crash the app.
+  if (!value.is_map()) {
+    *error_message = "bundle metadata element is not an object";
+    return false;
+  }
+  MapFieldValue element_fields = value.map_value();
+  auto found = element_fields.find("metadata");
+  if (found == element_fields.end() || !found->second.is_map()) {
+    *error_message = "bundle metadata is not an object";
+    return false;
+  }
+  MapFieldValue metadata = found->second.map_value();
+  found = metadata.find("id");
+  if (found == metadata.end() || !found->second.is_string()) {
+    *error_message = "bundle metadata has no id";
+    return false;
+  }
+  state->bundle_id = found->second.string_value();
+
+  found = metadata.find("createTime");
+  state->create_time.clear();
+  if (found == metadata.end() ||
+      !(found->second.is_string() || found->second.is_map())) {
+    *error_message = "bundle metadata has no valid createTime";
+    return false;
+  }
+  const FieldValue& create_time = found->second;
+  if (create_time.is_string()) {
+    AppendJsonString(create_time.string_value(), &state->create_time);
+  } else {
+    MapFieldValue time = create_time.map_value();
+    state->create_time = "{\"seconds\":" +
+                         std::to_string(IntegerField(time, "seconds")) +
+                         ",\"nanos\":" +
+                         std::to_string(IntegerField(time, "nanos")) + "}";
+  }
+
+  state->totals.total_bytes = IntegerField(metadata, "totalBytes");
+  state->totals.total_documents = IntegerField(metadata, "totalDocuments");
+  state->body_begin = element.size;
+  state->offset = element.size;
+  return true;
+}
+
+void LoadNextChunk(std::shared_ptr<LoadState> state) {
+  const MappedFile& file = state->file;
+  size_t begin = state->offset;
+  std::string body;
+  int64_t documents = 0;
+  std::string error_message;
+
+  while (state->offset < file.size()) {
+    Element element;
+    if (!ReadElement(file, state->offset, &element, &error_message)) {
+      state->callback(Error::kErrorInvalidArgument, error_message);
+      return;
+    }
+    if (element.kind == "documentMetadata") {
+      // Chunks only end before a document, so that a document's metadata and
+      // contents always load together.
+      if (documents > 0 && !state->has_named_queries &&
+          body.size() >= state->options.chunk_bytes) {
+        break;
+      }
+      ++documents;
+      body.append(element.begin, element.size);
+    } else if (element.kind == "document") {
+      body.append(element.begin, element.size);
+    } else if (element.kind == "namedQuery") {
+      // The SDK matches a named query only against the documents loaded in
+      // the same `LoadBundle()` call, so its documents can't be split off
+      // into other chunks.
+      if (state->totals.chunks_loaded > 0) {
+        state->callback(Error::kErrorInvalidArgument,
+                        "named query after documents in a chunked bundle");
+        return;
+      }
+      state->has_named_queries = true;
+      body.append(element.begin, element.size);
+    } else {
+      state->callback(Error::kErrorInvalidArgument,
+                      "unexpected bundle element: " + element.kind);
+      return;
+    }
+    state->offset += element.size;
+  }
+
+  bool last = state->offset >= file.size();
+  if (body.empty()) {
+    state->callback(Error::kErrorOk, "");
+    return;
+  }
+  // The chunk is a copy, so the pages it came from can go.
+  state->file.Release(state->offset);
+
+  // The SDK skips a bundle ID it has already loaded, so the ID names the
+  // exact bytes of the chunk: loading with another `chunk_bytes` must not
+  // skip a chunk that held different documents.
+  std::string metadata = "{\"metadata\":{\"id\":";
+  AppendJsonString(state->bundle_id + "#" + std::to_string(begin) + "-" +
+                       std::to_string(state->offset),
+                   &metadata);
+  metadata += ",\"createTime\":" + state->create_time +
+              ",\"version\":1,\"totalDocuments\":" +
+              std::to_string(documents) +
+              ",\"totalBytes\":" + std::to_string(body.size()) + "}}";
+  std::string chunk = std::to_string(metadata.size()) + metadata + body;
+  body.clear();
+  body.shrink_to_fit();
+
+  state->db->LoadBundle(chunk).OnCompletion(
+      [state, documents, last](const Future<LoadBundleTaskProgress>& future) {
+        if (future.error() != Error::kErrorOk) {
+          state->callback(static_cast<Error>(future.error()),
+                          future.error_message());
+          return;
+        }
+        StreamingBundleProgress& totals = state->totals;
+        totals.bytes_loaded =
+            static_cast<int64_t>(state->offset - state->body_begin);
+        totals.documents_loaded += documents;
+        ++totals.chunks_loaded;
+        if (state->progress) {
+          state->progress(totals);
+        }
+        if (last) {
+          state->callback(Error::kErrorOk, "");
+        } else {
+          LoadNextChunk(state);
+        }
+      });
+}
+
+}  // namespace
+
+void LoadBundleFile(
+    Firestore* db, const std::string& path, StreamingBundleOptions options,
+    std::function<void(const StreamingBundleProgress&)> progress,
+    std::function<void(Error, const std::string&)> callback) {
+  auto state = std::make_shared<LoadState>();
+  state->db = db;
+  state->options = options;
+  state->progress = std::move(progress);
+  state->callback = std::move(callback);
+
+  std::string error_message;
+  if (!state->file.Open(path, &error_message)) {
+    state->callback(Error::kErrorNotFound, error_message);
+    return;
+  }
+  if (!ReadMetadata(state.get(), &error_message)) {
+    state->callback(Error::kErrorInvalidArgument, error_message);
+    return;
+  }
+  LoadNextChunk(state);
+}
+
+}  // namespace snippets
@@ -0,0 +1,73 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_STREAMING_BUNDLE_LOADER_H
+#define FIRESTORESNIPPETSCPP_STREAMING_BUNDLE_LOADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "firebase/firestore.h"
+
+namespace snippets {
+
+struct StreamingBundleOptions {
+  // Approximate size of each piece passed to `Firestore::LoadBundle()`. A
+  // piece is larger only if a single document is.
+  size_t chunk_bytes = 1 << 20;
+};
+
+struct StreamingBundleProgress {
+  // Bytes of the bundle file, and documents, loaded so far.
+  int64_t bytes_loaded = 0;
+  int64_t total_bytes = 0;
+  int64_t documents_loaded = 0;
+  int64_t total_documents = 0;
+  int chunks_loaded = 0;
+};
+
+// Loads the bundle in the file at `path` without reading it into memory.
+//
+// `Firestore::LoadBundle()` takes the whole bundle as one string. This maps
+// the file instead, and splits it into smaller bundles of about `chunk_bytes`
+// that are loaded one after another: each gets a copy of the original
+// metadata, under the ID "<bundle ID>#<first byte>-<end byte>", and a share
+// of the documents. Pages of the file that have been loaded are released as
+// loading proceeds.
+//
+// The SDK only associates a named query with the documents loaded in the
+// same `LoadBundle()` call, so a bundle with named queries is not split:
+// from its first named query on, the rest of the file is loaded as one
+// piece. Its named queries must therefore come before its documents, as
+// `BuildBundle()` writes them; otherwise loading fails with
+// `kErrorInvalidArgument`. Keep large bundles free of named queries to load
+// them in chunks.
+//
+// `progress` is called after each chunk, and `callback` once at the end. A
+// load that fails part-way leaves the chunks before it in the cache; loading
+// the file again skips them.
+void LoadBundleFile(
+    firebase::firestore::Firestore* db, const std::string& path,
+    StreamingBundleOptions options,
+    std::function<void(const StreamingBundleProgress&)> progress,
+    std::function<void(firebase::firestore::Error, const std::string&)>
+        callback);
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_STREAMING_BUNDLE_LOADER_H
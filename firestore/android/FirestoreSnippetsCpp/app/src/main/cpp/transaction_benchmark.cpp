@@ -0,0 +1,189 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "transaction_benchmark.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "benchmark_util.h"
+
+namespace snippets {
+
+using firebase::Future;
+using firebase::firestore::DocumentReference;
+using firebase::firestore::DocumentSnapshot;
+using firebase::firestore::Error;
+using firebase::firestore::FieldValue;
+using firebase::firestore::Firestore;
+using firebase::firestore::Transaction;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchmarkState {
+  Firestore* db = nullptr;
+  DocumentReference document;
+  TransactionBenchmarkOptions options;
+  // One runner per client, so that each backs off on its own like a separate
+  // device would.
+  std::vector<std::unique_ptr<TransactionRunner>> runners;
+
+  std::mutex mutex;
+  std::condition_variable done;
+  int clients_running = 0;
+  int64_t committed = 0;
+  int64_t failed = 0;
+  // Retries counted for `kSdkRetry`; the runners count their own.
+  int64_t sdk_retries = 0;
+  std::vector<std::chrono::microseconds> latencies;
+};
+
+// `calls`, if set, counts the attempts.
+TransactionRunner::Update IncrementInTransaction(
+    const DocumentReference& document, const std::string& field,
+    std::shared_ptr<std::atomic<int>> calls = nullptr) {
+  return [document, field, calls](Transaction& transaction,
+                                  std::string& out_error_message) -> Error {
+    if (calls) ++*calls;
+    Error error = Error::kErrorOk;
+    DocumentSnapshot snapshot =
+        transaction.Get(document, &error, &out_error_message);
+    if (error != Error::kErrorOk) {
+      return error;
+    }
+    int64_t value = snapshot.Get(field).integer_value() + 1;
+    transaction.Update(document, {{field, FieldValue::Integer(value)}});
+    return Error::kErrorOk;
+  };
+}
+
+void RunOperation(std::shared_ptr<BenchmarkState> state, int client,
+                  int remaining) {
+  if (remaining == 0) {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (--state->clients_running == 0) {
+      state->done.notify_all();
+    }
+    return;
+  }
+
+  Clock::time_point start = Clock::now();
+  auto finish = [state, client, remaining, start](Error error) {
+    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now() - start);
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      if (error == Error::kErrorOk) {
+        ++state->committed;
+      } else {
+        ++state->failed;
+      }
+      state->latencies.push_back(latency);
+    }
+    RunOperation(state, client, remaining - 1);
+  };
+
+  const TransactionBenchmarkOptions& options = state->options;
+  TransactionRunner& runner = *state->runners[client];
+  switch (options.mode) {
+    case TransactionBenchmarkMode::kSdkRetry: {
+      auto calls = std::make_shared<std::atomic<int>>(0);
+      state->db
+          ->RunTransaction(
+              IncrementInTransaction(state->document, options.field, calls))
+          .OnCompletion([state, finish, calls](const Future<void>& future) {
+            if (*calls > 1) {
+              std::lock_guard<std::mutex> lock(state->mutex);
+              state->sdk_retries += *calls - 1;
+            }
+            finish(static_cast<Error>(future.error()));
+          });
+      break;
+    }
+    case TransactionBenchmarkMode::kAdaptiveRetry:
+      runner.Run(IncrementInTransaction(state->document, options.field),
+                 [finish](Error error, const std::string&, int) {
+                   finish(error);
+                 });
+      break;
+    case TransactionBenchmarkMode::kIncrement:
+      runner.Increment(state->document, options.field, 1,
+                       [finish](Error error, const std::string&, int) {
+                         finish(error);
+                       });
+      break;
+  }
+}
+
+}  // namespace
+
+TransactionBenchmarkResult RunTransactionBenchmark(
+    Firestore* db, const DocumentReference& document,
+    TransactionBenchmarkOptions options) {
+  auto state = std::make_shared<BenchmarkState>();
+  state->db = db;
+  state->document = document;
+  state->options = std::move(options);
+  int clients = std::max(1, state->options.clients);
+  for (int i = 0; i < clients; ++i) {
+    state->runners.push_back(std::make_unique<TransactionRunner>(
+        db, state->options.retry_options));
+  }
+  state->clients_running = clients;
+
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < clients; ++i) {
+    RunOperation(state, i, std::max(0, state->options.operations_per_client));
+  }
+
+  TransactionBenchmarkResult result;
+  {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done.wait(lock, [&state] { return state->clients_running == 0; });
+    result.committed = state->committed;
+    result.failed = state->failed;
+    result.retries = state->sdk_retries;
+  }
+  result.elapsed_seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  for (const auto& runner : state->runners) {
+    result.retries += runner->stats().retries;
+  }
+
+  std::vector<std::chrono::microseconds> latencies;
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    latencies = std::move(state->latencies);
+  }
+  std::sort(latencies.begin(), latencies.end());
+  result.p50_latency = Percentile(latencies, 0.50);
+  result.p95_latency = Percentile(latencies, 0.95);
+  result.p99_latency = Percentile(latencies, 0.99);
+  if (!latencies.empty()) {
+    result.max_latency = latencies.back();
+  }
+  return result;
+}
+
+}  // namespace snippets
@@ -0,0 +1,89 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_TRANSACTION_BENCHMARK_H
+#define FIRESTORESNIPPETSCPP_TRANSACTION_BENCHMARK_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "firebase/firestore.h"
+#include "transaction_retry.h"
+
+namespace snippets {
+
+enum class TransactionBenchmarkMode {
+  // `Firestore::RunTransaction()` with the SDK's own retries.
+  kSdkRetry,
+  // `TransactionRunner::Run()`, with adaptive backoff.
+  kAdaptiveRetry,
+  // `TransactionRunner::Increment()`, with no transaction at all.
+  kIncrement,
+};
+
+struct TransactionBenchmarkOptions {
+  // Number of clients running at the same time. Each runs its operations one
+  // after another.
+  int clients = 8;
+  int operations_per_client = 25;
+
+  TransactionBenchmarkMode mode = TransactionBenchmarkMode::kAdaptiveRetry;
+  TransactionRetryOptions retry_options;
+
+  // Integer field that every operation adds one to.
+  std::string field = "population";
+};
+
+struct TransactionBenchmarkResult {
+  int64_t committed = 0;
+  int64_t failed = 0;
+  // Retried attempts. For `kSdkRetry`, the calls to the update function
+  // beyond the first of each operation.
+  int64_t retries = 0;
+  double elapsed_seconds = 0;
+
+  // Latency of an operation, including its retries.
+  std::chrono::microseconds p50_latency{0};
+  std::chrono::microseconds p95_latency{0};
+  std::chrono::microseconds p99_latency{0};
+  std::chrono::microseconds max_latency{0};
+
+  double commits_per_second() const {
+    return elapsed_seconds > 0 ? committed / elapsed_seconds : 0;
+  }
+};
+
+// Measures contention on one document: `clients` concurrent clients each
+// increment `field` of `document` `operations_per_client` times, with a
+// read-modify-write transaction as in `AddDataTransactions()`, or with
+// `FieldValue::Increment()`.
+//
+// The clients share `db`, so they model several writers in one process
+// rather than separate devices; each transaction still reads and commits on
+// its own, so the backend sees the same conflicts. Run it against the
+// emulator; it writes to `document`.
+//
+// Blocks until every operation has finished, so it must not be called from a
+// Firestore callback.
+TransactionBenchmarkResult RunTransactionBenchmark(
+    firebase::firestore::Firestore* db,
+    const firebase::firestore::DocumentReference& document,
+    TransactionBenchmarkOptions options = TransactionBenchmarkOptions());
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_TRANSACTION_BENCHMARK_H
@@ -0,0 +1,157 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "transaction_retry.h"
+
+#include <algorithm>
+#include <mutex>
+#include <random>
+#include <utility>
+
+#include "future_combinators.h"
+
+namespace snippets {
+
+using firebase::Future;
+using firebase::firestore::DocumentReference;
+using firebase::firestore::Error;
+using firebase::firestore::FieldValue;
+using firebase::firestore::SetOptions;
+using firebase::firestore::TransactionOptions;
+
+namespace {
+
+// Transactions fail with kErrorAborted or kErrorFailedPrecondition when a
+// document they read changed before they committed.
+bool IsRetryable(Error error) {
+  switch (error) {
+    case Error::kErrorAborted:
+    case Error::kErrorFailedPrecondition:
+    case Error::kErrorUnavailable:
+    case Error::kErrorResourceExhausted:
+    case Error::kErrorDeadlineExceeded:
+      return true;
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+struct TransactionRunner::State {
+  firebase::firestore::Firestore* db = nullptr;
+  TransactionRetryOptions options;
+
+  std::mutex mutex;
+  // Base backoff, in milliseconds.
+  double backoff = 0;
+  std::mt19937 rng{std::random_device{}()};
+  TransactionRetryStats stats;
+};
+
+TransactionRunner::TransactionRunner(firebase::firestore::Firestore* db,
+                                     TransactionRetryOptions options)
+    : state_(std::make_shared<State>()) {
+  state_->db = db;
+  state_->options = std::move(options);
+  state_->backoff = static_cast<double>(state_->options.min_backoff.count());
+}
+
+void TransactionRunner::Run(Update update, Callback callback) {
+  Attempt(state_, std::move(update), std::move(callback), 1);
+}
+
+void TransactionRunner::Increment(const DocumentReference& document,
+                                  const std::string& field, int64_t delta,
+                                  Callback callback) {
+  std::shared_ptr<State> state = state_;
+  DocumentReference target = document;
+  // Merging creates the document if it doesn't exist yet.
+  target.Set({{field, FieldValue::Increment(delta)}}, SetOptions::Merge())
+      .OnCompletion([state, callback](const Future<void>& future) {
+        Error error = static_cast<Error>(future.error());
+        {
+          std::lock_guard<std::mutex> lock(state->mutex);
+          if (error == Error::kErrorOk) {
+            ++state->stats.committed;
+          } else {
+            ++state->stats.failed;
+          }
+        }
+        callback(error, future.error_message(), 1);
+      });
+}
+
+TransactionRetryStats TransactionRunner::stats() const {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  TransactionRetryStats stats = state_->stats;
+  stats.backoff = std::chrono::milliseconds(
+      static_cast<int64_t>(state_->backoff));
+  return stats;
+}
+
+void TransactionRunner::Attempt(std::shared_ptr<State> state, Update update,
+                                Callback callback, int attempt) {
+  // The runner does its own retries, with backoff.
+  TransactionOptions transaction_options;
+  transaction_options.set_max_attempts(1);
+
+  state->db->RunTransaction(transaction_options, update)
+      .OnCompletion([state, update, callback,
+                     attempt](const Future<void>& future) {
+        Error error = static_cast<Error>(future.error());
+        const TransactionRetryOptions& options = state->options;
+        double min_backoff = static_cast<double>(options.min_backoff.count());
+        double max_backoff = static_cast<double>(options.max_backoff.count());
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        if (error == Error::kErrorOk) {
+          ++state->stats.committed;
+          if (options.adaptive) {
+            state->backoff = std::max(min_backoff, state->backoff * 0.75);
+          }
+          lock.unlock();
+          callback(error, "", attempt);
+          return;
+        }
+
+        if (!IsRetryable(error) || attempt >= options.max_attempts) {
+          ++state->stats.failed;
+          lock.unlock();
+          callback(error, future.error_message(), attempt);
+          return;
+        }
+
+        ++state->stats.retries;
+        if (options.adaptive) {
+          state->backoff = std::min(max_backoff, state->backoff * 2);
+        }
+        // "Full jitter": anywhere between zero and the exponential bound, so
+        // that clients which conflicted together retry apart.
+        double growth = static_cast<double>(1 << std::min(attempt - 1, 10));
+        double bound = std::min(max_backoff, state->backoff * growth);
+        std::uniform_real_distribution<double> jitter(0, bound);
+        std::chrono::milliseconds delay(
+            std::max<int64_t>(1, static_cast<int64_t>(jitter(state->rng))));
+        lock.unlock();
+
+        RunAfter(delay, [state, update, callback, attempt] {
+          Attempt(state, update, callback, attempt + 1);
+        });
+      });
+}
+
+}  // namespace snippets
@@ -0,0 +1,99 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_TRANSACTION_RETRY_H
+#define FIRESTORESNIPPETSCPP_TRANSACTION_RETRY_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "firebase/firestore.h"
+
+namespace snippets {
+
+struct TransactionRetryOptions {
+  // Attempts per transaction, including the first.
+  int max_attempts = 10;
+
+  // Bounds of the delay before a retry.
+  std::chrono::milliseconds min_backoff{10};
+  std::chrono::milliseconds max_backoff{2000};
+
+  // Whether the backoff adapts to the contention seen by recent
+  // transactions. Without it, every transaction starts from `min_backoff`.
+  bool adaptive = true;
+};
+
+struct TransactionRetryStats {
+  int64_t committed = 0;
+  int64_t failed = 0;
+  // Attempts that failed with a retryable error and were tried again.
+  int64_t retries = 0;
+  // Current base backoff, which rises under contention and decays as
+  // transactions succeed.
+  std::chrono::milliseconds backoff{0};
+};
+
+// Runs transactions with jittered, contention-aware backoff.
+//
+// `Firestore::RunTransaction()` retries a conflicting transaction straight
+// away, so clients that contend for one document keep colliding. This runner
+// makes the SDK try each transaction only once and schedules retries itself:
+// each retry waits a random delay of up to `base * 2^attempt`, where `base`
+// is shared by all transactions of the runner. It doubles whenever a
+// transaction conflicts and shrinks a little after each commit, so the
+// clients spread out while contention lasts and speed up again afterwards.
+//
+// For a plain counter no transaction is needed at all; `Increment()` applies
+// `FieldValue::Increment()` on the server, which never conflicts.
+class TransactionRunner {
+ public:
+  using Update = std::function<firebase::firestore::Error(
+      firebase::firestore::Transaction&, std::string&)>;
+  // `attempts` is the number of times the transaction ran.
+  using Callback = std::function<void(firebase::firestore::Error,
+                                      const std::string&, int attempts)>;
+
+  explicit TransactionRunner(
+      firebase::firestore::Firestore* db,
+      TransactionRetryOptions options = TransactionRetryOptions());
+
+  // Runs `update` in a transaction and calls `callback` once it commits, fails
+  // with a non-retryable error, or runs out of attempts. `update` may run
+  // several times, and must not have side effects outside the transaction.
+  void Run(Update update, Callback callback);
+
+  // Adds `delta` to `field` of `document` without a transaction.
+  void Increment(const firebase::firestore::DocumentReference& document,
+                 const std::string& field, int64_t delta, Callback callback);
+
+  TransactionRetryStats stats() const;
+
+ private:
+  struct State;
+
+  static void Attempt(std::shared_ptr<State> state, Update update,
+                      Callback callback, int attempt);
+
+  std::shared_ptr<State> state_;
+};
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_TRANSACTION_RETRY_H
@@ -0,0 +1,179 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#include "warmup_planner.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <utility>
+
+#include "future_combinators.h"
+#include "query_spec_json.h"
+
+namespace snippets {
+
+using firebase::Future;
+using firebase::firestore::Error;
+using firebase::firestore::Firestore;
+using firebase::firestore::QuerySnapshot;
+
+WarmupPlanner::WarmupPlanner(Firestore* db, WarmupPlannerOptions options)
+    : db_(db), options_(std::move(options)) {}
+
+bool WarmupPlanner::Load(std::string* error_message) {
+  std::ifstream in(options_.path);
+  if (!in) {
+    // No history yet.
+    return true;
+  }
+
+  // Each line is "<score>\t<query as JSON>".
+  std::string line;
+  std::lock_guard<std::mutex> lock(mutex_);
+  while (std::getline(in, line)) {
+    size_t tab = line.find('\t');
+    if (tab == std::string::npos) {
+      continue;
+    }
+    QuerySpec spec;
+    std::string parse_error;
+    if (!ParseQuerySpecJson(db_, line.substr(tab + 1), &spec, &parse_error)) {
+      continue;
+    }
+    double score = std::strtod(line.substr(0, tab).c_str(), nullptr);
+    Entry& entry = entries_[spec.CanonicalKey()];
+    entry.spec = std::move(spec);
+    entry.score += score * options_.decay;
+  }
+  if (in.bad()) {
+    *error_message = "can't read " + options_.path;
+    return false;
+  }
+  return true;
+}
+
+void WarmupPlanner::Record(const QuerySpec& spec) {
+  std::string key = spec.CanonicalKey();
+  std::lock_guard<std::mutex> lock(mutex_);
+  Entry& entry = entries_[key];
+  if (entry.score == 0) {
+    entry.spec = spec;
+  }
+  entry.score += 1;
+}
+
+std::vector<const WarmupPlanner::Entry*> WarmupPlanner::TopEntries(
+    size_t limit) const {
+  std::vector<std::pair<const std::string*, const Entry*>> sorted;
+  sorted.reserve(entries_.size());
+  for (const auto& entry : entries_) {
+    sorted.emplace_back(&entry.first, &entry.second);
+  }
+  // Ties are broken by key, so that the plan is stable between runs.
+  auto by_score = [](const std::pair<const std::string*, const Entry*>& left,
+                     const std::pair<const std::string*, const Entry*>& right) {
+    if (left.second->score != right.second->score) {
+      return left.second->score > right.second->score;
+    }
+    return *left.first < *right.first;
+  };
+  size_t count = std::min(limit, sorted.size());
+  std::partial_sort(sorted.begin(), sorted.begin() + count, sorted.end(),
+                    by_score);
+
+  std::vector<const Entry*> top;
+  top.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    top.push_back(sorted[i].second);
+  }
+  return top;
+}
+
+bool WarmupPlanner::Save(std::string* error_message) const {
+  std::string contents;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const Entry* entry : TopEntries(options_.max_entries)) {
+      char score[32];
+      std::snprintf(score, sizeof(score), "%.6g\t", entry->score);
+      contents.append(score);
+      contents.append(QuerySpecToJson(entry->spec));
+      contents.push_back('\n');
+    }
+  }
+
+  // Written next to the history and renamed over it, so that a crash while
+  // saving leaves the previous history intact.
+  std::string temporary = options_.path + ".tmp";
+  {
+    std::ofstream out(temporary, std::ios::trunc);
+    out << contents;
+    if (!out.flush()) {
+      *error_message = "can't write " + temporary;
+      return false;
+    }
+  }
+  if (std::rename(temporary.c_str(), options_.path.c_str()) != 0) {
+    *error_message = "can't replace " + options_.path;
+    return false;
+  }
+  return true;
+}
+
+std::vector<QuerySpec> WarmupPlanner::Plan() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<QuerySpec> plan;
+  for (const Entry* entry : TopEntries(options_.top_k)) {
+    plan.push_back(entry->spec);
+  }
+  return plan;
+}
+
+void WarmupPlanner::WarmUp(
+    std::function<void(const WarmupResult&)> callback) const {
+  std::vector<Future<QuerySnapshot>> reads;
+  for (const QuerySpec& spec : Plan()) {
+    reads.push_back(spec.ToQuery(db_).Get(options_.source));
+  }
+  if (reads.empty()) {
+    callback(WarmupResult());
+    return;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  WhenAll<Future<QuerySnapshot>>(
+      std::move(reads),
+      [start, callback](const std::vector<Future<QuerySnapshot>>& done) {
+        WarmupResult result;
+        result.queries = static_cast<int>(done.size());
+        for (const Future<QuerySnapshot>& read : done) {
+          if (read.error() == Error::kErrorOk) {
+            result.documents += static_cast<int64_t>(read.result()->size());
+          } else {
+            ++result.failed;
+          }
+        }
+        result.elapsed_seconds = std::chrono::duration<double>(
+                                     std::chrono::steady_clock::now() - start)
+                                     .count();
+        callback(result);
+      });
+}
+
+}  // namespace snippets
@@ -0,0 +1,109 @@
+//
+//  Copyright (c) 2020 Google Inc.
+//
+//  Licensed under the Apache License, Version 2.0 (the "License");
+//  you may not use this file except in compliance with the License.
+//  You may obtain a copy of the License at
+//
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+//
+
+#ifndef FIRESTORESNIPPETSCPP_WARMUP_PLANNER_H
+#define FIRESTORESNIPPETSCPP_WARMUP_PLANNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "firebase/firestore.h"
+#include "query_spec.h"
+
+namespace snippets {
+
+struct WarmupPlannerOptions {
+  // File in which the query history is kept between sessions, e.g. in the
+  // app's files directory.
+  std::string path;
+
+  // Number of queries that `WarmUp()` runs.
+  size_t top_k = 8;
+
+  // Number of queries kept in the history.
+  size_t max_entries = 64;
+
+  // Weight of earlier sessions' counts, applied once per session, so that
+  // queries the app has stopped running fade out of the plan.
+  double decay = 0.5;
+
+  firebase::firestore::Source source = firebase::firestore::Source::kDefault;
+};
+
+struct WarmupResult {
+  int queries = 0;
+  int failed = 0;
+  int64_t documents = 0;
+  double elapsed_seconds = 0;
+};
+
+// Learns which queries an app runs, and runs them ahead of time in later
+// sessions so that their results are in the offline cache before the UI asks
+// for them.
+//
+// Call `Record()` wherever a query runs and `Save()` when the app goes to the
+// background. At the next start, call `Load()` and `WarmUp()` right after
+// `Firestore::GetInstance()`; the most frequently recorded queries run in
+// parallel, and the screens that need them then read from the cache.
+//
+// Thread-safe.
+class WarmupPlanner {
+ public:
+  WarmupPlanner(firebase::firestore::Firestore* db,
+                WarmupPlannerOptions options);
+
+  // Reads the history saved by earlier sessions. A missing file is not an
+  // error; an unreadable entry is skipped.
+  bool Load(std::string* error_message);
+
+  // Counts one run of `spec` in this session.
+  void Record(const QuerySpec& spec);
+
+  // Writes the history, replacing the file atomically.
+  bool Save(std::string* error_message) const;
+
+  // Returns the `top_k` queries with the highest scores.
+  std::vector<QuerySpec> Plan() const;
+
+  // Runs the planned queries in parallel, and calls `callback` once they
+  // have all finished.
+  void WarmUp(std::function<void(const WarmupResult&)> callback) const;
+
+ private:
+  struct Entry {
+    QuerySpec spec;
+    double score = 0;
+  };
+
+  // Entries sorted by descending score, at most `limit` of them.
+  std::vector<const Entry*> TopEntries(size_t limit) const;
+
+  firebase::firestore::Firestore* db_ = nullptr;
+  WarmupPlannerOptions options_;
+
+  mutable std::mutex mutex_;
+  // Keyed by `QuerySpec::CanonicalKey()`.
+  std::unordered_map<std::string, Entry> entries_;
+};
+
+}  // namespace snippets
+
+#endif  // FIRESTORESNIPPETSCPP_WARMUP_PLANNER_H